@@ -10,28 +10,16 @@
 #undef length
 #endif
 
-// Вместо включения всего Accelerate, который вызывает конфликты,
-// мы включаем только необходимые для BLAS заголовочные файлы
+#include "blas_backend.h"
+#include "blas_info.h"
+#include "matmul_stats.h"
 
-// Определения для CBLAS
-#define CBLAS_ORDER int
-#define CBLAS_TRANSPOSE int
-#define CblasRowMajor 101
-#define CblasColMajor 102
-#define CblasNoTrans 111
-#define CblasTrans 112
-
-// Прототип функции cblas_dgemm
-extern "C" {
-    void cblas_dgemm(const CBLAS_ORDER Order, const CBLAS_TRANSPOSE TransA, const CBLAS_TRANSPOSE TransB,
-                    const int M, const int N, const int K,
-                    const double alpha, const double *A, const int lda,
-                    const double *B, const int ldb, const double beta,
-                    double *C, const int ldc);
-}
-
-// Оптимизированная реализация матричного умножения с использованием Apple Accelerate Framework
+// Умножение матриц через оптимизированный BLAS (на macOS - Apple Accelerate Framework)
 extern "C" SEXP cpp_mmAccelerate(SEXP A_r, SEXP B_r) {
+  unsigned call = mp_stats_begin(MP_STATS_BLAS);
+  if (!Rf_isReal(A_r) || !Rf_isReal(B_r) || !Rf_isMatrix(A_r) || !Rf_isMatrix(B_r)) {
+    Rf_error("A и B должны быть матрицами типа double");
+  }
   // Получаем размеры матриц из атрибутов R объектов
   SEXP dim_A = Rf_getAttrib(A_r, R_DimSymbol);
   SEXP dim_B = Rf_getAttrib(B_r, R_DimSymbol);
@@ -44,40 +32,55 @@ extern "C" SEXP cpp_mmAccelerate(SEXP A_r, SEXP B_r) {
   if (k != p) {
     Rf_error("Несовместимые размеры матриц");
   }
+  mp_stats_mark(MP_PHASE_SETUP);
   
   // Создаем результирующую матрицу
   SEXP C_r = PROTECT(Rf_allocMatrix(REALSXP, m, n));
+  mp_stats_mark(MP_PHASE_ALLOC);
   double *A = REAL(A_r);
   double *B = REAL(B_r);
   double *C = REAL(C_r);
   
-  // Используем CBLAS из Accelerate Framework для умножения матриц
-  // C = alpha * A * B + beta * C
-  // Где A, B и C - матрицы, alpha и beta - скаляры
-  
-  // Параметры:
-  // CblasRowMajor: матрицы хранятся по строкам
-  // CblasNoTrans: матрицы не транспонированы
-  // m: количество строк в A и C
-  // n: количество столбцов в B и C
-  // k: количество столбцов в A и строк в B
-  // alpha: скаляр для A*B
-  // A: указатель на матрицу A
-  // lda: шаг между строками A
-  // B: указатель на матрицу B
-  // ldb: шаг между строками B
-  // beta: скаляр для C
-  // C: указатель на матрицу C
-  // ldc: шаг между строками C
-  
-  // Примечание: R хранит матрицы в формате column-major,
-  // поэтому мы вычисляем B * A вместо A * B
-  cblas_dgemm(CblasColMajor, CblasNoTrans, CblasNoTrans,
-              m, n, k,
-              1.0, A, m,
-              B, k,
-              0.0, C, m);
+  // dgemm бэкенда, выбранного configure (Accelerate, OpenBLAS, MKL, BLIS
+  // или BLAS самого R); матрицы R в формате column-major передаются как есть
+  mp_blas_dgemm(0, 0, m, n, k, 1.0, A, m, B, k, 0.0, C, m);
+  mp_stats_mark(MP_PHASE_KERNEL);
+  mp_stats_end_product(call, m, n, k, sizeof(double));
   
   UNPROTECT(1);
   return C_r;
 }
+
+// Бэкенд BLAS: выбранный при сборке, фактически загруженный в процесс и
+// число его потоков (NA, если библиотека его не сообщает), а также собраны
+// ли ядра Rust (configure определяет MATRIXPROD_HAVE_RUST)
+extern "C" SEXP blas_backend_info() {
+  SEXP result = PROTECT(Rf_allocVector(VECSXP, 4));
+  SEXP names = PROTECT(Rf_allocVector(STRSXP, 4));
+  int threads = mp_blas_threads();
+  SET_VECTOR_ELT(result, 0, Rf_mkString(mp_blas_backend()));
+  SET_VECTOR_ELT(result, 1, Rf_mkString(mp_blas_vendor()));
+  SET_VECTOR_ELT(result, 2, Rf_ScalarInteger(threads > 0 ? threads : NA_INTEGER));
+#ifdef MATRIXPROD_HAVE_RUST
+  SET_VECTOR_ELT(result, 3, Rf_ScalarLogical(TRUE));
+#else
+  SET_VECTOR_ELT(result, 3, Rf_ScalarLogical(FALSE));
+#endif
+  SET_STRING_ELT(names, 0, Rf_mkChar("backend"));
+  SET_STRING_ELT(names, 1, Rf_mkChar("vendor"));
+  SET_STRING_ELT(names, 2, Rf_mkChar("threads"));
+  SET_STRING_ELT(names, 3, Rf_mkChar("rust"));
+  Rf_setAttrib(result, R_NamesSymbol, names);
+  UNPROTECT(2);
+  return result;
+}
+
+// Устанавливает число потоков BLAS; возвращает TRUE, если библиотека это
+// поддерживает
+extern "C" SEXP set_blas_threads(SEXP threads_r) {
+  int threads = Rf_asInteger(threads_r);
+  if (threads == NA_INTEGER || threads < 1) {
+    Rf_error("Число потоков должно быть положительным целым");
+  }
+  return Rf_ScalarLogical(mp_blas_set_threads(threads));
+}
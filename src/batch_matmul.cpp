@@ -0,0 +1,292 @@
+// Пакетное умножение матриц: множество произведений за один вызов .Call.
+// Все проверки выполняются один раз в главном потоке R, после чего
+// произведения распределяются по пулу потоков; малые произведения
+// объединяются в задачи, чтобы диспетчеризация не стоила больше счета.
+#define R_NO_REMAP
+#include <R.h>
+#include <Rinternals.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "fixed_kernels.h"
+#include "gebp_engine.h"
+#include "matmul_stats.h"
+#include "tile_pool.h"
+
+#ifdef MATRIXPROD_HAVE_DGEMM_BATCH
+// Групповой пакетный интерфейс CBLAS (MKL, OpenBLAS >= 0.3.27)
+#define CBLAS_LAYOUT int
+#define CBLAS_TRANSPOSE int
+#define CblasColMajor 102
+#define CblasNoTrans 111
+extern "C" void cblas_dgemm_batch(const CBLAS_LAYOUT Layout,
+                                  const CBLAS_TRANSPOSE *TransA_array, const CBLAS_TRANSPOSE *TransB_array,
+                                  const int *M_array, const int *N_array, const int *K_array,
+                                  const double *alpha_array, const double **A_array, const int *lda_array,
+                                  const double **B_array, const int *ldb_array, const double *beta_array,
+                                  double **C_array, const int *ldc_array,
+                                  const int group_count, const int *group_size);
+#endif
+
+namespace {
+
+// Произведения, у которых все размеры не больше этого значения, считаются
+// малым ядром без упаковки: на таких размерах накладные расходы BLAS и
+// упаковки панелей больше самого умножения
+const int kSmallKernelMaxDim = 64;
+
+// Минимальный объем работы (m * n * k) задачи пула: подряд идущие малые
+// произведения объединяются, пока их суммарный объем меньше
+const double kMinTaskWork = 1 << 16;
+
+// Произведения от этого объема при пакете меньше числа потоков считаются
+// по одному на всем пуле: одно произведение на поток оставило бы остальные
+// потоки без работы
+const double kSplitMinWork = 1 << 21;
+
+struct Product {
+  int m, k, n;
+  const double *A;
+  const double *B;
+  double *C;
+  mp_fixed_fn fixed;   // ядро фиксированного размера или NULL
+};
+
+struct BatchJob {
+  std::vector<const Product *> items;
+  std::vector<int> starts;   // первое произведение каждой задачи и конец пакета
+};
+
+void product_task(int task, int worker, void *ctx) {
+  (void) worker;
+  const BatchJob *job = (const BatchJob *) ctx;
+  for (int i = job->starts[task]; i < job->starts[task + 1]; i++) {
+    const Product &p = *job->items[i];
+    if (p.fixed != NULL) {
+      // Фиксированные размеры (4 x 4, 8 x 8, ...) - специализированное ядро
+      p.fixed(p.A, p.B, p.C);
+    } else if (p.m <= kSmallKernelMaxDim && p.n <= kSmallKernelMaxDim && p.k <= kSmallKernelMaxDim) {
+      mp_small_dgemm(p.m, p.n, p.k, p.A, p.m, p.B, p.k, p.C, p.m);
+    } else {
+      // Внутри задачи пула GEBP выполняется последовательно
+      mp_gebp_dgemm(p.m, p.n, p.k, 1.0, p.A, p.m, p.B, p.k, 0.0, p.C, p.m);
+    }
+  }
+}
+
+#ifdef MATRIXPROD_HAVE_DGEMM_BATCH
+// Пакетный BLAS выгоден, когда произведения не малы и не вырождены
+bool use_blas_batch(const std::vector<Product> &products) {
+  bool any_large = false;
+  for (const Product &p : products) {
+    if (p.m == 0 || p.n == 0 || p.k == 0) return false;
+    if (p.m > kSmallKernelMaxDim || p.n > kSmallKernelMaxDim || p.k > kSmallKernelMaxDim) any_large = true;
+  }
+  return any_large;
+}
+#endif
+
+void run_products(std::vector<Product> &products, bool uniform) {
+  if (products.empty()) return;
+#ifdef MATRIXPROD_HAVE_DGEMM_BATCH
+  if (use_blas_batch(products)) {
+    // Одинаковые размеры - одна группа; иначе по группе на произведение
+    int count = (int) products.size();
+    int groups = uniform ? 1 : count;
+    std::vector<int> trans(groups, CblasNoTrans), M(groups), N(groups), K(groups), sizes(groups);
+    std::vector<double> alpha(groups, 1.0), beta(groups, 0.0);
+    std::vector<const double *> A(count), B(count);
+    std::vector<double *> C(count);
+    for (int i = 0; i < count; i++) {
+      A[i] = products[i].A;
+      B[i] = products[i].B;
+      C[i] = products[i].C;
+    }
+    for (int g = 0; g < groups; g++) {
+      M[g] = products[g].m;
+      N[g] = products[g].n;
+      K[g] = products[g].k;
+      sizes[g] = uniform ? count : 1;
+    }
+    cblas_dgemm_batch(CblasColMajor, trans.data(), trans.data(), M.data(), N.data(), K.data(),
+                      alpha.data(), A.data(), M.data(), B.data(), K.data(), beta.data(),
+                      C.data(), M.data(), groups, sizes.data());
+    return;
+  }
+#else
+  (void) uniform;
+#endif
+  bool split = (int) products.size() < mp_pool_get_threads();
+  BatchJob job;
+  double work = 0;
+  for (Product &p : products) {
+    p.fixed = mp_fixed_kernel(p.m, p.k, p.n);
+    double product_work = (double) p.m * p.n * p.k;
+    if (split && p.fixed == NULL && product_work >= kSplitMinWork) {
+      // Вызов из главного потока: GEBP распределяет плитки C по пулу
+      mp_gebp_dgemm(p.m, p.n, p.k, 1.0, p.A, p.m, p.B, p.k, 0.0, p.C, p.m);
+      continue;
+    }
+    if (job.starts.empty() || work >= kMinTaskWork) {
+      job.starts.push_back((int) job.items.size());
+      work = 0;
+    }
+    job.items.push_back(&p);
+    work += product_work + p.m * p.n;
+  }
+  if (job.items.empty()) return;
+  job.starts.push_back((int) job.items.size());
+  mp_pool_run((int) job.starts.size() - 1, product_task, &job);
+}
+
+// Завершение вызова для статистики: FLOP и байты всех произведений пакета
+void stats_end(unsigned call, const std::vector<Product> &products) {
+  if (call == 0) return;
+  double flops = 0, bytes = 0;
+  for (size_t i = 0; i < products.size(); i++) {
+    const Product &p = products[i];
+    flops += 2.0 * p.m * p.n * (double) p.k;
+    bytes += sizeof(double) * ((double) p.m * p.k + (double) p.k * p.n + (double) p.m * p.n);
+  }
+  mp_stats_end(call, flops, bytes);
+}
+
+// Размеры матрицы; false, если объект не является матрицей double
+bool matrix_dims(SEXP x, int *rows, int *cols) {
+  if (TYPEOF(x) != REALSXP) return false;
+  SEXP dim = Rf_getAttrib(x, R_DimSymbol);
+  if (TYPEOF(dim) != INTSXP || LENGTH(dim) != 2) return false;
+  *rows = INTEGER(dim)[0];
+  *cols = INTEGER(dim)[1];
+  return true;
+}
+
+bool array3_dims(SEXP x, int *rows, int *cols, int *count) {
+  if (TYPEOF(x) != REALSXP) return false;
+  SEXP dim = Rf_getAttrib(x, R_DimSymbol);
+  if (TYPEOF(dim) != INTSXP || LENGTH(dim) != 3) return false;
+  *rows = INTEGER(dim)[0];
+  *cols = INTEGER(dim)[1];
+  *count = INTEGER(dim)[2];
+  return true;
+}
+
+// Трехмерные массивы m x k x b и k x n x b (или одна матрица для
+// всех элементов пакета) -> один массив результата m x n x b
+SEXP batch_stacked(SEXP A_r, SEXP B_r, unsigned call) {
+  int m = 0, k = 0, count_a = 1, kb = 0, n = 0, count_b = 1;
+  bool a_stacked = array3_dims(A_r, &m, &k, &count_a);
+  bool b_stacked = array3_dims(B_r, &kb, &n, &count_b);
+  if (!a_stacked && !matrix_dims(A_r, &m, &k)) {
+    Rf_error("A должен быть трехмерным массивом или матрицей типа double");
+  }
+  if (!b_stacked && !matrix_dims(B_r, &kb, &n)) {
+    Rf_error("B должен быть трехмерным массивом или матрицей типа double");
+  }
+  if (k != kb) {
+    Rf_error("Несовместимые размеры матриц");
+  }
+  if (a_stacked && b_stacked && count_a != count_b) {
+    Rf_error("Количество матриц в A и B не совпадает");
+  }
+  int count = a_stacked ? count_a : count_b;
+  mp_stats_mark(MP_PHASE_SETUP);
+
+  SEXP C_r = PROTECT(Rf_alloc3DArray(REALSXP, m, n, count));
+  const double *A = REAL(A_r);
+  const double *B = REAL(B_r);
+  double *C = REAL(C_r);
+
+  std::vector<Product> products(count);
+  for (int i = 0; i < count; i++) {
+    products[i].m = m;
+    products[i].k = k;
+    products[i].n = n;
+    products[i].A = A + (a_stacked ? (R_xlen_t) i * m * k : 0);
+    products[i].B = B + (b_stacked ? (R_xlen_t) i * k * n : 0);
+    products[i].C = C + (R_xlen_t) i * m * n;
+  }
+  mp_stats_mark(MP_PHASE_ALLOC);
+  run_products(products, true);
+  mp_stats_mark(MP_PHASE_KERNEL);
+  stats_end(call, products);
+
+  UNPROTECT(1);
+  return C_r;
+}
+
+// Списки матриц произвольных размеров (или одна матрица для всех
+// элементов) -> список результатов
+SEXP batch_list(SEXP A_r, SEXP B_r, unsigned call) {
+  bool a_list = TYPEOF(A_r) == VECSXP;
+  bool b_list = TYPEOF(B_r) == VECSXP;
+  R_xlen_t count_a = a_list ? XLENGTH(A_r) : 1;
+  R_xlen_t count_b = b_list ? XLENGTH(B_r) : 1;
+  if (a_list && b_list && count_a != count_b) {
+    Rf_error("Количество матриц в A и B не совпадает");
+  }
+  R_xlen_t count = a_list ? count_a : count_b;
+
+  // Проверяем все элементы до выделения памяти: Rf_error не вызывает
+  // деструкторы объектов C++
+  for (R_xlen_t i = 0; i < count; i++) {
+    SEXP Ai = a_list ? VECTOR_ELT(A_r, i) : A_r;
+    SEXP Bi = b_list ? VECTOR_ELT(B_r, i) : B_r;
+    int m = 0, k = 0, kb = 0, n = 0;
+    if (!matrix_dims(Ai, &m, &k) || !matrix_dims(Bi, &kb, &n)) {
+      Rf_error("Элемент %d: ожидаются матрицы типа double", (int) i + 1);
+    }
+    if (k != kb) {
+      Rf_error("Элемент %d: несовместимые размеры матриц", (int) i + 1);
+    }
+  }
+  mp_stats_mark(MP_PHASE_SETUP);
+
+  // Все результаты выделяются до создания контейнеров C++: при нехватке
+  // памяти Rf_allocMatrix выходит через longjmp, и вектор не освободился бы
+  SEXP result = PROTECT(Rf_allocVector(VECSXP, count));
+  for (R_xlen_t i = 0; i < count; i++) {
+    SEXP Ai = a_list ? VECTOR_ELT(A_r, i) : A_r;
+    SEXP Bi = b_list ? VECTOR_ELT(B_r, i) : B_r;
+    int m = 0, k = 0, kb = 0, n = 0;
+    if (!matrix_dims(Ai, &m, &k) || !matrix_dims(Bi, &kb, &n)) {
+      Rf_error("Элемент %d: ожидаются матрицы типа double", (int) i + 1);
+    }
+    SET_VECTOR_ELT(result, i, Rf_allocMatrix(REALSXP, m, n));
+  }
+
+  std::vector<Product> products(count);
+  bool uniform = true;
+  for (R_xlen_t i = 0; i < count; i++) {
+    SEXP Ai = a_list ? VECTOR_ELT(A_r, i) : A_r;
+    SEXP Bi = b_list ? VECTOR_ELT(B_r, i) : B_r;
+    SEXP Ci = VECTOR_ELT(result, i);
+    int m = Rf_nrows(Ci), k = Rf_ncols(Ai), n = Rf_ncols(Ci);
+
+    products[i].m = m;
+    products[i].k = k;
+    products[i].n = n;
+    products[i].A = REAL(Ai);
+    products[i].B = REAL(Bi);
+    products[i].C = REAL(Ci);
+    if (i > 0 && (m != products[0].m || k != products[0].k || n != products[0].n)) uniform = false;
+  }
+  mp_stats_mark(MP_PHASE_ALLOC);
+  run_products(products, uniform);
+  mp_stats_mark(MP_PHASE_KERNEL);
+  stats_end(call, products);
+
+  UNPROTECT(1);
+  return result;
+}
+
+}  // namespace
+
+extern "C" SEXP batch_matmul(SEXP A_r, SEXP B_r) {
+  unsigned call = mp_stats_begin(MP_STATS_BATCH);
+  if (TYPEOF(A_r) == VECSXP || TYPEOF(B_r) == VECSXP) {
+    return batch_list(A_r, B_r, call);
+  }
+  return batch_stacked(A_r, B_r, call);
+}
@@ -0,0 +1,369 @@
+// Нативные замеры для benchmark_suite(): время ядра без обертки R (буфер
+// результата выделяется один раз, ядро вызывается в цикле) и граница
+// roofline машины - пиковая производительность FMA и пропускная
+// способность памяти, измеренные на пуле потоков.
+#define R_NO_REMAP
+#include <R.h>
+#include <Rinternals.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <new>
+#include <vector>
+
+#if defined(__AVX2__) && defined(__FMA__)
+#include <immintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#include "blas_backend.h"
+#include "cpu_info.h"
+#include "fixed_kernels.h"
+#include "gebp_engine.h"
+#include "skinny_matmul.h"
+#include "tile_pool.h"
+
+extern "C" {
+void rust_mm_optimized_ld(const double *a_ptr, int lda, const double *b_ptr, int ldb,
+                          double *c_ptr, int ldc, int m, int k, int n);
+void rust_mm_gemm(int trans_a, int trans_b, int m, int n, int k,
+                  double alpha, const double *a_ptr, int lda,
+                  const double *b_ptr, int ldb,
+                  double beta, double *c_ptr, int ldc);
+int mp_metal_dgemm(int trans_a, int trans_b, int M, int N, int K, double alpha,
+                   const double *A, int lda, const double *B, int ldb,
+                   double beta, double *C, int ldc);
+SEXP batch_matmul(SEXP A_r, SEXP B_r);
+}
+
+namespace {
+
+const char *const kBenchKernels[] = {"rust_tiny", "rust_blocked", "cpp_accelerate", "metal_gpu",
+                                     "block_huge", "skinny", "fixed"};
+enum { kRustTiny, kRustBlocked, kBlas, kMetal, kBlockHuge, kSkinny, kFixed, kBenchKernelCount };
+
+double now_seconds() {
+  return std::chrono::duration<double>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+struct Problem {
+  int trans_a, trans_b, m, n, k;
+  const double *A;
+  int lda;
+  const double *B;
+  int ldb;
+  double *C;
+};
+
+// Один вызов ядра; false, если ядро не поддерживает эту форму
+bool run_kernel(int kernel, const Problem &p) {
+  bool plain = !p.trans_a && !p.trans_b;
+  switch (kernel) {
+  case kRustTiny:
+    if (!plain) return false;
+    rust_mm_optimized_ld(p.A, p.lda, p.B, p.ldb, p.C, p.m > 0 ? p.m : 1, p.m, p.k, p.n);
+    return true;
+  case kRustBlocked:
+    rust_mm_gemm(p.trans_a, p.trans_b, p.m, p.n, p.k, 1.0, p.A, p.lda, p.B, p.ldb, 0.0, p.C,
+                 p.m > 0 ? p.m : 1);
+    return true;
+  case kBlas:
+    mp_blas_dgemm(p.trans_a, p.trans_b, p.m, p.n, p.k, 1.0, p.A, p.lda, p.B, p.ldb, 0.0, p.C,
+                  p.m > 0 ? p.m : 1);
+    return true;
+  case kMetal:
+    return mp_metal_dgemm(p.trans_a, p.trans_b, p.m, p.n, p.k, 1.0, p.A, p.lda, p.B, p.ldb, 0.0,
+                          p.C, p.m > 0 ? p.m : 1) != 0;
+  case kBlockHuge:
+    mp_gebp_dgemm_ex(p.trans_a, p.trans_b, p.m, p.n, p.k, 1.0, p.A, p.lda, p.B, p.ldb, 0.0, p.C,
+                     p.m > 0 ? p.m : 1);
+    return true;
+  case kSkinny:
+    return plain && mp_skinny_dgemm(p.m, p.n, p.k, p.A, p.lda, p.B, p.ldb, p.C, p.m > 0 ? p.m : 1);
+  case kFixed: {
+    if (!plain || p.m > MP_FIXED_MAX || p.n > MP_FIXED_MAX || p.k > MP_FIXED_MAX) return false;
+    mp_fixed_fn fixed = mp_fixed_kernel(p.m, p.k, p.n);
+    if (fixed != NULL) {
+      fixed(p.A, p.B, p.C);
+    } else {
+      mp_small_dgemm(p.m, p.n, p.k, p.A, p.lda, p.B, p.ldb, p.C, p.m > 0 ? p.m : 1);
+    }
+    return true;
+  }
+  }
+  return false;
+}
+
+int kernel_index(SEXP kernel_r) {
+  if (!Rf_isString(kernel_r) || Rf_length(kernel_r) != 1) {
+    Rf_error("Ядро должно быть строкой");
+  }
+  const char *kernel = CHAR(STRING_ELT(kernel_r, 0));
+  for (int i = 0; i < kBenchKernelCount; i++) {
+    if (std::strcmp(kernel, kBenchKernels[i]) == 0) return i;
+  }
+  Rf_error("Неизвестное ядро: %s", kernel);
+  return -1;
+}
+
+// Параметры замера: samples замеров, каждый не короче min_time секунд
+// (ядро повторяется в цикле); если первый вызов дольше max_time, он
+// остается единственным замером
+struct Limits {
+  int samples;
+  double min_time, max_time;
+};
+
+Limits bench_limits(SEXP samples_r, SEXP limits_r) {
+  if (!Rf_isNumeric(samples_r) || Rf_length(samples_r) != 1 || Rf_asInteger(samples_r) < 1) {
+    Rf_error("Число замеров должно быть положительным");
+  }
+  if (!Rf_isReal(limits_r) || Rf_length(limits_r) != 2) {
+    Rf_error("Ограничения времени должны быть вектором c(min_time, max_time)");
+  }
+  Limits limits = {Rf_asInteger(samples_r), REAL(limits_r)[0], REAL(limits_r)[1]};
+  return limits;
+}
+
+// Времена одного вызова (секунды) по замерам; fn возвращает false, если
+// форма не поддерживается - тогда результат пуст
+template <typename Fn>
+std::vector<double> time_calls(const Limits &limits, Fn fn) {
+  std::vector<double> times;
+  double start = now_seconds();
+  if (!fn()) return times;
+  double first = now_seconds() - start;
+  if (first > limits.max_time) {
+    times.push_back(first);
+    return times;
+  }
+  long calls = std::max(1L, (long) (limits.min_time / std::max(first, 1e-9)));
+  for (int s = 0; s < limits.samples; s++) {
+    start = now_seconds();
+    for (long c = 0; c < calls; c++) fn();
+    times.push_back((now_seconds() - start) / calls);
+  }
+  return times;
+}
+
+SEXP times_vector(const std::vector<double> &times) {
+  SEXP result = PROTECT(Rf_allocVector(REALSXP, (R_xlen_t) times.size()));
+  std::copy(times.begin(), times.end(), REAL(result));
+  UNPROTECT(1);
+  return result;
+}
+
+// Пиковая производительность: независимые цепочки FMA в регистрах (их
+// число покрывает задержку FMA на всех конвейерах)
+struct PeakJob {
+  long iterations;
+  std::vector<double> sink;
+};
+
+const double kPeakFlopsPerIteration =
+#if defined(__AVX2__) && defined(__FMA__)
+    10 * 4 * 2;
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+    16 * 2 * 2;
+#else
+    8 * 2;
+#endif
+
+double peak_loop(long iterations) {
+#if defined(__AVX2__) && defined(__FMA__)
+  __m256d x = _mm256_set1_pd(0.9999999), y = _mm256_set1_pd(1e-7);
+  __m256d acc[10];
+  for (int i = 0; i < 10; i++) acc[i] = _mm256_set1_pd(i);
+  for (long it = 0; it < iterations; it++) {
+    for (int i = 0; i < 10; i++) acc[i] = _mm256_fmadd_pd(acc[i], x, y);
+  }
+  __m256d s = acc[0];
+  for (int i = 1; i < 10; i++) s = _mm256_add_pd(s, acc[i]);
+  double out[4];
+  _mm256_storeu_pd(out, s);
+  return out[0] + out[1] + out[2] + out[3];
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+  float64x2_t x = vdupq_n_f64(0.9999999), y = vdupq_n_f64(1e-7);
+  float64x2_t acc[16];
+  for (int i = 0; i < 16; i++) acc[i] = vdupq_n_f64(i);
+  for (long it = 0; it < iterations; it++) {
+    for (int i = 0; i < 16; i++) acc[i] = vfmaq_f64(y, acc[i], x);
+  }
+  float64x2_t s = acc[0];
+  for (int i = 1; i < 16; i++) s = vaddq_f64(s, acc[i]);
+  return vaddvq_f64(s);
+#else
+  double acc[8];
+  for (int i = 0; i < 8; i++) acc[i] = i;
+  for (long it = 0; it < iterations; it++) {
+    for (int i = 0; i < 8; i++) acc[i] = acc[i] * 0.9999999 + 1e-7;
+  }
+  double s = 0.0;
+  for (int i = 0; i < 8; i++) s += acc[i];
+  return s;
+#endif
+}
+
+void peak_task(int task, int worker, void *ctx) {
+  (void) worker;
+  PeakJob *job = (PeakJob *) ctx;
+  job->sink[task] = peak_loop(job->iterations);
+}
+
+// Пропускная способность: чтение буфера, который больше L3, полосами по потокам
+struct StreamJob {
+  const double *data;
+  size_t size, chunk;
+  std::vector<double> sink;
+};
+
+void stream_task(int task, int worker, void *ctx) {
+  (void) worker;
+  StreamJob *job = (StreamJob *) ctx;
+  size_t begin = (size_t) task * job->chunk;
+  size_t end = std::min(job->size, begin + job->chunk);
+  double s[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+  size_t i = begin;
+  for (; i + 8 <= end; i += 8) {
+    for (int t = 0; t < 8; t++) s[t] += job->data[i + t];
+  }
+  for (; i < end; i++) s[0] += job->data[i];
+  job->sink[task] = s[0] + s[1] + s[2] + s[3] + s[4] + s[5] + s[6] + s[7];
+}
+
+void fill_task(int task, int worker, void *ctx) {
+  (void) worker;
+  StreamJob *job = (StreamJob *) ctx;
+  size_t begin = (size_t) task * job->chunk;
+  size_t end = std::min(job->size, begin + job->chunk);
+  double *data = (double *) job->data;
+  for (size_t i = begin; i < end; i++) data[i] = 1.0;
+}
+
+// c(пик GFLOPS на всех потоках, пик одного ядра, ГБ/с); NULL при успехе
+const char *measure_roofline(double *out) {
+  int threads = mp_pool_get_threads();
+  try {
+    // Число итераций подбирается так, чтобы цикл шел около 50 мс
+    long iterations = 1 << 16;
+    double elapsed = 0.0;
+    for (;;) {
+      double start = now_seconds();
+      volatile double sink = peak_loop(iterations);
+      (void) sink;
+      elapsed = now_seconds() - start;
+      if (elapsed > 0.05 || iterations > (1L << 40)) break;
+      iterations *= 4;
+    }
+    out[1] = kPeakFlopsPerIteration * iterations / elapsed * 1e-9;
+
+    PeakJob peak;
+    peak.iterations = iterations;
+    peak.sink.resize(threads);
+    double start = now_seconds();
+    mp_pool_run(threads, peak_task, &peak);
+    out[0] = kPeakFlopsPerIteration * iterations * threads / (now_seconds() - start) * 1e-9;
+
+    // Буфер в 4 раза больше L3 (не меньше 64 МБ); заполняется потоками
+    // пула, чтобы страницы оказались на их NUMA-узлах
+    const mp_cache_info *cache = mp_get_cache_info();
+    size_t bytes = std::max((size_t) 64 << 20, (size_t) std::max(cache->l3, 0L) * 4);
+    std::vector<double> buffer(bytes / sizeof(double));
+    StreamJob stream;
+    stream.data = buffer.data();
+    stream.size = buffer.size();
+    int tasks = threads * 4;
+    stream.chunk = (stream.size + tasks - 1) / tasks;
+    stream.sink.resize(tasks);
+    mp_pool_run(tasks, fill_task, &stream);
+    double best = 1e30;
+    for (int rep = 0; rep < 3; rep++) {
+      start = now_seconds();
+      mp_pool_run(tasks, stream_task, &stream);
+      best = std::min(best, now_seconds() - start);
+    }
+    out[2] = (double) bytes / best * 1e-9;
+  } catch (const std::bad_alloc &) {
+    return "Недостаточно памяти для замера пропускной способности";
+  }
+  return NULL;
+}
+
+}  // namespace
+
+// Время одного вызова ядра kernel для op(A) * op(B) (trans_r = c(transA,
+// transB)) без обертки R; пустой вектор, если ядро не поддерживает форму
+extern "C" SEXP bench_kernel(SEXP kernel_r, SEXP A_r, SEXP B_r, SEXP trans_r, SEXP samples_r,
+                             SEXP limits_r) {
+  int kernel = kernel_index(kernel_r);
+  if (!Rf_isReal(A_r) || !Rf_isReal(B_r) || !Rf_isMatrix(A_r) || !Rf_isMatrix(B_r)) {
+    Rf_error("A и B должны быть матрицами типа double");
+  }
+  if (!Rf_isLogical(trans_r) || Rf_length(trans_r) != 2) {
+    Rf_error("trans должен быть логическим вектором длины 2");
+  }
+  Limits limits = bench_limits(samples_r, limits_r);
+  const int *dim_A = INTEGER(Rf_getAttrib(A_r, R_DimSymbol));
+  const int *dim_B = INTEGER(Rf_getAttrib(B_r, R_DimSymbol));
+
+  Problem p;
+  p.trans_a = LOGICAL(trans_r)[0] == TRUE;
+  p.trans_b = LOGICAL(trans_r)[1] == TRUE;
+  p.m = p.trans_a ? dim_A[1] : dim_A[0];
+  p.k = p.trans_a ? dim_A[0] : dim_A[1];
+  p.n = p.trans_b ? dim_B[0] : dim_B[1];
+  if ((p.trans_b ? dim_B[1] : dim_B[0]) != p.k) {
+    Rf_error("Несовместимые размеры матриц");
+  }
+  p.A = REAL(A_r);
+  p.lda = dim_A[0] > 0 ? dim_A[0] : 1;
+  p.B = REAL(B_r);
+  p.ldb = dim_B[0] > 0 ? dim_B[0] : 1;
+
+  std::vector<double> times;
+  bool ok = true;
+  try {
+    std::vector<double> C((size_t) p.m * p.n + 1);
+    p.C = C.data();
+    times = time_calls(limits, [&]() { return run_kernel(kernel, p); });
+  } catch (const std::bad_alloc &) {
+    ok = false;
+  }
+  if (!ok) {
+    Rf_error("Недостаточно памяти для результата");
+  }
+  return times_vector(times);
+}
+
+// Время пакетного умножения (batch_matmul) без обертки R
+extern "C" SEXP bench_batch(SEXP A_r, SEXP B_r, SEXP samples_r, SEXP limits_r) {
+  Limits limits = bench_limits(samples_r, limits_r);
+  // Первый вызов проверяет аргументы до создания объектов C++
+  batch_matmul(A_r, B_r);
+  std::vector<double> times = time_calls(limits, [&]() {
+    batch_matmul(A_r, B_r);
+    return true;
+  });
+  return times_vector(times);
+}
+
+// Монотонные часы (секунды) для замеров оберток в R: точнее proc.time()
+extern "C" SEXP bench_clock() {
+  return Rf_ScalarReal(now_seconds());
+}
+
+// c(peak_gflops, core_gflops, bandwidth_gbs) для пула потоков пакета
+extern "C" SEXP bench_roofline() {
+  double out[3];
+  const char *error = measure_roofline(out);
+  if (error != NULL) {
+    Rf_error("%s", error);
+  }
+  SEXP result = PROTECT(Rf_allocVector(REALSXP, 3));
+  std::copy(out, out + 3, REAL(result));
+  UNPROTECT(1);
+  return result;
+}
@@ -0,0 +1,129 @@
+// Вызов dgemm через бэкенд, выбранный configure. Для библиотек поставщиков
+// используется интерфейс CBLAS, для BLAS самого R - F77_CALL(dgemm).
+#include "blas_backend.h"
+
+#if defined(MATRIXPROD_BLAS_ACCELERATE) || defined(MATRIXPROD_BLAS_OPENBLAS) || \
+    defined(MATRIXPROD_BLAS_MKL) || defined(MATRIXPROD_BLAS_BLIS)
+#define MP_USE_CBLAS 1
+#endif
+
+#ifdef MP_USE_CBLAS
+// Заголовки поставщиков (и Accelerate целиком) конфликтуют с макросами R,
+// поэтому объявляем только нужную функцию; значения перечислений CBLAS
+// одинаковы во всех реализациях
+#define MP_CBLAS_COL_MAJOR 102
+#define MP_CBLAS_NO_TRANS  111
+#define MP_CBLAS_TRANS     112
+#define MP_CBLAS_UPPER     121
+
+void cblas_dgemm(const int Order, const int TransA, const int TransB,
+                 const int M, const int N, const int K,
+                 const double alpha, const double *A, const int lda,
+                 const double *B, const int ldb, const double beta,
+                 double *C, const int ldc);
+void cblas_sgemm(const int Order, const int TransA, const int TransB,
+                 const int M, const int N, const int K,
+                 const float alpha, const float *A, const int lda,
+                 const float *B, const int ldb, const float beta,
+                 float *C, const int ldc);
+void cblas_zgemm(const int Order, const int TransA, const int TransB,
+                 const int M, const int N, const int K,
+                 const void *alpha, const void *A, const int lda,
+                 const void *B, const int ldb, const void *beta,
+                 void *C, const int ldc);
+void cblas_dsyrk(const int Order, const int Uplo, const int Trans,
+                 const int N, const int K, const double alpha,
+                 const double *A, const int lda, const double beta,
+                 double *C, const int ldc);
+#else
+#define USE_FC_LEN_T
+#include <R.h>
+#include <R_ext/BLAS.h>
+#ifndef FCONE
+#define FCONE
+#endif
+#endif
+
+const char *mp_blas_backend(void) {
+#if defined(MATRIXPROD_BLAS_ACCELERATE)
+  return "accelerate";
+#elif defined(MATRIXPROD_BLAS_OPENBLAS)
+  return "openblas";
+#elif defined(MATRIXPROD_BLAS_MKL)
+  return "mkl";
+#elif defined(MATRIXPROD_BLAS_BLIS)
+  return "blis";
+#else
+  return "R";
+#endif
+}
+
+void mp_blas_dgemm(int trans_a, int trans_b, int m, int n, int k,
+                   double alpha, const double *A, int lda,
+                   const double *B, int ldb,
+                   double beta, double *C, int ldc) {
+  if (m == 0 || n == 0) return;
+  // BLAS требует ld >= max(1, k) даже для пустых операндов: при k == 0
+  // вызов иначе отклоняется через xerbla и C остается незаполненной
+  if (lda < 1) lda = 1;
+  if (ldb < 1) ldb = 1;
+#ifdef MP_USE_CBLAS
+  cblas_dgemm(MP_CBLAS_COL_MAJOR,
+              trans_a ? MP_CBLAS_TRANS : MP_CBLAS_NO_TRANS,
+              trans_b ? MP_CBLAS_TRANS : MP_CBLAS_NO_TRANS,
+              m, n, k, alpha, A, lda, B, ldb, beta, C, ldc);
+#else
+  const char ta = trans_a ? 'T' : 'N';
+  const char tb = trans_b ? 'T' : 'N';
+  F77_CALL(dgemm)(&ta, &tb, &m, &n, &k, &alpha, A, &lda, B, &ldb, &beta, C, &ldc FCONE FCONE);
+#endif
+}
+
+void mp_blas_zgemm(int m, int n, int k, const double *A, int lda,
+                   const double *B, int ldb, double *C, int ldc) {
+  if (m == 0 || n == 0) return;
+  const double one[2] = {1.0, 0.0}, zero[2] = {0.0, 0.0};
+  if (lda < 1) lda = 1;
+  if (ldb < 1) ldb = 1;
+#ifdef MP_USE_CBLAS
+  cblas_zgemm(MP_CBLAS_COL_MAJOR, MP_CBLAS_NO_TRANS, MP_CBLAS_NO_TRANS,
+              m, n, k, one, A, lda, B, ldb, zero, C, ldc);
+#else
+  // Rcomplex - пара double (re, im), как и чередующийся формат аргументов
+  const char tr = 'N';
+  F77_CALL(zgemm)(&tr, &tr, &m, &n, &k, (const Rcomplex *) one, (const Rcomplex *) A, &lda,
+                  (const Rcomplex *) B, &ldb, (const Rcomplex *) zero, (Rcomplex *) C, &ldc
+                  FCONE FCONE);
+#endif
+}
+
+void mp_blas_dsyrk(int trans, int n, int k, double alpha, const double *A, int lda,
+                   double beta, double *C, int ldc) {
+  if (n == 0) return;
+  if (lda < 1) lda = 1;
+#ifdef MP_USE_CBLAS
+  cblas_dsyrk(MP_CBLAS_COL_MAJOR, MP_CBLAS_UPPER,
+              trans ? MP_CBLAS_TRANS : MP_CBLAS_NO_TRANS,
+              n, k, alpha, A, lda, beta, C, ldc);
+#else
+  const char uplo = 'U';
+  const char tr = trans ? 'T' : 'N';
+  F77_CALL(dsyrk)(&uplo, &tr, &n, &k, &alpha, A, &lda, &beta, C, &ldc FCONE FCONE);
+#endif
+}
+
+int mp_blas_sgemm(int m, int n, int k, const float *A, int lda,
+                  const float *B, int ldb, float *C, int ldc) {
+#ifdef MP_USE_CBLAS
+  if (m == 0 || n == 0) return 1;
+  if (lda < 1) lda = 1;
+  if (ldb < 1) ldb = 1;
+  cblas_sgemm(MP_CBLAS_COL_MAJOR, MP_CBLAS_NO_TRANS, MP_CBLAS_NO_TRANS,
+              m, n, k, 1.0f, A, lda, B, ldb, 0.0f, C, ldc);
+  return 1;
+#else
+  // BLAS, поставляемый с R, содержит только процедуры двойной точности
+  (void) m; (void) n; (void) k; (void) A; (void) lda; (void) B; (void) ldb; (void) C; (void) ldc;
+  return 0;
+#endif
+}
@@ -0,0 +1,39 @@
+#ifndef MATRIXPROD_BLAS_BACKEND_H
+#define MATRIXPROD_BLAS_BACKEND_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Бэкенд BLAS, выбранный configure при сборке: "accelerate", "openblas",
+// "mkl", "blis" или "R" (BLAS, с которым собран сам R)
+const char *mp_blas_backend(void);
+
+// C = alpha * op(A) * op(B) + beta * C в формате column-major (как dgemm);
+// trans_a/trans_b - ненулевые для транспонирования
+void mp_blas_dgemm(int trans_a, int trans_b, int m, int n, int k,
+                   double alpha, const double *A, int lda,
+                   const double *B, int ldb,
+                   double beta, double *C, int ldc);
+
+// C = A * B для комплексных матриц (zgemm): элементы хранятся парами double
+// (re, im), как Rcomplex, шаги lda/ldb/ldc - в комплексных элементах
+void mp_blas_zgemm(int m, int n, int k, const double *A, int lda,
+                   const double *B, int ldb, double *C, int ldc);
+
+// Верхний треугольник C = alpha * A * A^T + beta * C (trans == 0, A: n x k)
+// или C = alpha * A^T * A + beta * C (trans != 0, A: k x n), как dsyrk;
+// нижний треугольник C не изменяется
+void mp_blas_dsyrk(int trans, int n, int k, double alpha, const double *A, int lda,
+                   double beta, double *C, int ldc);
+
+// C = A * B в одинарной точности (sgemm); 0, если библиотека BLAS не
+// содержит sgemm (BLAS самого R), тогда вызывающий использует другое ядро
+int mp_blas_sgemm(int m, int n, int k, const float *A, int lda,
+                  const float *B, int ldb, float *C, int ldc);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
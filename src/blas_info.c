@@ -0,0 +1,109 @@
+// Определение реализации BLAS по экспортируемым ею символам: R загружает
+// libRblas (или подмененную библиотеку) в процесс, поэтому dlsym по
+// глобальному пространству имен находит функции управления потоками.
+#ifdef __linux__
+#define _GNU_SOURCE  // RTLD_DEFAULT
+#endif
+#include <dlfcn.h>
+#include <stddef.h>
+
+#include "blas_info.h"
+
+typedef int (*mp_int_fn)(void);
+typedef void (*mp_set_int_fn)(int);
+typedef void (*mp_set_long_fn)(long);
+
+static void *find_symbol(const char *name) {
+  return dlsym(RTLD_DEFAULT, name);
+}
+
+// Вызывает функцию int f(void) по имени; 0, если символ не найден
+static int call_int_symbol(const char *name, int *value) {
+  mp_int_fn fn;
+  void *sym = find_symbol(name);
+  if (!sym) return 0;
+  // Приведение через память, как рекомендует POSIX для dlsym
+  *(void **) (&fn) = sym;
+  *value = fn();
+  return 1;
+}
+
+const char *mp_blas_vendor(void) {
+  if (find_symbol("flexiblas_current_backend")) return "FlexiBLAS";
+  if (find_symbol("mkl_get_max_threads") || find_symbol("MKL_Get_Max_Threads")) return "MKL";
+  if (find_symbol("openblas_get_num_threads")) return "OpenBLAS";
+  if (find_symbol("bli_thread_get_num_threads")) return "BLIS";
+#ifdef __APPLE__
+  return "Accelerate";
+#else
+  return "reference";
+#endif
+}
+
+int mp_blas_threads(void) {
+  int threads;
+  if (call_int_symbol("flexiblas_get_num_threads", &threads)) return threads;
+  if (call_int_symbol("mkl_get_max_threads", &threads)) return threads;
+  if (call_int_symbol("openblas_get_num_threads", &threads)) return threads;
+  if (call_int_symbol("bli_thread_get_num_threads", &threads)) return threads;
+  // Эталонный BLAS однопоточный; Accelerate число потоков не сообщает
+#ifdef __APPLE__
+  return -1;
+#else
+  return 1;
+#endif
+}
+
+// Функция установки числа потоков ищется один раз: mp_blas_set_threads
+// вызывается и в дочернем процессе после fork, где dlsym небезопасен
+// (блокировку загрузчика мог держать другой поток родителя)
+enum { SETTER_NONE, SETTER_INT, SETTER_LONG, SETTER_APPLE };
+static int setter_kind = -1;
+static void *setter;
+
+static void resolve_setter(void) {
+  if ((setter = find_symbol("flexiblas_set_num_threads")) ||
+      (setter = find_symbol("mkl_set_num_threads")) ||
+      (setter = find_symbol("openblas_set_num_threads"))) {
+    setter_kind = SETTER_INT;
+  } else if ((setter = find_symbol("bli_thread_set_num_threads"))) {
+    // В BLIS число потоков имеет тип dim_t (64 бита в стандартной сборке)
+    setter_kind = SETTER_LONG;
+#ifdef __APPLE__
+  } else if ((setter = find_symbol("BLASSetThreading"))) {
+    // Accelerate (macOS 15+) различает только однопоточный и
+    // многопоточный режимы
+    setter_kind = SETTER_APPLE;
+#endif
+  } else {
+    setter_kind = SETTER_NONE;
+  }
+}
+
+void mp_blas_prepare_threads(void) {
+  if (setter_kind < 0) resolve_setter();
+}
+
+int mp_blas_set_threads(int threads) {
+  mp_set_int_fn set_int;
+  mp_set_long_fn set_long;
+  if (threads < 1) threads = 1;
+  if (setter_kind < 0) resolve_setter();
+  switch (setter_kind) {
+  case SETTER_INT:
+    *(void **) (&set_int) = setter;
+    set_int(threads);
+    return 1;
+  case SETTER_LONG:
+    *(void **) (&set_long) = setter;
+    set_long((long) threads);
+    return 1;
+  case SETTER_APPLE:
+    // BLAS_THREADING_MULTI_THREADED = 0, BLAS_THREADING_SINGLE_THREADED = 1
+    *(void **) (&set_int) = setter;
+    set_int(threads == 1 ? 1 : 0);
+    return 1;
+  default:
+    return 0;
+  }
+}
@@ -0,0 +1,26 @@
+#ifndef MATRIXPROD_BLAS_INFO_H
+#define MATRIXPROD_BLAS_INFO_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Реализация BLAS, загруженная в процесс R: "Accelerate", "OpenBLAS", "MKL",
+// "BLIS", "FlexiBLAS" или "reference" (если не удалось определить)
+const char *mp_blas_vendor(void);
+
+// Число потоков BLAS (-1, если библиотека его не сообщает)
+int mp_blas_threads(void);
+
+// Устанавливает число потоков BLAS; 0, если библиотека не позволяет это
+int mp_blas_set_threads(int threads);
+
+// Находит функцию установки числа потоков, не меняя его: после fork
+// mp_blas_set_threads должна обойтись без dlsym
+void mp_blas_prepare_threads(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,188 @@
+// Цепочка произведений A1 * A2 * ... * An по плану, найденному в R
+// (оптимальная расстановка скобок). Промежуточные матрицы не возвращаются в
+// R: они живут в пуле буферов, и буфер операнда, который уже использован,
+// сразу отдается следующему произведению. Последнее произведение пишется
+// прямо в результат R.
+#define R_NO_REMAP
+#include <R.h>
+#include <Rinternals.h>
+
+#include <cstring>
+#include <new>
+#include <vector>
+
+#include "blas_backend.h"
+#include "fixed_kernels.h"
+#include "gebp_engine.h"
+#include "matmul_stats.h"
+#include "skinny_matmul.h"
+
+namespace {
+
+struct Operand {
+  int rows, cols;
+  const double *data;
+  int buffer;   // номер буфера пула для промежуточных, -1 для входных матриц
+};
+
+// Пул буферов промежуточных результатов
+class BufferPool {
+ public:
+  // Свободный буфер не меньше size элементов: наименьший подходящий, иначе
+  // наибольший свободный расширяется, иначе создается новый
+  int acquire(size_t size) {
+    int best = -1, largest = -1;
+    for (size_t i = 0; i < buffers_.size(); i++) {
+      if (busy_[i]) continue;
+      size_t capacity = buffers_[i].size();
+      if (capacity >= size && (best < 0 || capacity < buffers_[best].size())) best = (int) i;
+      if (largest < 0 || capacity > buffers_[largest].size()) largest = (int) i;
+    }
+    if (best < 0 && largest >= 0) {
+      // Старое содержимое не нужно: память освобождается до выделения новой
+      best = largest;
+      buffers_[best] = std::vector<double>();
+      buffers_[best].resize(size);
+    }
+    if (best < 0) {
+      best = (int) buffers_.size();
+      buffers_.push_back(std::vector<double>(size));
+      busy_.push_back(false);
+    }
+    busy_[best] = true;
+    return best;
+  }
+
+  void release(int buffer) {
+    if (buffer >= 0) busy_[buffer] = false;
+  }
+
+  double *data(int buffer) { return buffers_[buffer].data(); }
+
+ private:
+  std::vector<std::vector<double> > buffers_;
+  std::vector<bool> busy_;
+};
+
+// C = A * B (плотные column-major матрицы) ядром, которое fastMatMul выбрал
+// бы для этой формы: фиксированный размер, малое ядро, узкое ядро или BLAS
+// (движок GEBP, если пакет собран с BLAS самого R)
+void multiply(int m, int n, int k, const double *A, const double *B, double *C) {
+  int lda = m > 0 ? m : 1, ldb = k > 0 ? k : 1;
+  mp_fixed_fn kernel = mp_fixed_kernel(m, k, n);
+  if (kernel != NULL) {
+    kernel(A, B, C);
+  } else if (m <= MP_FIXED_MAX && n <= MP_FIXED_MAX && k <= MP_FIXED_MAX) {
+    mp_small_dgemm(m, n, k, A, lda, B, ldb, C, lda);
+  } else if (mp_skinny_dgemm(m, n, k, A, lda, B, ldb, C, lda)) {
+    return;
+  } else if (std::strcmp(mp_blas_backend(), "R") == 0) {
+    mp_gebp_dgemm_ex(0, 0, m, n, k, 1.0, A, lda, B, ldb, 0.0, C, lda);
+  } else {
+    mp_blas_dgemm(0, 0, m, n, k, 1.0, A, lda, B, ldb, 0.0, C, lda);
+  }
+}
+
+// Выполняет шаги плана; NULL при успехе или текст ошибки
+const char *run_chain(SEXP mats_r, const int *rows, const int *cols, const int *steps, int nsteps,
+                      double *result) {
+  int count = nsteps + 1;
+  try {
+    std::vector<Operand> operands(count + nsteps);
+    for (int i = 0; i < count + nsteps; i++) {
+      operands[i].rows = rows[i];
+      operands[i].cols = cols[i];
+      operands[i].data = i < count ? REAL(VECTOR_ELT(mats_r, i)) : NULL;
+      operands[i].buffer = -1;
+    }
+    BufferPool pool;
+    for (int t = 0; t < nsteps; t++) {
+      Operand &X = operands[steps[t] - 1];
+      Operand &Y = operands[steps[t + nsteps] - 1];
+      Operand &Z = operands[count + t];
+      double *out = result;
+      if (t < nsteps - 1) {
+        Z.buffer = pool.acquire((size_t) Z.rows * Z.cols);
+        out = pool.data(Z.buffer);
+      }
+      multiply(Z.rows, Z.cols, X.cols, X.data, Y.data, out);
+      Z.data = out;
+      // Каждый операнд входит в дерево произведений ровно один раз
+      pool.release(X.buffer);
+      pool.release(Y.buffer);
+    }
+  } catch (const std::bad_alloc &) {
+    return "Недостаточно памяти для промежуточных произведений";
+  }
+  return NULL;
+}
+
+}  // namespace
+
+// mats - список из n матриц double, steps - целочисленная матрица
+// (n - 1) x 2: номера левого и правого операнда каждого шага (1..n - входные
+// матрицы, n + t - результат шага t)
+extern "C" SEXP chain_matmul(SEXP mats_r, SEXP steps_r) {
+  unsigned call = mp_stats_begin(MP_STATS_CHAIN);
+  if (TYPEOF(mats_r) != VECSXP || XLENGTH(mats_r) < 2) {
+    Rf_error("Ожидается список не менее чем из двух матриц");
+  }
+  int count = (int) XLENGTH(mats_r);
+  int nsteps = count - 1;
+  if (TYPEOF(steps_r) != INTSXP || XLENGTH(steps_r) != 2 * (R_xlen_t) nsteps) {
+    Rf_error("План должен быть целочисленной матрицей (n - 1) x 2");
+  }
+  const int *steps = INTEGER(steps_r);
+
+  // Размеры всех операндов проверяются до создания объектов C++: Rf_error
+  // не вызывает их деструкторы, поэтому рабочие массивы выделяются в R
+  int total = count + nsteps;
+  SEXP work_r = PROTECT(Rf_allocVector(INTSXP, 3 * (R_xlen_t) total));
+  int *rows = INTEGER(work_r), *cols = rows + total, *used = cols + total;
+  std::memset(used, 0, sizeof(int) * total);
+  for (int i = 0; i < count; i++) {
+    SEXP A = VECTOR_ELT(mats_r, i);
+    if (TYPEOF(A) != REALSXP || !Rf_isMatrix(A)) {
+      Rf_error("Элемент %d: ожидается матрица типа double", i + 1);
+    }
+    rows[i] = INTEGER(Rf_getAttrib(A, R_DimSymbol))[0];
+    cols[i] = INTEGER(Rf_getAttrib(A, R_DimSymbol))[1];
+  }
+  for (int t = 0; t < nsteps; t++) {
+    int x = steps[t] - 1, y = steps[t + nsteps] - 1;
+    if (x < 0 || y < 0 || x >= count + t || y >= count + t || used[x] || used[y] || x == y) {
+      Rf_error("Шаг %d: неверные номера операндов", t + 1);
+    }
+    if (cols[x] != rows[y]) {
+      Rf_error("Шаг %d: несовместимые размеры матриц", t + 1);
+    }
+    used[x] = used[y] = 1;
+    rows[count + t] = rows[x];
+    cols[count + t] = cols[y];
+  }
+  // n - 1 шагов по два еще не использованных операнда: план - одно дерево,
+  // корень которого - последний шаг
+  int last = total - 1;
+  mp_stats_mark(MP_PHASE_SETUP);
+  SEXP C_r = PROTECT(Rf_allocMatrix(REALSXP, rows[last], cols[last]));
+  mp_stats_mark(MP_PHASE_ALLOC);
+
+  const char *error = run_chain(mats_r, rows, cols, steps, nsteps, REAL(C_r));
+  if (error != NULL) {
+    Rf_error("%s", error);
+  }
+  // Работа цепочки - сумма ее шагов (промежуточные буферы входят в вычисление)
+  mp_stats_mark(MP_PHASE_KERNEL);
+  if (call != 0) {
+    double flops = 0, bytes = 0;
+    for (int t = 0; t < nsteps; t++) {
+      int x = steps[t] - 1, y = steps[t + nsteps] - 1;
+      flops += 2.0 * rows[x] * cols[y] * (double) cols[x];
+      bytes += sizeof(double) * ((double) rows[x] * cols[x] + (double) rows[y] * cols[y] +
+                                 (double) rows[x] * cols[y]);
+    }
+    mp_stats_end(call, flops, bytes);
+  }
+  UNPROTECT(2);
+  return C_r;
+}
@@ -0,0 +1,386 @@
+#ifdef __linux__
+#define _GNU_SOURCE
+#include <sched.h>
+#include <dirent.h>
+#endif
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#ifdef __APPLE__
+#include <sys/types.h>
+#include <sys/sysctl.h>
+#endif
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#endif
+
+#if defined(__linux__) && defined(__aarch64__)
+#include <sys/auxv.h>
+#endif
+
+#include "cpu_info.h"
+
+// Значения по умолчанию, если система не сообщает размеры кэшей
+#define MP_DEFAULT_L1D  (32L * 1024)
+#define MP_DEFAULT_L2   (256L * 1024)
+#define MP_DEFAULT_L3   (8L * 1024 * 1024)
+#define MP_DEFAULT_LINE 64L
+
+// Результаты определения кэшируются; первый вызов может прийти из любого
+// потока (например, из задачи пула), поэтому инициализация - через
+// pthread_once
+static mp_cache_info cache_info;
+static pthread_once_t cache_info_once = PTHREAD_ONCE_INIT;
+
+#ifdef __APPLE__
+static long sysctl_long(const char *name) {
+  long long value = 0;
+  size_t size = sizeof(value);
+  if (sysctlbyname(name, &value, &size, NULL, 0) != 0) return 0;
+  return (long) value;
+}
+#endif
+
+#ifdef __linux__
+// Читает размер кэша из sysfs: /sys/devices/system/cpu/cpu0/cache/indexN
+static long sysfs_cache_size(int level, int want_data) {
+  char path[128];
+  for (int idx = 0; idx < 8; idx++) {
+    FILE *f;
+    int lvl = 0;
+    char type[32] = {0};
+    char size[32] = {0};
+
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu0/cache/index%d/level", idx);
+    if (!(f = fopen(path, "r"))) break;
+    if (fscanf(f, "%d", &lvl) != 1) lvl = 0;
+    fclose(f);
+    if (lvl != level) continue;
+
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu0/cache/index%d/type", idx);
+    if ((f = fopen(path, "r"))) {
+      if (fscanf(f, "%31s", type) != 1) type[0] = '\0';
+      fclose(f);
+    }
+    if (want_data && type[0] == 'I') continue;  // пропускаем кэш инструкций
+
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu0/cache/index%d/size", idx);
+    if (!(f = fopen(path, "r"))) continue;
+    if (fscanf(f, "%31s", size) != 1) size[0] = '\0';
+    fclose(f);
+
+    char *end = NULL;
+    long value = strtol(size, &end, 10);
+    if (end && (*end == 'K' || *end == 'k')) value *= 1024;
+    else if (end && (*end == 'M' || *end == 'm')) value *= 1024 * 1024;
+    return value;
+  }
+  return 0;
+}
+#endif
+
+static void detect_caches(mp_cache_info *info) {
+  info->l1d = info->l2 = info->l3 = info->line = 0;
+
+#if defined(__APPLE__)
+  // На Apple Silicon размеры относятся к производительным ядрам (perflevel0)
+  info->l1d = sysctl_long("hw.perflevel0.l1dcachesize");
+  info->l2 = sysctl_long("hw.perflevel0.l2cachesize");
+  if (info->l1d <= 0) info->l1d = sysctl_long("hw.l1dcachesize");
+  if (info->l2 <= 0) info->l2 = sysctl_long("hw.l2cachesize");
+  info->l3 = sysctl_long("hw.l3cachesize");
+  info->line = sysctl_long("hw.cachelinesize");
+#elif defined(__linux__)
+#ifdef _SC_LEVEL1_DCACHE_SIZE
+  info->l1d = sysconf(_SC_LEVEL1_DCACHE_SIZE);
+  info->l2 = sysconf(_SC_LEVEL2_CACHE_SIZE);
+  info->l3 = sysconf(_SC_LEVEL3_CACHE_SIZE);
+  info->line = sysconf(_SC_LEVEL1_DCACHE_LINESIZE);
+#endif
+  // glibc на aarch64 часто возвращает 0 - тогда читаем sysfs
+  if (info->l1d <= 0) info->l1d = sysfs_cache_size(1, 1);
+  if (info->l2 <= 0) info->l2 = sysfs_cache_size(2, 1);
+  if (info->l3 <= 0) info->l3 = sysfs_cache_size(3, 1);
+#endif
+
+  if (info->l1d <= 0) info->l1d = MP_DEFAULT_L1D;
+  if (info->l2 <= 0) info->l2 = MP_DEFAULT_L2;
+  // Нет L3 (например, Apple M1 с SLC) - ориентируемся на L2
+  if (info->l3 <= 0) info->l3 = info->l2 > MP_DEFAULT_L3 ? info->l2 : MP_DEFAULT_L3;
+  if (info->line <= 0) info->line = MP_DEFAULT_LINE;
+}
+
+static void init_cache_info(void) {
+  detect_caches(&cache_info);
+}
+
+const mp_cache_info *mp_get_cache_info(void) {
+  pthread_once(&cache_info_once, init_cache_info);
+  return &cache_info;
+}
+
+// ---------------------------------------------------------------------------
+// Топология: физические ядра и NUMA-узлы
+// ---------------------------------------------------------------------------
+
+#define MP_MAX_CPUS 1024
+
+static int cpu_order[MP_MAX_CPUS];
+static int cpu_order_len = 0;
+static int physical_cores = 0;
+static pthread_once_t topology_once = PTHREAD_ONCE_INIT;
+
+#ifdef __linux__
+// Первое число из файла sysfs вида "0-3,8" или "-1", если файл недоступен
+static int sysfs_first_int(const char *path) {
+  FILE *f = fopen(path, "r");
+  int value = -1;
+  if (!f) return -1;
+  if (fscanf(f, "%d", &value) != 1) value = -1;
+  fclose(f);
+  return value;
+}
+
+// Номер NUMA-узла: каталог /sys/devices/system/cpu/cpuN/nodeM
+static int cpu_numa_node(int cpu) {
+  char path[96];
+  snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d", cpu);
+  DIR *dir = opendir(path);
+  int node = 0;
+  if (!dir) return 0;
+  struct dirent *entry;
+  while ((entry = readdir(dir)) != NULL) {
+    if (strncmp(entry->d_name, "node", 4) == 0 && entry->d_name[4] >= '0' && entry->d_name[4] <= '9') {
+      node = atoi(entry->d_name + 4);
+      break;
+    }
+  }
+  closedir(dir);
+  return node;
+}
+
+static void detect_topology_linux(void) {
+  cpu_set_t allowed;
+  CPU_ZERO(&allowed);
+  if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) return;
+
+  int primary[MP_MAX_CPUS], secondary[MP_MAX_CPUS];
+  int primary_node[MP_MAX_CPUS], secondary_node[MP_MAX_CPUS];
+  int n_primary = 0, n_secondary = 0, max_node = 0;
+  char path[128];
+
+  for (int cpu = 0; cpu < CPU_SETSIZE && cpu < MP_MAX_CPUS; cpu++) {
+    if (!CPU_ISSET(cpu, &allowed)) continue;
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/topology/thread_siblings_list", cpu);
+    int first_sibling = sysfs_first_int(path);
+    int node = cpu_numa_node(cpu);
+    if (node > max_node) max_node = node;
+    // Первый из SMT-соседей, доступный процессу, представляет физическое ядро
+    if (first_sibling < 0 || first_sibling == cpu || !CPU_ISSET(first_sibling, &allowed)) {
+      primary[n_primary] = cpu;
+      primary_node[n_primary++] = node;
+    } else {
+      secondary[n_secondary] = cpu;
+      secondary_node[n_secondary++] = node;
+    }
+  }
+
+  physical_cores = n_primary;
+
+  // Чередуем узлы: ядро узла 0, ядро узла 1, ..., затем следующее ядро узла 0
+  int *lists[2] = {primary, secondary};
+  int *nodes[2] = {primary_node, secondary_node};
+  int counts[2] = {n_primary, n_secondary};
+  for (int pass = 0; pass < 2; pass++) {
+    int taken[MP_MAX_CPUS] = {0};
+    int remaining = counts[pass];
+    while (remaining > 0) {
+      for (int node = 0; node <= max_node; node++) {
+        for (int i = 0; i < counts[pass]; i++) {
+          if (!taken[i] && nodes[pass][i] == node) {
+            taken[i] = 1;
+            cpu_order[cpu_order_len++] = lists[pass][i];
+            remaining--;
+            break;
+          }
+        }
+      }
+    }
+  }
+}
+#endif
+
+static void init_topology(void) {
+#if defined(__linux__)
+  detect_topology_linux();
+#elif defined(__APPLE__)
+  physical_cores = (int) sysctl_long("hw.physicalcpu");
+#endif
+  if (physical_cores <= 0) {
+    long online = sysconf(_SC_NPROCESSORS_ONLN);
+    physical_cores = online > 0 ? (int) online : 1;
+  }
+}
+
+static void detect_topology(void) {
+  pthread_once(&topology_once, init_topology);
+}
+
+int mp_physical_cores(void) {
+  detect_topology();
+  return physical_cores;
+}
+
+int mp_cpu_order(int *cpus, int max_cpus) {
+  detect_topology();
+  int count = cpu_order_len < max_cpus ? cpu_order_len : max_cpus;
+  for (int i = 0; i < count; i++) cpus[i] = cpu_order[i];
+  return count;
+}
+
+int mp_logical_cores(void) {
+#ifdef __linux__
+  cpu_set_t allowed;
+  CPU_ZERO(&allowed);
+  if (sched_getaffinity(0, sizeof(allowed), &allowed) == 0) {
+    int count = CPU_COUNT(&allowed);
+    if (count > 0) return count;
+  }
+#endif
+  long online = sysconf(_SC_NPROCESSORS_ONLN);
+  return online > 0 ? (int) online : 1;
+}
+
+// ---------------------------------------------------------------------------
+// Классы ядер: производительные и энергоэффективные
+// ---------------------------------------------------------------------------
+
+#ifdef __linux__
+// Количество CPU в списке sysfs вида "0-7,16-23"; -1, если файл недоступен
+static int sysfs_list_count(const char *path) {
+  FILE *f = fopen(path, "r");
+  char buf[1024];
+  if (!f) return -1;
+  if (!fgets(buf, sizeof(buf), f)) buf[0] = '\0';
+  fclose(f);
+  int count = 0;
+  char *p = buf;
+  while (*p) {
+    char *end;
+    long lo = strtol(p, &end, 10);
+    if (end == p) break;
+    long hi = lo;
+    if (*end == '-') {
+      p = end + 1;
+      hi = strtol(p, &end, 10);
+    }
+    count += (int) (hi - lo + 1);
+    p = *end == ',' ? end + 1 : end;
+    if (*p == '\n') break;
+  }
+  return count;
+}
+#endif
+
+void mp_core_classes(int *performance, int *efficiency) {
+  int physical = mp_physical_cores();
+  *performance = physical;
+  *efficiency = 0;
+#if defined(__APPLE__)
+  // perflevel0 - производительные ядра, perflevel1 - энергоэффективные
+  long p = sysctl_long("hw.perflevel0.physicalcpu");
+  long e = sysctl_long("hw.perflevel1.physicalcpu");
+  if (p > 0) {
+    *performance = (int) p;
+    *efficiency = e > 0 ? (int) e : 0;
+  }
+#elif defined(__linux__)
+  // Гибридные Intel: отдельные PMU для P-ядер (cpu_core) и E-ядер (cpu_atom).
+  // Списки содержат логические CPU; у E-ядер SMT нет
+  int core = sysfs_list_count("/sys/devices/cpu_core/cpus");
+  int atom = sysfs_list_count("/sys/devices/cpu_atom/cpus");
+  if (core > 0 && atom > 0) {
+    *efficiency = atom;
+    *performance = physical > atom ? physical - atom : core;
+    return;
+  }
+  // ARM big.LITTLE: ядра с максимальной cpu_capacity считаются производительными
+  int max_capacity = 0, n_max = 0, n_total = 0;
+  char path[96];
+  for (int cpu = 0; cpu < MP_MAX_CPUS; cpu++) {
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/cpu_capacity", cpu);
+    int capacity = sysfs_first_int(path);
+    if (capacity < 0) break;
+    n_total++;
+    if (capacity > max_capacity) {
+      max_capacity = capacity;
+      n_max = 1;
+    } else if (capacity == max_capacity) {
+      n_max++;
+    }
+  }
+  if (n_total > 0 && n_max < n_total) {
+    *performance = n_max;
+    *efficiency = n_total - n_max;
+  }
+#endif
+}
+
+// ---------------------------------------------------------------------------
+// Наборы векторных инструкций
+// ---------------------------------------------------------------------------
+
+static int simd_flags = 0;
+static pthread_once_t simd_once = PTHREAD_ONCE_INIT;
+
+static int detect_simd(void) {
+  int flags = 0;
+#if defined(__x86_64__) || defined(__i386__)
+  // __builtin_cpu_supports учитывает и поддержку состояния регистров в ОС
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("sse2")) flags |= MP_SIMD_SSE2;
+  if (__builtin_cpu_supports("avx2")) flags |= MP_SIMD_AVX2;
+  if (__builtin_cpu_supports("fma")) flags |= MP_SIMD_FMA;
+  if (__builtin_cpu_supports("avx512f")) flags |= MP_SIMD_AVX512F;
+  unsigned int eax, ebx, ecx, edx;
+  // CPUID.(EAX=7,ECX=0):EDX[24] - AMX-TILE
+  if (__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx) && (edx & (1u << 24))) flags |= MP_SIMD_AMX;
+#elif defined(__aarch64__)
+  flags |= MP_SIMD_NEON;  // обязателен для AArch64
+#if defined(__APPLE__)
+  // Все Apple Silicon имеют матричный сопроцессор AMX (используется Accelerate)
+  flags |= MP_SIMD_AMX;
+  if (sysctl_long("hw.optional.arm.FEAT_SME") > 0) flags |= MP_SIMD_SME;
+#elif defined(__linux__)
+  unsigned long hwcap = getauxval(AT_HWCAP);
+  unsigned long hwcap2 = getauxval(AT_HWCAP2);
+  if (hwcap & (1UL << 22)) flags |= MP_SIMD_SVE;   // HWCAP_SVE
+  if (hwcap2 & (1UL << 23)) flags |= MP_SIMD_SME;  // HWCAP2_SME
+#endif
+#endif
+  return flags;
+}
+
+static void init_simd(void) {
+  simd_flags = detect_simd();
+}
+
+int mp_simd_flags(void) {
+  pthread_once(&simd_once, init_simd);
+  return simd_flags;
+}
+
+const char *mp_simd_isa(void) {
+  int flags = mp_simd_flags();
+  if (flags & MP_SIMD_AVX512F) return "avx512";
+  if ((flags & MP_SIMD_AVX2) && (flags & MP_SIMD_FMA)) return "avx2";
+  if (flags & MP_SIMD_SVE) return "sve";
+  if (flags & MP_SIMD_NEON) return "neon";
+  if (flags & MP_SIMD_SSE2) return "sse2";
+  return "scalar";
+}
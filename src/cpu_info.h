@@ -0,0 +1,56 @@
+#ifndef MATRIXPROD_CPU_INFO_H
+#define MATRIXPROD_CPU_INFO_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Размеры кэшей процессора в байтах (0 - уровень отсутствует или не определен)
+typedef struct {
+  long l1d;
+  long l2;
+  long l3;
+  long line;
+} mp_cache_info;
+
+// Возвращает размеры кэшей; определяются один раз при первом вызове
+const mp_cache_info *mp_get_cache_info(void);
+
+// Количество физических ядер, доступных процессу (без учета SMT)
+int mp_physical_cores(void);
+
+// Порядок логических CPU для закрепления рабочих потоков: сначала по одному
+// CPU на физическое ядро с чередованием NUMA-узлов, затем SMT-соседи.
+// Возвращает длину списка (0, если закрепление не поддерживается).
+int mp_cpu_order(int *cpus, int max_cpus);
+
+// Логические CPU, доступные процессу
+int mp_logical_cores(void);
+
+// Число производительных и энергоэффективных физических ядер (Apple Silicon,
+// гибридные Intel, ARM big.LITTLE); на однородных процессорах efficiency = 0
+void mp_core_classes(int *performance, int *efficiency);
+
+// Наборы векторных инструкций, поддерживаемые процессором и ОС
+enum {
+  MP_SIMD_SSE2    = 1 << 0,
+  MP_SIMD_AVX2    = 1 << 1,
+  MP_SIMD_FMA     = 1 << 2,
+  MP_SIMD_AVX512F = 1 << 3,
+  MP_SIMD_AMX     = 1 << 4,   // Intel AMX-TILE или матричный сопроцессор Apple
+  MP_SIMD_NEON    = 1 << 5,
+  MP_SIMD_SVE     = 1 << 6,
+  MP_SIMD_SME     = 1 << 7
+};
+
+int mp_simd_flags(void);
+
+// Наилучший набор инструкций, используемый ядрами пакета ("avx512", "avx2",
+// "neon", ..., "scalar")
+const char *mp_simd_isa(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,453 @@
+// Диспетчер fastMatMul: проверка операндов, выбор бэкенда и умножение за
+// один вызов .Call. Бэкенды собраны в реестр с именами, как в профиле
+// tune_matmul и в benchmark_suite; доступность Metal определяется один раз,
+// а таблица профиля (лучший бэкенд для набора форм) хранится здесь же и
+// задается из R функцией dispatch_set_profile. Целые матрицы умножаются
+// точным целочисленным ядром, комплексные - zgemm или движком GEBP.
+#define R_NO_REMAP
+#include <R.h>
+#include <Rinternals.h>
+
+#include <cmath>
+#include <cstring>
+#include <new>
+#include <vector>
+
+#include "blas_backend.h"
+#include "fixed_kernels.h"
+#include "gebp_engine.h"
+#include "integer_matmul.h"
+#include "matmul_stats.h"
+#include "skinny_matmul.h"
+
+extern "C" {
+void rust_mm_optimized(const double *a_ptr, const double *b_ptr, double *c_ptr,
+                       int m, int k, int n);
+void rust_mm_blocked(const double *a_ptr, const double *b_ptr, double *c_ptr,
+                     int m, int k, int n);
+void rust_mm_auto(const double *a_ptr, const double *b_ptr, double *c_ptr,
+                  int m, int k, int n);
+int mp_metal_available(void);
+int mp_metal_dgemm(int trans_a, int trans_b, int M, int N, int K, double alpha,
+                   const double *A, int lda, const double *B, int ldb,
+                   double beta, double *C, int ldc);
+SEXP strassen_matmul(SEXP A_r, SEXP B_r, SEXP cutoff_r, SEXP base_r);
+}
+
+namespace {
+
+enum {
+  kBaseR, kRustTiny, kRustBlocked, kRustAuto, kBlas, kBlockHuge, kMetal, kSkinny, kFixed,
+  kStrassen, kBackendCount
+};
+const int kAuto = -1;
+
+struct Backend {
+  const char *name;
+  int stats;          // счетчик matmul_stats; -1 - вызов учитывает сам бэкенд
+  bool needs_metal;
+};
+
+const Backend kBackends[kBackendCount] = {
+  {"base_r", -1, false},
+  {"rust_tiny", MP_STATS_RUST_TINY, false},
+  {"rust_blocked", MP_STATS_RUST_BLOCKED, false},
+  {"rust_auto", MP_STATS_RUST_AUTO, false},
+  {"cpp_accelerate", MP_STATS_BLAS, false},
+  {"block_huge", MP_STATS_BLOCK, false},
+  {"metal_gpu", MP_STATS_METAL, true},
+  {"skinny", MP_STATS_SKINNY, false},
+  {"fixed", MP_STATS_FIXED, false},
+  {"strassen", -1, false},
+};
+
+// Устаревшие имена method
+const struct {
+  const char *name;
+  int backend;
+} kMethodAliases[] = {
+  {"tiny", kRustTiny}, {"cpu", kBlas}, {"gpu", kMetal}, {"huge", kBlockHuge},
+};
+
+// Правила выбора без профиля: до kTinyMaxDim - rust_tiny (если ядра Rust
+// собраны), до kGpuMinDim - BLAS, дальше Metal (если есть) или BLAS. Вместо
+// эталонного BLAS самого R считает движок GEBP
+const int kTinyMaxDim = 500;
+const int kGpuMinDim = 1000;
+// Комплексное произведение на BLAS самого R (эталонный zgemm без блоков)
+// выгоднее считать движком GEBP начиная с этого числа операций
+const double kComplexGebpMinOps = 1 << 21;
+// Узкое произведение выгодно, когда большой операнд не помещается в L2
+// (на меньших выигрыш не окупает вызов)
+const double kSkinnyMinWork = 32768.0;
+
+// Доступность Metal: -1 - еще не проверялась. Инициализация устройства
+// дорогая, поэтому проверка выполняется при первом запросе
+int metal_state = -1;
+
+bool has_metal() {
+  if (metal_state < 0) metal_state = mp_metal_available() ? 1 : 0;
+  return metal_state == 1;
+}
+
+// Профиль tune_matmul: log2 размеров измеренных форм и лучший бэкенд
+struct TunedShape {
+  double log_m, log_k, log_n;
+  int backend;
+};
+
+std::vector<TunedShape> tuned_shapes;
+
+int backend_index(const char *name) {
+  for (int i = 0; i < kBackendCount; i++) {
+    if (std::strcmp(name, kBackends[i].name) == 0) return i;
+  }
+  return kAuto;
+}
+
+int method_index(SEXP method_r) {
+  if (!Rf_isString(method_r) || Rf_length(method_r) != 1 ||
+      STRING_ELT(method_r, 0) == NA_STRING) {
+    Rf_error("Метод должен быть строкой");
+  }
+  const char *method = CHAR(STRING_ELT(method_r, 0));
+  if (std::strcmp(method, "auto") == 0) return kAuto;
+  for (const auto &alias : kMethodAliases) {
+    if (std::strcmp(method, alias.name) == 0) return alias.backend;
+  }
+  int backend = backend_index(method);
+  if (backend == kAuto) Rf_error("Неизвестный метод: %s", method);
+  return backend;
+}
+
+// Размеры числовой матрицы; false, если X_r не матрица double, integer,
+// logical или complex
+bool matrix_dims(SEXP X_r, int *rows, int *cols) {
+  int type = TYPEOF(X_r);
+  if ((type != REALSXP && type != INTSXP && type != LGLSXP && type != CPLXSXP) ||
+      !Rf_isMatrix(X_r)) {
+    return false;
+  }
+  const int *dim = INTEGER(Rf_getAttrib(X_r, R_DimSymbol));
+  *rows = dim[0];
+  *cols = dim[1];
+  return true;
+}
+
+// Бэкенд ближайшей (в log2) измеренной формы; kAuto без профиля или если
+// выбранный бэкенд сейчас недоступен
+int tuned_backend(int m, int k, int n) {
+  if (tuned_shapes.empty()) return kAuto;
+  double lm = std::log2((double) (m > 1 ? m : 1)), lk = std::log2((double) (k > 1 ? k : 1));
+  double ln = std::log2((double) (n > 1 ? n : 1));
+  const TunedShape *best = nullptr;
+  double best_dist = 0.0;
+  for (const TunedShape &shape : tuned_shapes) {
+    double dm = shape.log_m - lm, dk = shape.log_k - lk, dn = shape.log_n - ln;
+    double dist = dm * dm + dk * dk + dn * dn;
+    if (best == nullptr || dist < best_dist) {
+      best = &shape;
+      best_dist = dist;
+    }
+  }
+  if (kBackends[best->backend].needs_metal && !has_metal()) return kAuto;
+  return best->backend;
+}
+
+int select_backend(int m, int n, int k, bool verbose) {
+  int big = m > n ? m : n;
+  if (k > big) big = k;
+  if (big <= MP_FIXED_MAX) {
+    if (verbose) Rprintf("Using fixed-size kernel\n");
+    return kFixed;
+  }
+  int tuned = tuned_backend(m, k, n);
+  if (tuned != kAuto) {
+    if (verbose) Rprintf("Using tuned method: %s\n", kBackends[tuned].name);
+    return tuned;
+  }
+  int narrow = m < n ? m : n, wide = m > n ? m : n;
+  if (narrow <= MP_SKINNY_MAX && (double) wide * k >= kSkinnyMinWork) {
+    if (verbose) Rprintf("Using skinny kernel\n");
+    return kSkinny;
+  }
+  // Без cargo rust_tiny - простой цикл на C: малые матрицы тогда тоже на CPU
+  int cpu = std::strcmp(mp_blas_backend(), "R") == 0 ? kBlockHuge : kBlas;
+  int backend;
+#ifdef MATRIXPROD_HAVE_RUST
+  if (big < kTinyMaxDim) {
+    backend = kRustTiny;
+  } else
+#endif
+  if (big < kGpuMinDim || !has_metal()) {
+    backend = cpu;
+  } else {
+    backend = kMetal;
+  }
+  if (verbose) Rprintf("Using method: %s\n", kBackends[backend].name);
+  return backend;
+}
+
+// C = A * B (плотные матрицы column-major) выбранным бэкендом; false, если
+// Metal не смог выделить буферы
+bool run_backend(int backend, int m, int n, int k, const double *A, const double *B, double *C) {
+  int lda = m > 0 ? m : 1, ldb = k > 0 ? k : 1;
+  switch (backend) {
+  case kRustTiny:
+    rust_mm_optimized(A, B, C, m, k, n);
+    return true;
+  case kRustBlocked:
+    rust_mm_blocked(A, B, C, m, k, n);
+    return true;
+  case kRustAuto:
+    rust_mm_auto(A, B, C, m, k, n);
+    return true;
+  case kBlockHuge:
+    mp_gebp_dgemm(m, n, k, 1.0, A, lda, B, ldb, 0.0, C, lda);
+    return true;
+  case kMetal:
+    return mp_metal_dgemm(0, 0, m, n, k, 1.0, A, lda, B, ldb, 0.0, C, lda) != 0;
+  case kSkinny:
+    if (mp_skinny_dgemm(m, n, k, A, lda, B, ldb, C, lda)) return true;
+    break;
+  case kFixed: {
+    mp_fixed_fn kernel = mp_fixed_kernel(m, k, n);
+    if (kernel != NULL) {
+      kernel(A, B, C);
+      return true;
+    }
+    if (m <= MP_FIXED_MAX && n <= MP_FIXED_MAX && k <= MP_FIXED_MAX) {
+      mp_small_dgemm(m, n, k, A, lda, B, ldb, C, lda);
+      return true;
+    }
+    break;
+  }
+  default:
+    break;
+  }
+  mp_blas_dgemm(0, 0, m, n, k, 1.0, A, lda, B, ldb, 0.0, C, lda);
+  return true;
+}
+
+// A %*% B базового R
+SEXP base_product(SEXP A_r, SEXP B_r) {
+  SEXP expr = PROTECT(Rf_lang3(Rf_install("%*%"), A_r, B_r));
+  SEXP C_r = Rf_eval(expr, R_BaseEnv);
+  UNPROTECT(1);
+  return C_r;
+}
+
+// Штрассен с порогом из опции MatrixProd.strassen_cutoff (как у
+// strassen_matmul в R)
+SEXP strassen_product(SEXP A_r, SEXP B_r) {
+  SEXP cutoff_opt = Rf_GetOption1(Rf_install("MatrixProd.strassen_cutoff"));
+  int cutoff = Rf_isNull(cutoff_opt) ? 1024 : Rf_asInteger(cutoff_opt);
+  SEXP cutoff_r = PROTECT(Rf_ScalarInteger(cutoff));
+  SEXP base_r = PROTECT(Rf_mkString("auto"));
+  SEXP C_r = strassen_matmul(A_r, B_r, cutoff_r, base_r);
+  UNPROTECT(2);
+  return C_r;
+}
+
+// Имена строк A и столбцов B (и имена самих dimnames) переносятся в C,
+// как это делает %*%; возвращает C
+SEXP with_dimnames(SEXP C_r, SEXP A_r, SEXP B_r) {
+  SEXP a = Rf_getAttrib(A_r, R_DimNamesSymbol);
+  SEXP b = Rf_getAttrib(B_r, R_DimNamesSymbol);
+  SEXP rows = Rf_isNull(a) ? R_NilValue : VECTOR_ELT(a, 0);
+  SEXP cols = Rf_isNull(b) ? R_NilValue : VECTOR_ELT(b, 1);
+  if (Rf_isNull(rows) && Rf_isNull(cols)) return C_r;
+  PROTECT(C_r);
+  SEXP dimnames = PROTECT(Rf_allocVector(VECSXP, 2));
+  SET_VECTOR_ELT(dimnames, 0, rows);
+  SET_VECTOR_ELT(dimnames, 1, cols);
+  SEXP a_names = Rf_isNull(a) ? R_NilValue : Rf_getAttrib(a, R_NamesSymbol);
+  SEXP b_names = Rf_isNull(b) ? R_NilValue : Rf_getAttrib(b, R_NamesSymbol);
+  if (!Rf_isNull(a_names) || !Rf_isNull(b_names)) {
+    SEXP names = PROTECT(Rf_allocVector(STRSXP, 2));
+    SET_STRING_ELT(names, 0, Rf_isNull(a_names) ? R_BlankString : STRING_ELT(a_names, 0));
+    SET_STRING_ELT(names, 1, Rf_isNull(b_names) ? R_BlankString : STRING_ELT(b_names, 1));
+    Rf_setAttrib(dimnames, R_NamesSymbol, names);
+    UNPROTECT(1);
+  }
+  Rf_setAttrib(C_r, R_DimNamesSymbol, dimnames);
+  UNPROTECT(2);
+  return C_r;
+}
+
+// Целые (integer, logical) A и B: точное целочисленное ядро; R_NilValue,
+// если суммы могут переполнить int64 (тогда умножение в double)
+SEXP integer_product(SEXP A_r, SEXP B_r, int m, int n, int k, bool verbose, unsigned call) {
+  mp_stats_backend(MP_STATS_INTEGER);
+  mp_stats_mark(MP_PHASE_SETUP);
+  SEXP C_r = PROTECT(Rf_allocMatrix(REALSXP, m, n));
+  mp_stats_mark(MP_PHASE_ALLOC);
+  int ok = mp_int_matmul(m, n, k, INTEGER(A_r), m > 0 ? m : 1, INTEGER(B_r), k > 0 ? k : 1,
+                         REAL(C_r), m > 0 ? m : 1);
+  mp_stats_mark(MP_PHASE_KERNEL);
+  UNPROTECT(1);
+  if (!ok) {
+    if (verbose) Rprintf("Integer sums may exceed int64, multiplying in double\n");
+    return R_NilValue;
+  }
+  if (verbose) Rprintf("Using exact integer kernel\n");
+  mp_stats_end(call, 2.0 * m * n * k, 4.0 * ((double) m * k + (double) k * n) + 8.0 * m * n);
+  return C_r;
+}
+
+// Комплексные A или B (второй операнд приводится к complex): zgemm BLAS
+// ("cpp_accelerate") или движок GEBP ("block_huge"); "auto" выбирает GEBP
+// только вместо эталонного zgemm самого R
+SEXP complex_product(SEXP A_r, SEXP B_r, int method, int m, int n, int k, bool verbose,
+                     unsigned call) {
+  int backend = method;
+  if (backend == kAuto) {
+    bool reference_blas = std::strcmp(mp_blas_backend(), "R") == 0;
+    backend = reference_blas && 2.0 * m * n * k >= kComplexGebpMinOps ? kBlockHuge : kBlas;
+  }
+  if (backend != kBaseR && backend != kBlas && backend != kBlockHuge) {
+    Rf_error("Метод %s не поддерживает комплексные матрицы", kBackends[backend].name);
+  }
+  if (verbose) Rprintf("Using complex method: %s\n", kBackends[backend].name);
+
+  int nprotect = 0;
+  if (TYPEOF(A_r) != CPLXSXP) {
+    A_r = PROTECT(Rf_coerceVector(A_r, CPLXSXP));
+    nprotect++;
+  }
+  if (TYPEOF(B_r) != CPLXSXP) {
+    B_r = PROTECT(Rf_coerceVector(B_r, CPLXSXP));
+    nprotect++;
+  }
+  if (backend == kBaseR) {
+    SEXP C_r = base_product(A_r, B_r);
+    UNPROTECT(nprotect);
+    return C_r;
+  }
+  mp_stats_backend(MP_STATS_COMPLEX);
+  mp_stats_mark(MP_PHASE_SETUP);
+  SEXP C_r = PROTECT(Rf_allocMatrix(CPLXSXP, m, n));
+  nprotect++;
+  mp_stats_mark(MP_PHASE_ALLOC);
+  const double *A = (const double *) COMPLEX(A_r);
+  const double *B = (const double *) COMPLEX(B_r);
+  double *C = (double *) COMPLEX(C_r);
+  int lda = m > 0 ? m : 1, ldb = k > 0 ? k : 1;
+  if (backend == kBlas || !mp_gebp_zgemm(m, n, k, A, lda, B, ldb, C, lda)) {
+    mp_blas_zgemm(m, n, k, A, lda, B, ldb, C, lda);
+  }
+  mp_stats_mark(MP_PHASE_KERNEL);
+  mp_stats_end(call, 8.0 * m * n * k, 16.0 * ((double) m * k + (double) k * n + (double) m * n));
+  UNPROTECT(nprotect);
+  return C_r;
+}
+
+}  // namespace
+
+// C = A %*% B бэкендом method ("auto" - выбор по форме и профилю, для
+// целых и комплексных матриц - по типу)
+extern "C" SEXP fast_matmul(SEXP A_r, SEXP B_r, SEXP method_r, SEXP verbose_r) {
+  unsigned call = mp_stats_begin(MP_STATS_BLAS);
+  int method = method_index(method_r);
+  bool verbose = Rf_asLogical(verbose_r) == TRUE;
+  int m, k, kb, n;
+  if (!matrix_dims(A_r, &m, &k) || !matrix_dims(B_r, &kb, &n)) {
+    Rf_error("A и B должны быть числовыми или комплексными матрицами");
+  }
+  if (k != kb) {
+    Rf_error("Несовместимые размеры матриц: ncol(A) = %d, nrow(B) = %d", k, kb);
+  }
+  if (verbose) Rprintf("Matrix multiplication: [%d x %d] * [%d x %d]\n", m, k, kb, n);
+
+  if (TYPEOF(A_r) == CPLXSXP || TYPEOF(B_r) == CPLXSXP) {
+    return with_dimnames(complex_product(A_r, B_r, method, m, n, k, verbose, call), A_r, B_r);
+  }
+  // Явно выбранные бэкенды вещественные: целые операнды приводятся к double
+  if (method == kAuto && TYPEOF(A_r) != REALSXP && TYPEOF(B_r) != REALSXP) {
+    SEXP C_r = integer_product(A_r, B_r, m, n, k, verbose, call);
+    if (C_r != R_NilValue) return with_dimnames(C_r, A_r, B_r);
+  }
+
+  int backend = method;
+  if (backend == kAuto) {
+    backend = select_backend(m, n, k, verbose);
+  } else if (verbose) {
+    Rprintf("Using method: %s\n", kBackends[backend].name);
+  }
+  if (kBackends[backend].needs_metal && !has_metal()) {
+    Rf_error("Metal недоступен на этой платформе");
+  }
+
+  int nprotect = 0;
+  if (TYPEOF(A_r) != REALSXP) {
+    A_r = PROTECT(Rf_coerceVector(A_r, REALSXP));
+    nprotect++;
+  }
+  if (TYPEOF(B_r) != REALSXP) {
+    B_r = PROTECT(Rf_coerceVector(B_r, REALSXP));
+    nprotect++;
+  }
+  if (backend == kBaseR || backend == kStrassen) {
+    SEXP C_r = backend == kBaseR ? base_product(A_r, B_r)
+                                 : with_dimnames(strassen_product(A_r, B_r), A_r, B_r);
+    UNPROTECT(nprotect);
+    return C_r;
+  }
+  mp_stats_backend(kBackends[backend].stats);
+  mp_stats_mark(MP_PHASE_SETUP);
+
+  SEXP C_r = PROTECT(Rf_allocMatrix(REALSXP, m, n));
+  nprotect++;
+  mp_stats_mark(MP_PHASE_ALLOC);
+  if (m > 0 && n > 0 && !run_backend(backend, m, n, k, REAL(A_r), REAL(B_r), REAL(C_r))) {
+    UNPROTECT(nprotect);
+    Rf_error("Не удалось выделить буферы Metal");
+  }
+  mp_stats_mark(MP_PHASE_KERNEL);
+  mp_stats_end_product(call, m, n, k, backend == kMetal ? sizeof(float) : sizeof(double));
+  C_r = with_dimnames(C_r, A_r, B_r);
+  UNPROTECT(nprotect);
+  return C_r;
+}
+
+// Таблица профиля для выбора "auto": формы m x k x n и имена лучших
+// бэкендов (best из tune_matmul); NULL очищает таблицу
+extern "C" SEXP dispatch_set_profile(SEXP m_r, SEXP k_r, SEXP n_r, SEXP backend_r) {
+  if (Rf_isNull(m_r)) {
+    tuned_shapes.clear();
+    return R_NilValue;
+  }
+  if (TYPEOF(m_r) != INTSXP || TYPEOF(k_r) != INTSXP || TYPEOF(n_r) != INTSXP ||
+      !Rf_isString(backend_r)) {
+    Rf_error("Профиль: размеры должны быть целыми, бэкенды - строками");
+  }
+  R_xlen_t count = XLENGTH(m_r);
+  if (XLENGTH(k_r) != count || XLENGTH(n_r) != count || XLENGTH(backend_r) != count) {
+    Rf_error("Профиль: векторы разной длины");
+  }
+  for (R_xlen_t i = 0; i < count; i++) {
+    if (INTEGER(m_r)[i] < 1 || INTEGER(k_r)[i] < 1 || INTEGER(n_r)[i] < 1) {
+      Rf_error("Профиль: размеры должны быть положительными");
+    }
+    SEXP name = STRING_ELT(backend_r, i);
+    if (name == NA_STRING || backend_index(CHAR(name)) == kAuto) {
+      Rf_error("Профиль: неизвестный бэкенд %s", name == NA_STRING ? "NA" : CHAR(name));
+    }
+  }
+
+  bool ok = true;
+  try {
+    std::vector<TunedShape> shapes;
+    shapes.reserve(count);
+    for (R_xlen_t i = 0; i < count; i++) {
+      shapes.push_back({std::log2((double) INTEGER(m_r)[i]), std::log2((double) INTEGER(k_r)[i]),
+                        std::log2((double) INTEGER(n_r)[i]),
+                        backend_index(CHAR(STRING_ELT(backend_r, i)))});
+    }
+    tuned_shapes.swap(shapes);
+  } catch (const std::bad_alloc &) {
+    ok = false;
+  }
+  if (!ok) Rf_error("Недостаточно памяти для профиля");
+  return R_NilValue;
+}
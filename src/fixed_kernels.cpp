@@ -0,0 +1,153 @@
+// Ядра для малых матриц фиксированного размера (2 x 2 ... 32 x 32). На
+// таких размерах время уходит не на умножение, а на циклы с границами во
+// время выполнения, проверки хвостов и выбор ядра. Здесь размеры - параметры
+// шаблона: после подстановки циклы по строкам и столбцам разворачиваются
+// полностью, накопители остаются в векторных регистрах, а смещения в A, B и C
+// становятся константами. Ядро выбирается по таблице переходов.
+#define R_NO_REMAP
+#include <R.h>
+#include <Rinternals.h>
+
+#include <utility>
+
+#if defined(__AVX2__) && defined(__FMA__)
+#include <immintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#include "blas_backend.h"
+#include "fixed_kernels.h"
+#include "gebp_engine.h"
+#include "matmul_stats.h"
+
+namespace {
+
+// Векторный тип и число накопителей, которые помещаются в регистры
+// вместе с загруженным столбцом A
+#if defined(__AVX2__) && defined(__FMA__)
+typedef __m256d Vec;
+const int kLanes = 4;
+const int kAccRegs = 12;
+inline Vec vload(const double *p) { return _mm256_loadu_pd(p); }
+inline void vstore(double *p, Vec v) { _mm256_storeu_pd(p, v); }
+inline Vec vzero() { return _mm256_setzero_pd(); }
+inline Vec vfma(Vec a, double b, Vec c) { return _mm256_fmadd_pd(a, _mm256_set1_pd(b), c); }
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+typedef float64x2_t Vec;
+const int kLanes = 2;
+const int kAccRegs = 24;
+inline Vec vload(const double *p) { return vld1q_f64(p); }
+inline void vstore(double *p, Vec v) { vst1q_f64(p, v); }
+inline Vec vzero() { return vdupq_n_f64(0.0); }
+inline Vec vfma(Vec a, double b, Vec c) { return vfmaq_n_f64(c, a, b); }
+#else
+typedef double Vec;
+const int kLanes = 1;
+const int kAccRegs = 8;
+inline Vec vload(const double *p) { return *p; }
+inline void vstore(double *p, Vec v) { *p = v; }
+inline Vec vzero() { return 0.0; }
+inline Vec vfma(Vec a, double b, Vec c) { return c + a * b; }
+#endif
+
+// C[:, 0:J] = A * B[:, 0:J] для M x K матрицы A. Полные векторы строк
+// накапливаются в регистрах, последние M % kLanes строк - скалярно
+template <int M, int K, int J>
+inline void column_block(const double *A, const double *B, double *C) {
+  constexpr int V = M / kLanes;
+  constexpr int R = M % kLanes;
+  Vec acc[J][V > 0 ? V : 1];
+  double tail[J][R > 0 ? R : 1];
+  for (int j = 0; j < J; j++) {
+    for (int v = 0; v < V; v++) acc[j][v] = vzero();
+    for (int r = 0; r < R; r++) tail[j][r] = 0.0;
+  }
+  for (int l = 0; l < K; l++) {
+    const double *a = A + l * M;
+    for (int v = 0; v < V; v++) {
+      Vec av = vload(a + v * kLanes);
+      for (int j = 0; j < J; j++) acc[j][v] = vfma(av, B[l + j * K], acc[j][v]);
+    }
+    for (int r = 0; r < R; r++) {
+      double av = a[V * kLanes + r];
+      for (int j = 0; j < J; j++) tail[j][r] += av * B[l + j * K];
+    }
+  }
+  for (int j = 0; j < J; j++) {
+    for (int v = 0; v < V; v++) vstore(C + j * M + v * kLanes, acc[j][v]);
+    for (int r = 0; r < R; r++) C[j * M + V * kLanes + r] = tail[j][r];
+  }
+}
+
+// Столбцов C за проход по A: столько, сколько накопителей помещается в регистры
+constexpr int columns_per_block(int M, int N) {
+  return (M + kLanes - 1) / kLanes * N <= kAccRegs ? N
+       : kAccRegs / ((M + kLanes - 1) / kLanes) > 0 ? kAccRegs / ((M + kLanes - 1) / kLanes)
+       : 1;
+}
+
+template <int M, int K, int N>
+void fixed_kernel(const double *A, const double *B, double *C) {
+  constexpr int J = columns_per_block(M, N);
+  for (int j = 0; j + J <= N; j += J) column_block<M, K, J>(A, B + j * K, C + j * M);
+  if (N % J != 0) {
+    constexpr int J0 = N / J * J;
+    column_block<M, K, (N % J != 0 ? N % J : 1)>(A, B + J0 * K, C + J0 * M);
+  }
+}
+
+// Таблицы переходов по размеру: элемент i - ядро для размера i + 2
+template <int... I>
+struct KernelTable {
+  static constexpr mp_fixed_fn square[] = {&fixed_kernel<I + 2, I + 2, I + 2>...};
+  static constexpr mp_fixed_fn gemv[] = {&fixed_kernel<I + 2, I + 2, 1>...};
+};
+
+template <int... I>
+KernelTable<I...> make_table(std::integer_sequence<int, I...>);
+
+typedef decltype(make_table(std::make_integer_sequence<int, MP_FIXED_MAX - 1>())) Kernels;
+
+}  // namespace
+
+extern "C" mp_fixed_fn mp_fixed_kernel(int m, int k, int n) {
+  if (m < 2 || m > MP_FIXED_MAX || k != m) return NULL;
+  if (n == m) return Kernels::square[m - 2];
+  if (n == 1) return Kernels::gemv[m - 2];
+  return NULL;
+}
+
+// C = A * B ядром фиксированного размера; прочие малые формы считаются
+// общим малым ядром, большие - BLAS. Проверки минимальны: функция
+// рассчитана на миллионы вызовов с матрицами 4 x 4 ... 16 x 16
+extern "C" SEXP fixed_matmul(SEXP A_r, SEXP B_r) {
+  unsigned call = mp_stats_begin(MP_STATS_FIXED);
+  if (TYPEOF(A_r) != REALSXP || TYPEOF(B_r) != REALSXP || !Rf_isMatrix(A_r) || !Rf_isMatrix(B_r)) {
+    Rf_error("A и B должны быть матрицами типа double");
+  }
+  const int *dim_A = INTEGER(Rf_getAttrib(A_r, R_DimSymbol));
+  const int *dim_B = INTEGER(Rf_getAttrib(B_r, R_DimSymbol));
+  int m = dim_A[0], k = dim_A[1], n = dim_B[1];
+  if (dim_B[0] != k) {
+    Rf_error("Несовместимые размеры матриц");
+  }
+  mp_stats_mark(MP_PHASE_SETUP);
+
+  SEXP C_r = PROTECT(Rf_allocMatrix(REALSXP, m, n));
+  mp_stats_mark(MP_PHASE_ALLOC);
+  mp_fixed_fn kernel = mp_fixed_kernel(m, k, n);
+  if (kernel != NULL) {
+    kernel(REAL(A_r), REAL(B_r), REAL(C_r));
+  } else if (m <= MP_FIXED_MAX && n <= MP_FIXED_MAX && k <= MP_FIXED_MAX) {
+    mp_small_dgemm(m, n, k, REAL(A_r), m > 0 ? m : 1, REAL(B_r), k > 0 ? k : 1,
+                   REAL(C_r), m > 0 ? m : 1);
+  } else {
+    mp_blas_dgemm(0, 0, m, n, k, 1.0, REAL(A_r), m > 0 ? m : 1, REAL(B_r), k > 0 ? k : 1,
+                  0.0, REAL(C_r), m > 0 ? m : 1);
+  }
+  mp_stats_mark(MP_PHASE_KERNEL);
+  mp_stats_end_product(call, m, n, k, sizeof(double));
+  UNPROTECT(1);
+  return C_r;
+}
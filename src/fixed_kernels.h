@@ -0,0 +1,24 @@
+#ifndef MATRIXPROD_FIXED_KERNELS_H
+#define MATRIXPROD_FIXED_KERNELS_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Наибольший размер со специализированным ядром
+#define MP_FIXED_MAX 32
+
+// Ядро фиксированного размера: C = A * B для плотных матриц column-major
+// (lda = m, ldb = k, ldc = m), размеры заданы при компиляции
+typedef void (*mp_fixed_fn)(const double *A, const double *B, double *C);
+
+// Ядро для (m x k) * (k x n) или NULL, если размер не специализирован.
+// Специализированы квадратные произведения n x n (2 <= n <= MP_FIXED_MAX)
+// и произведения квадратной матрицы на вектор (k = m, n = 1)
+mp_fixed_fn mp_fixed_kernel(int m, int k, int n);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
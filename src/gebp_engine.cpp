@@ -0,0 +1,557 @@
+// Блочное умножение матриц по схеме GEBP (Goto/BLIS):
+// панели A и B упаковываются в непрерывные выровненные буферы,
+// а внутренний цикл выполняет регистровое микроядро MR x NR с SIMD.
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+
+#if defined(__AVX512F__) || (defined(__AVX2__) && defined(__FMA__))
+#include <immintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#include "cpu_info.h"
+#include "gebp_engine.h"
+#include "tile_pool.h"
+
+namespace {
+
+// ---------------------------------------------------------------------------
+// Микроядра. Каждое вычисляет C[0:MR, 0:NR] = alpha * Ap * Bp + beta * C,
+// где Ap - панель MR x kc (по MR значений на шаг p), Bp - панель kc x NR.
+// ---------------------------------------------------------------------------
+
+#if defined(__AVX512F__)
+
+struct Kernel {
+  static constexpr int MR = 16;
+  static constexpr int NR = 12;
+
+  static inline void run(int kc, const double *a, const double *b,
+                         double alpha, double beta, double *c, int ldc) {
+    __m512d acc[NR][2];
+    for (int j = 0; j < NR; j++) {
+      acc[j][0] = _mm512_setzero_pd();
+      acc[j][1] = _mm512_setzero_pd();
+    }
+    for (int p = 0; p < kc; p++) {
+      __m512d a0 = _mm512_load_pd(a);
+      __m512d a1 = _mm512_load_pd(a + 8);
+      for (int j = 0; j < NR; j++) {
+        __m512d bj = _mm512_set1_pd(b[j]);
+        acc[j][0] = _mm512_fmadd_pd(a0, bj, acc[j][0]);
+        acc[j][1] = _mm512_fmadd_pd(a1, bj, acc[j][1]);
+      }
+      a += MR;
+      b += NR;
+    }
+    __m512d va = _mm512_set1_pd(alpha);
+    if (beta == 0.0) {
+      for (int j = 0; j < NR; j++) {
+        _mm512_storeu_pd(c + j * ldc, _mm512_mul_pd(va, acc[j][0]));
+        _mm512_storeu_pd(c + j * ldc + 8, _mm512_mul_pd(va, acc[j][1]));
+      }
+    } else {
+      __m512d vb = _mm512_set1_pd(beta);
+      for (int j = 0; j < NR; j++) {
+        double *col = c + j * ldc;
+        _mm512_storeu_pd(col, _mm512_fmadd_pd(va, acc[j][0], _mm512_mul_pd(vb, _mm512_loadu_pd(col))));
+        _mm512_storeu_pd(col + 8, _mm512_fmadd_pd(va, acc[j][1], _mm512_mul_pd(vb, _mm512_loadu_pd(col + 8))));
+      }
+    }
+  }
+};
+
+#elif defined(__AVX2__) && defined(__FMA__)
+
+struct Kernel {
+  static constexpr int MR = 8;
+  static constexpr int NR = 6;
+
+  static inline void run(int kc, const double *a, const double *b,
+                         double alpha, double beta, double *c, int ldc) {
+    __m256d acc[NR][2];
+    for (int j = 0; j < NR; j++) {
+      acc[j][0] = _mm256_setzero_pd();
+      acc[j][1] = _mm256_setzero_pd();
+    }
+    for (int p = 0; p < kc; p++) {
+      __m256d a0 = _mm256_load_pd(a);
+      __m256d a1 = _mm256_load_pd(a + 4);
+      _mm_prefetch((const char *) (a + 8 * MR), _MM_HINT_T0);
+      for (int j = 0; j < NR; j++) {
+        __m256d bj = _mm256_broadcast_sd(b + j);
+        acc[j][0] = _mm256_fmadd_pd(a0, bj, acc[j][0]);
+        acc[j][1] = _mm256_fmadd_pd(a1, bj, acc[j][1]);
+      }
+      a += MR;
+      b += NR;
+    }
+    __m256d va = _mm256_set1_pd(alpha);
+    if (beta == 0.0) {
+      for (int j = 0; j < NR; j++) {
+        _mm256_storeu_pd(c + j * ldc, _mm256_mul_pd(va, acc[j][0]));
+        _mm256_storeu_pd(c + j * ldc + 4, _mm256_mul_pd(va, acc[j][1]));
+      }
+    } else {
+      __m256d vb = _mm256_set1_pd(beta);
+      for (int j = 0; j < NR; j++) {
+        double *col = c + j * ldc;
+        _mm256_storeu_pd(col, _mm256_fmadd_pd(va, acc[j][0], _mm256_mul_pd(vb, _mm256_loadu_pd(col))));
+        _mm256_storeu_pd(col + 4, _mm256_fmadd_pd(va, acc[j][1], _mm256_mul_pd(vb, _mm256_loadu_pd(col + 4))));
+      }
+    }
+  }
+};
+
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+
+struct Kernel {
+  static constexpr int MR = 8;
+  static constexpr int NR = 6;
+
+  static inline void run(int kc, const double *a, const double *b,
+                         double alpha, double beta, double *c, int ldc) {
+    // 24 аккумулятора + 4 регистра A + 3 регистра B = 31 из 32 регистров NEON
+    float64x2_t acc[NR][4];
+    for (int j = 0; j < NR; j++) {
+      for (int i = 0; i < 4; i++) acc[j][i] = vdupq_n_f64(0.0);
+    }
+    for (int p = 0; p < kc; p++) {
+      float64x2_t av[4];
+      for (int i = 0; i < 4; i++) av[i] = vld1q_f64(a + 2 * i);
+      float64x2_t b01 = vld1q_f64(b);
+      float64x2_t b23 = vld1q_f64(b + 2);
+      float64x2_t b45 = vld1q_f64(b + 4);
+      for (int i = 0; i < 4; i++) {
+        acc[0][i] = vfmaq_laneq_f64(acc[0][i], av[i], b01, 0);
+        acc[1][i] = vfmaq_laneq_f64(acc[1][i], av[i], b01, 1);
+        acc[2][i] = vfmaq_laneq_f64(acc[2][i], av[i], b23, 0);
+        acc[3][i] = vfmaq_laneq_f64(acc[3][i], av[i], b23, 1);
+        acc[4][i] = vfmaq_laneq_f64(acc[4][i], av[i], b45, 0);
+        acc[5][i] = vfmaq_laneq_f64(acc[5][i], av[i], b45, 1);
+      }
+      a += MR;
+      b += NR;
+    }
+    for (int j = 0; j < NR; j++) {
+      double *col = c + j * ldc;
+      for (int i = 0; i < 4; i++) {
+        float64x2_t r = vmulq_n_f64(acc[j][i], alpha);
+        if (beta != 0.0) r = vfmaq_n_f64(r, vld1q_f64(col + 2 * i), beta);
+        vst1q_f64(col + 2 * i, r);
+      }
+    }
+  }
+};
+
+#else
+
+// Переносимое скалярное ядро; компилятор векторизует его при возможности
+struct Kernel {
+  static constexpr int MR = 4;
+  static constexpr int NR = 4;
+
+  static inline void run(int kc, const double *a, const double *b,
+                         double alpha, double beta, double *c, int ldc) {
+    double acc[NR][MR] = {{0.0}};
+    for (int p = 0; p < kc; p++) {
+      for (int j = 0; j < NR; j++) {
+        for (int i = 0; i < MR; i++) acc[j][i] += a[i] * b[j];
+      }
+      a += MR;
+      b += NR;
+    }
+    for (int j = 0; j < NR; j++) {
+      double *col = c + j * ldc;
+      for (int i = 0; i < MR; i++) {
+        col[i] = (beta == 0.0) ? alpha * acc[j][i] : alpha * acc[j][i] + beta * col[i];
+      }
+    }
+  }
+};
+
+#endif
+
+constexpr int MR = Kernel::MR;
+constexpr int NR = Kernel::NR;
+
+// ---------------------------------------------------------------------------
+// Размеры блоков по иерархии кэшей
+// ---------------------------------------------------------------------------
+
+int round_down(int value, int multiple) {
+  return std::max(multiple, value / multiple * multiple);
+}
+
+mp_gebp_blocking compute_blocking() {
+  const mp_cache_info *cache = mp_get_cache_info();
+  mp_gebp_blocking bl;
+  bl.mr = MR;
+  bl.nr = NR;
+
+  // Микропанели A (MR x kc) и B (kc x NR) должны занимать ~3/4 L1
+  long kc = cache->l1d * 3 / 4 / ((MR + NR) * (long) sizeof(double));
+  bl.kc = std::min(512, std::max(64, round_down((int) kc, 16)));
+
+  // Блок A (mc x kc) занимает половину L2
+  long mc = cache->l2 / 2 / (bl.kc * (long) sizeof(double));
+  bl.mc = std::min(round_down(1024, MR), std::max(MR, round_down((int) mc, MR)));
+
+  // Блок B (kc x nc) занимает половину L3
+  long nc = cache->l3 / 2 / (bl.kc * (long) sizeof(double));
+  bl.nc = std::min(round_down(8192, NR), std::max(NR, round_down((int) std::min(nc, 1L << 20), NR)));
+
+  return bl;
+}
+
+// ---------------------------------------------------------------------------
+// Упаковка панелей
+// ---------------------------------------------------------------------------
+
+// Начало блока op(X)[r:, c:] для X с шагом ld; при транспонировании
+// op(X)[r, c] = X[c + r * ld]
+const double *op_block(const double *X, int ld, bool trans, int r, int c) {
+  return trans ? X + c + (long) r * ld : X + r + (long) c * ld;
+}
+
+// op(A)[0:mc, 0:kc] -> панели по MR строк; недостающие строки заполняются нулями
+void pack_A(int mc, int kc, const double *A, int lda, bool trans, double *Ap) {
+  for (int ir = 0; ir < mc; ir += MR) {
+    int mr = std::min(MR, mc - ir);
+    if (trans) {
+      // Строка op(A) - столбец A: читаем подряд, пишем с шагом MR
+      for (int i = 0; i < MR; i++) {
+        if (i < mr) {
+          const double *row = A + (long) (ir + i) * lda;
+          for (int p = 0; p < kc; p++) Ap[p * MR + i] = row[p];
+        } else {
+          for (int p = 0; p < kc; p++) Ap[p * MR + i] = 0.0;
+        }
+      }
+      Ap += (long) kc * MR;
+      continue;
+    }
+    const double *src = A + ir;
+    if (mr == MR) {
+      for (int p = 0; p < kc; p++) {
+        const double *col = src + (long) p * lda;
+        for (int i = 0; i < MR; i++) Ap[i] = col[i];
+        Ap += MR;
+      }
+    } else {
+      for (int p = 0; p < kc; p++) {
+        const double *col = src + (long) p * lda;
+        int i = 0;
+        for (; i < mr; i++) Ap[i] = col[i];
+        for (; i < MR; i++) Ap[i] = 0.0;
+        Ap += MR;
+      }
+    }
+  }
+}
+
+// op(B)[0:kc, 0:nc] -> панели по NR столбцов; недостающие столбцы заполняются нулями
+void pack_B(int kc, int nc, const double *B, int ldb, bool trans, double *Bp) {
+  for (int jr = 0; jr < nc; jr += NR) {
+    int nr = std::min(NR, nc - jr);
+    if (trans) {
+      // Строка панели op(B) - NR соседних элементов столбца B
+      for (int p = 0; p < kc; p++) {
+        const double *col = B + jr + (long) p * ldb;
+        for (int j = 0; j < NR; j++) Bp[j] = (j < nr) ? col[j] : 0.0;
+        Bp += NR;
+      }
+      continue;
+    }
+    const double *cols[NR];
+    for (int j = 0; j < NR; j++) cols[j] = B + (long) (jr + std::min(j, nr - 1)) * ldb;
+    for (int p = 0; p < kc; p++) {
+      for (int j = 0; j < NR; j++) Bp[j] = (j < nr) ? cols[j][p] : 0.0;
+      Bp += NR;
+    }
+  }
+}
+
+// Блок C[0:mc, 0:nc] += Ap * Bp с учетом alpha/beta; краевые плитки
+// считаются во временный буфер и затем переносятся в C
+void macro_kernel(int mc, int nc, int kc, double alpha,
+                  const double *Ap, const double *Bp,
+                  double beta, double *C, int ldc) {
+  alignas(64) double edge[MR * NR];
+
+  for (int jr = 0; jr < nc; jr += NR) {
+    int nr = std::min(NR, nc - jr);
+    const double *bp = Bp + (long) jr * kc;
+    for (int ir = 0; ir < mc; ir += MR) {
+      int mr = std::min(MR, mc - ir);
+      const double *ap = Ap + (long) ir * kc;
+      double *c = C + ir + (long) jr * ldc;
+
+      if (mr == MR && nr == NR) {
+        Kernel::run(kc, ap, bp, alpha, beta, c, ldc);
+      } else {
+        Kernel::run(kc, ap, bp, alpha, 0.0, edge, MR);
+        for (int j = 0; j < nr; j++) {
+          double *col = c + (long) j * ldc;
+          const double *e = edge + j * MR;
+          if (beta == 0.0) {
+            for (int i = 0; i < mr; i++) col[i] = e[i];
+          } else {
+            for (int i = 0; i < mr; i++) col[i] = e[i] + beta * col[i];
+          }
+        }
+      }
+    }
+  }
+}
+
+double *aligned_buffer(size_t count) {
+  void *ptr = NULL;
+  if (posix_memalign(&ptr, 64, count * sizeof(double)) != 0) return NULL;
+  return (double *) ptr;
+}
+
+// Буферы упаковки живут в каждом потоке и переиспользуются между вызовами
+struct PackBuffers {
+  double *Ap = NULL;
+  double *Bp = NULL;
+  size_t a_size = 0;
+  size_t b_size = 0;
+
+  ~PackBuffers() {
+    free(Ap);
+    free(Bp);
+  }
+
+  bool reserve(size_t a_count, size_t b_count) {
+    if (a_count > a_size) {
+      free(Ap);
+      Ap = aligned_buffer(a_count);
+      a_size = Ap ? a_count : 0;
+    }
+    if (b_count > b_size) {
+      free(Bp);
+      Bp = aligned_buffer(b_count);
+      b_size = Bp ? b_count : 0;
+    }
+    return Ap && Bp;
+  }
+};
+
+thread_local PackBuffers pack_buffers;
+
+void scale_C(int m, int n, double beta, double *C, int ldc) {
+  for (int j = 0; j < n; j++) {
+    double *col = C + (long) j * ldc;
+    if (beta == 0.0) {
+      memset(col, 0, m * sizeof(double));
+    } else if (beta != 1.0) {
+      for (int i = 0; i < m; i++) col[i] *= beta;
+    }
+  }
+}
+
+// Последовательный GEBP для одного блока C (вызывается в любом потоке пула)
+void gebp_serial(bool trans_a, bool trans_b, int m, int n, int k,
+                 double alpha, const double *A, int lda,
+                 const double *B, int ldb,
+                 double beta, double *C, int ldc) {
+  const mp_gebp_blocking *bl = mp_gebp_get_blocking();
+  const int MC = std::min(bl->mc, (m + MR - 1) / MR * MR);
+  const int KC = std::min(bl->kc, k);
+  const int NC = std::min(bl->nc, (n + NR - 1) / NR * NR);
+
+  PackBuffers &buf = pack_buffers;
+  if (!buf.reserve((size_t) MC * KC, (size_t) KC * NC)) {
+    // Без буферов упаковки считаем напрямую (медленно, но корректно)
+    for (int j = 0; j < n; j++) {
+      for (int i = 0; i < m; i++) {
+        double sum = 0.0;
+        for (int l = 0; l < k; l++) {
+          sum += *op_block(A, lda, trans_a, i, l) * *op_block(B, ldb, trans_b, l, j);
+        }
+        C[i + (long) j * ldc] = alpha * sum + (beta == 0.0 ? 0.0 : beta * C[i + (long) j * ldc]);
+      }
+    }
+    return;
+  }
+
+  for (int jc = 0; jc < n; jc += NC) {
+    int nc = std::min(NC, n - jc);
+    for (int pc = 0; pc < k; pc += KC) {
+      int kc = std::min(KC, k - pc);
+      // Первая панель по k применяет beta, последующие накапливают результат
+      double beta_eff = (pc == 0) ? beta : 1.0;
+      pack_B(kc, nc, op_block(B, ldb, trans_b, pc, jc), ldb, trans_b, buf.Bp);
+      for (int ic = 0; ic < m; ic += MC) {
+        int mc = std::min(MC, m - ic);
+        pack_A(mc, kc, op_block(A, lda, trans_a, ic, pc), lda, trans_a, buf.Ap);
+        macro_kernel(mc, nc, kc, alpha, buf.Ap, buf.Bp, beta_eff,
+                     C + ic + (long) jc * ldc, ldc);
+      }
+    }
+  }
+}
+
+// Меньшие произведения выгоднее считать в одном потоке
+const double kParallelMinFlops = 2.0 * 128 * 128 * 128;
+
+// Плитки на поток: запас для балансировки нагрузки перехватом работы
+const int kTilesPerThread = 4;
+
+struct TileJob {
+  bool trans_a, trans_b;
+  int m, n, k;
+  double alpha, beta;
+  const double *A;
+  const double *B;
+  double *C;
+  int lda, ldb, ldc;
+  int tile_m, tile_n, tiles_m;
+};
+
+void tile_task(int task, int worker, void *ctx) {
+  (void) worker;
+  const TileJob *job = (const TileJob *) ctx;
+  int i0 = (task % job->tiles_m) * job->tile_m;
+  int j0 = (task / job->tiles_m) * job->tile_n;
+  int mm = std::min(job->tile_m, job->m - i0);
+  int nn = std::min(job->tile_n, job->n - j0);
+  gebp_serial(job->trans_a, job->trans_b, mm, nn, job->k, job->alpha,
+              op_block(job->A, job->lda, job->trans_a, i0, 0), job->lda,
+              op_block(job->B, job->ldb, job->trans_b, 0, j0), job->ldb,
+              job->beta, job->C + i0 + (long) j0 * job->ldc, job->ldc);
+}
+
+int ceil_div(int a, int b) {
+  return (a + b - 1) / b;
+}
+
+}  // namespace
+
+extern "C" const mp_gebp_blocking *mp_gebp_get_blocking(void) {
+  static const mp_gebp_blocking blocking = compute_blocking();
+  return &blocking;
+}
+
+extern "C" void mp_gebp_dgemm(int m, int n, int k,
+                              double alpha, const double *A, int lda,
+                              const double *B, int ldb,
+                              double beta, double *C, int ldc) {
+  mp_gebp_dgemm_ex(0, 0, m, n, k, alpha, A, lda, B, ldb, beta, C, ldc);
+}
+
+extern "C" void mp_gebp_dgemm_ex(int trans_a, int trans_b, int m, int n, int k,
+                                 double alpha, const double *A, int lda,
+                                 const double *B, int ldb,
+                                 double beta, double *C, int ldc) {
+  bool ta = trans_a != 0, tb = trans_b != 0;
+  if (m <= 0 || n <= 0) return;
+  if (k <= 0 || alpha == 0.0) {
+    scale_C(m, n, beta, C, ldc);
+    return;
+  }
+
+  int threads = mp_pool_in_worker() ? 1 : mp_pool_get_threads();
+  if (threads == 1 || 2.0 * m * n * k < kParallelMinFlops) {
+    gebp_serial(ta, tb, m, n, k, alpha, A, lda, B, ldb, beta, C, ldc);
+    return;
+  }
+
+  // Плитки C делим в первую очередь по столбцам: в column-major формате
+  // соседние по столбцам плитки пересекаются не более чем по одной строке
+  // кэша на границе. Строки делим, только если столбцов не хватает, и по
+  // границам, кратным MR (не менее 8 double = строка кэша 64 байта).
+  const mp_gebp_blocking *bl = mp_gebp_get_blocking();
+  int want = threads * kTilesPerThread;
+
+  int tiles_n = std::min(want, ceil_div(n, NR));
+  int tile_n = std::min(bl->nc, ceil_div(ceil_div(n, tiles_n), NR) * NR);
+  tiles_n = ceil_div(n, tile_n);
+
+  int tiles_m = 1;
+  int tile_m = m;
+  if (tiles_n < want) {
+    tiles_m = std::min(ceil_div(want, tiles_n), ceil_div(m, MR));
+    tile_m = ceil_div(ceil_div(m, tiles_m), MR) * MR;
+    tiles_m = ceil_div(m, tile_m);
+  }
+
+  TileJob job = {ta, tb, m, n, k, alpha, beta, A, B, C, lda, ldb, ldc,
+                 tile_m, tile_n, tiles_m};
+  mp_pool_run(tiles_m * tiles_n, tile_task, &job);
+}
+
+// Комплексное C = A * B одним вещественным умножением: чередующиеся (re, im)
+// B и C - это вещественные матрицы 2k x n и 2m x n с шагом 2 * ld, а A
+// разворачивается в вещественную блочную матрицу 2m x 2k из блоков
+// [re -im; im re]. Тогда C = A2 * B, 8mnk операций, как у zgemm
+extern "C" int mp_gebp_zgemm(int m, int n, int k,
+                             const double *A, int lda,
+                             const double *B, int ldb,
+                             double *C, int ldc) {
+  if (m <= 0 || n <= 0) return 1;
+  if (k <= 0) {
+    for (int j = 0; j < n; j++) memset(C + 2L * j * ldc, 0, sizeof(double) * 2 * m);
+    return 1;
+  }
+  long ld2 = 2L * m;
+  double *A2 = aligned_buffer((size_t) ld2 * 2 * k);
+  if (A2 == NULL) return 0;
+  for (int p = 0; p < k; p++) {
+    const double *a = A + 2L * p * lda;
+    double *re_col = A2 + 2 * p * ld2;
+    double *im_col = re_col + ld2;
+    for (int i = 0; i < m; i++) {
+      double re = a[2 * i], im = a[2 * i + 1];
+      re_col[2 * i] = re;
+      re_col[2 * i + 1] = im;
+      im_col[2 * i] = -im;
+      im_col[2 * i + 1] = re;
+    }
+  }
+  mp_gebp_dgemm(2 * m, n, 2 * k, 1.0, A2, (int) ld2, B, 2 * ldb, 0.0, C, 2 * ldc);
+  free(A2);
+  return 1;
+}
+
+// Малое умножение: столбцы C строятся группами по 4 как линейные комбинации
+// столбцов A, так что каждый загруженный столбец A используется 4 раза
+extern "C" void mp_small_dgemm(int m, int n, int k,
+                               const double *A, int lda,
+                               const double *B, int ldb,
+                               double *C, int ldc) {
+  int j = 0;
+  for (; j + 4 <= n; j += 4) {
+    double *c0 = C + (long) j * ldc;
+    double *c1 = c0 + ldc;
+    double *c2 = c1 + ldc;
+    double *c3 = c2 + ldc;
+    for (int i = 0; i < m; i++) c0[i] = c1[i] = c2[i] = c3[i] = 0.0;
+    for (int l = 0; l < k; l++) {
+      const double *a = A + (long) l * lda;
+      double b0 = B[l + (long) j * ldb];
+      double b1 = B[l + (long) (j + 1) * ldb];
+      double b2 = B[l + (long) (j + 2) * ldb];
+      double b3 = B[l + (long) (j + 3) * ldb];
+      for (int i = 0; i < m; i++) {
+        double av = a[i];
+        c0[i] += av * b0;
+        c1[i] += av * b1;
+        c2[i] += av * b2;
+        c3[i] += av * b3;
+      }
+    }
+  }
+  for (; j < n; j++) {
+    double *c = C + (long) j * ldc;
+    for (int i = 0; i < m; i++) c[i] = 0.0;
+    for (int l = 0; l < k; l++) {
+      const double *a = A + (long) l * lda;
+      double bv = B[l + (long) j * ldb];
+      for (int i = 0; i < m; i++) c[i] += a[i] * bv;
+    }
+  }
+}
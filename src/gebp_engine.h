@@ -0,0 +1,53 @@
+#ifndef MATRIXPROD_GEBP_ENGINE_H
+#define MATRIXPROD_GEBP_ENGINE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Параметры блочного разбиения (в элементах), вычисляемые по размерам кэшей
+typedef struct {
+  int mr;   // высота микроядра (строки A)
+  int nr;   // ширина микроядра (столбцы B)
+  int mc;   // блок A, помещающийся в L2
+  int kc;   // глубина панели, помещающейся в L1
+  int nc;   // блок B, помещающийся в L3
+} mp_gebp_blocking;
+
+const mp_gebp_blocking *mp_gebp_get_blocking(void);
+
+// C = alpha * A * B + beta * C для матриц в формате column-major
+// (A: m x k с шагом lda, B: k x n с шагом ldb, C: m x n с шагом ldc).
+// При beta == 0 содержимое C не читается.
+void mp_gebp_dgemm(int m, int n, int k,
+                   double alpha, const double *A, int lda,
+                   const double *B, int ldb,
+                   double beta, double *C, int ldc);
+
+// То же с транспонированием: C = alpha * op(A) * op(B) + beta * C, где
+// op(X) = X^T при ненулевом trans_x (тогда A хранится как k x m, B - как
+// n x k). Транспонирование выполняется при упаковке панелей без копий.
+void mp_gebp_dgemm_ex(int trans_a, int trans_b, int m, int n, int k,
+                      double alpha, const double *A, int lda,
+                      const double *B, int ldb,
+                      double beta, double *C, int ldc);
+
+// C = A * B для комплексных матриц (пары double re, im; шаги - в
+// комплексных элементах) через вещественный движок. Рабочая память - 2m x 2k
+// double; возвращает 0, если ее не удалось выделить
+int mp_gebp_zgemm(int m, int n, int k,
+                  const double *A, int lda,
+                  const double *B, int ldb,
+                  double *C, int ldc);
+
+// C = A * B для малых матриц без упаковки и выделения памяти (однопоточно)
+void mp_small_dgemm(int m, int n, int k,
+                    const double *A, int lda,
+                    const double *B, int ldb,
+                    double *C, int ldc);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
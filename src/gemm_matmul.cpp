@@ -0,0 +1,138 @@
+// Полный GEMM для R: C = alpha * op(A) * op(B) + beta * C, где op(X) = X
+// или X^T. Транспонирование передается ядрам флагами (без копий t(A)), а C
+// может обновляться на месте, так что crossprod(A, B) и накопление
+// C <- C + A %*% B в цикле не создают временных матриц.
+#define R_NO_REMAP
+#include <R.h>
+#include <Rinternals.h>
+
+#include <cstring>
+
+#include "blas_backend.h"
+#include "gebp_engine.h"
+#include "matmul_stats.h"
+
+extern "C" {
+void rust_mm_gemm(int trans_a, int trans_b, int m, int n, int k,
+                  double alpha, const double *a_ptr, int lda,
+                  const double *b_ptr, int ldb,
+                  double beta, double *c_ptr, int ldc);
+int mp_metal_dgemm(int trans_a, int trans_b, int M, int N, int K, double alpha,
+                   const double *A, int lda, const double *B, int ldb,
+                   double beta, double *C, int ldc);
+}
+
+namespace {
+
+// Ядра с поддержкой транспонирования и alpha/beta; "auto" - BLAS
+const char *const kGemmMethods[] = {"auto", "cpp_accelerate", "block_huge", "rust_blocked",
+                                    "metal_gpu"};
+enum { kAuto, kBlas, kBlockHuge, kRust, kMetal, kGemmMethodCount };
+
+int gemm_method(SEXP method_r) {
+  if (!Rf_isString(method_r) || Rf_length(method_r) != 1) {
+    Rf_error("Метод должен быть строкой");
+  }
+  const char *method = CHAR(STRING_ELT(method_r, 0));
+  for (int i = 0; i < kGemmMethodCount; i++) {
+    if (std::strcmp(method, kGemmMethods[i]) == 0) return i;
+  }
+  Rf_error("Неизвестный метод: %s", method);
+  return -1;
+}
+
+void matrix_dims(SEXP X_r, const char *name, int *rows, int *cols) {
+  if (!Rf_isReal(X_r) || !Rf_isMatrix(X_r)) {
+    Rf_error("%s должна быть матрицей типа double", name);
+  }
+  SEXP dim = Rf_getAttrib(X_r, R_DimSymbol);
+  *rows = INTEGER(dim)[0];
+  *cols = INTEGER(dim)[1];
+}
+
+}  // namespace
+
+// scalars_r = c(alpha, beta), trans_r = c(transA, transB). Без C (NULL)
+// результат выделяется заново и beta не используется; при in_place = TRUE
+// результат записывается прямо в C, иначе в его копию.
+extern "C" SEXP gemm_matmul(SEXP A_r, SEXP B_r, SEXP C_r, SEXP scalars_r, SEXP trans_r,
+                            SEXP method_r, SEXP in_place_r) {
+  unsigned call = mp_stats_begin(MP_STATS_GEMM);
+  int a_rows, a_cols, b_rows, b_cols;
+  matrix_dims(A_r, "A", &a_rows, &a_cols);
+  matrix_dims(B_r, "B", &b_rows, &b_cols);
+  if (!Rf_isReal(scalars_r) || Rf_length(scalars_r) != 2 ||
+      !Rf_isLogical(trans_r) || Rf_length(trans_r) != 2) {
+    Rf_error("Некорректные параметры alpha/beta или transA/transB");
+  }
+  double alpha = REAL(scalars_r)[0];
+  double beta = REAL(scalars_r)[1];
+  int trans_a = LOGICAL(trans_r)[0] == TRUE;
+  int trans_b = LOGICAL(trans_r)[1] == TRUE;
+  int method = gemm_method(method_r);
+  bool in_place = Rf_asLogical(in_place_r) == TRUE;
+
+  int m = trans_a ? a_cols : a_rows;
+  int k = trans_a ? a_rows : a_cols;
+  int n = trans_b ? b_rows : b_cols;
+  if ((trans_b ? b_cols : b_rows) != k) {
+    Rf_error("Несовместимые размеры матриц");
+  }
+  mp_stats_mark(MP_PHASE_SETUP);
+
+  SEXP result;
+  if (Rf_isNull(C_r)) {
+    beta = 0.0;
+    result = PROTECT(Rf_allocMatrix(REALSXP, m, n));
+  } else {
+    int c_rows, c_cols;
+    matrix_dims(C_r, "C", &c_rows, &c_cols);
+    if (c_rows != m || c_cols != n) {
+      Rf_error("Размеры C должны быть %d x %d", m, n);
+    }
+    if (in_place) {
+      result = PROTECT(C_r);
+    } else if (beta == 0.0) {
+      // Содержимое C не используется: копировать его незачем
+      result = PROTECT(Rf_allocMatrix(REALSXP, m, n));
+    } else {
+      result = PROTECT(Rf_duplicate(C_r));
+    }
+  }
+  mp_stats_mark(MP_PHASE_ALLOC);
+  if (m == 0 || n == 0) {
+    UNPROTECT(1);
+    return result;
+  }
+
+  const double *A = REAL(A_r);
+  const double *B = REAL(B_r);
+  double *C = REAL(result);
+  int lda = a_rows > 0 ? a_rows : 1;
+  int ldb = b_rows > 0 ? b_rows : 1;
+
+  switch (method) {
+  case kAuto:
+  case kBlas:
+    mp_blas_dgemm(trans_a, trans_b, m, n, k, alpha, A, lda, B, ldb, beta, C, m);
+    break;
+  case kBlockHuge:
+    mp_gebp_dgemm_ex(trans_a, trans_b, m, n, k, alpha, A, lda, B, ldb, beta, C, m);
+    break;
+  case kRust:
+    rust_mm_gemm(trans_a, trans_b, m, n, k, alpha, A, lda, B, ldb, beta, C, m);
+    break;
+  case kMetal:
+    // При ошибке C еще не изменена: буферы выделяются до вычислений
+    if (!mp_metal_dgemm(trans_a, trans_b, m, n, k, alpha, A, lda, B, ldb, beta, C, m)) {
+      UNPROTECT(1);
+      Rf_error("Metal недоступен или не удалось выделить буферы");
+    }
+    break;
+  }
+  mp_stats_mark(MP_PHASE_KERNEL);
+  mp_stats_end_product(call, m, n, k, sizeof(double));
+
+  UNPROTECT(1);
+  return result;
+}
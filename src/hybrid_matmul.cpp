@@ -0,0 +1,302 @@
+// Гибридное умножение очень больших матриц: CPU и GPU считают одну матрицу C.
+// Столбцы C делятся на панели C[:, j0:j0+w) = A * B[:, j0:j0+w); GPU забирает
+// панели с начала, BLAS на CPU - с конца, так что каждое устройство получает
+// долю работы, пропорциональную его фактической скорости. Обе стороны пишут
+// прямо в результирующую матрицу R: панели не пересекаются.
+#define R_NO_REMAP
+#include <R.h>
+#include <Rinternals.h>
+
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "blas_backend.h"
+#include "hybrid_matmul.h"
+#include "matmul_stats.h"
+
+namespace {
+
+enum { kGpu = 0, kCpu = 1 };
+
+// Ниже этого объема работы загрузка A на GPU и служебный поток не окупаются
+const double kHybridMinFlops = 4e9;
+// Желаемое число панелей: достаточно для балансировки в конце, но панель
+// остается достаточно широкой, чтобы и GPU, и BLAS работали с полной загрузкой
+const int kHybridPanels = 48;
+const int kMinPanelWidth = 256;
+// Ширина панели кратна плитке C блочных ядер Metal
+const int kPanelAlign = 64;
+
+// Скорость устройств (флоп/с), измеренная в прошлых вызовах: с ней уже
+// первые панели распределяются с учетом соотношения скоростей
+std::mutex rate_mutex;
+double known_rate[2] = {0.0, 0.0};
+
+// Распределение последнего вызова для hybrid_split_info
+struct SplitInfo {
+  int panel_width;
+  int columns[2];
+  double rate[2];
+};
+SplitInfo last_split = {0, {0, 0}, {0.0, 0.0}};
+
+double now_seconds() {
+  return std::chrono::duration<double>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+class PanelScheduler {
+ public:
+  PanelScheduler(int panels, const double rate[2]) : front_(0), back_(panels) {
+    for (int d = 0; d < 2; d++) {
+      rate_[d] = rate[d];
+      busy_until_[d] = 0.0;
+      active_[d] = true;
+    }
+  }
+
+  // Следующая панель для устройства или -1, если работы для него нет.
+  // Последнюю панель устройство оставляет другому, если по измеренным
+  // скоростям (с учетом уже взятой работы) другое закончит ее раньше.
+  int claim(int dev, double flops) {
+    std::lock_guard<std::mutex> guard(mutex_);
+    double now = now_seconds();
+    if (front_ >= back_ || (back_ - front_ == 1 && should_yield(dev, flops, now))) {
+      active_[dev] = false;
+      return -1;
+    }
+    if (rate_[dev] > 0) busy_until_[dev] = std::max(now, busy_until_[dev]) + flops / rate_[dev];
+    return dev == kGpu ? front_++ : --back_;
+  }
+
+  void record(int dev, double flops, double seconds) {
+    if (seconds <= 0) return;
+    std::lock_guard<std::mutex> guard(mutex_);
+    double measured = flops / seconds;
+    rate_[dev] = rate_[dev] > 0 ? 0.5 * (rate_[dev] + measured) : measured;
+  }
+
+  // Устройство больше не берет панели (ошибка GPU)
+  void retire(int dev) {
+    std::lock_guard<std::mutex> guard(mutex_);
+    active_[dev] = false;
+  }
+
+  double rate(int dev) {
+    std::lock_guard<std::mutex> guard(mutex_);
+    return rate_[dev];
+  }
+
+ private:
+  bool should_yield(int dev, double flops, double now) const {
+    int other = 1 - dev;
+    if (!active_[other] || rate_[dev] <= 0 || rate_[other] <= 0) return false;
+    double mine = std::max(now, busy_until_[dev]) + flops / rate_[dev];
+    double theirs = std::max(now, busy_until_[other]) + flops / rate_[other];
+    return theirs < mine;
+  }
+
+  std::mutex mutex_;
+  int front_, back_;
+  double rate_[2];
+  double busy_until_[2];
+  bool active_[2];
+};
+
+struct HybridJob {
+  int m, n, k, width;
+  const double *A;
+  const double *B;
+  double *C;
+  PanelScheduler *scheduler;
+  mp_gpu_panels *gpu;
+  // Панели, которые GPU не смог посчитать; их досчитывает CPU
+  std::vector<int> failed;
+  int columns[2];
+};
+
+int panel_width(const HybridJob &job, int panel) {
+  return std::min(job.width, job.n - panel * job.width);
+}
+
+double panel_flops(const HybridJob &job, int panel) {
+  return 2.0 * job.m * job.k * panel_width(job, panel);
+}
+
+void cpu_panel(HybridJob &job, int panel) {
+  long j0 = (long) panel * job.width;
+  mp_blas_dgemm(0, 0, job.m, panel_width(job, panel), job.k, 1.0, job.A, job.m,
+                job.B + j0 * job.k, job.k, 0.0, job.C + j0 * job.m, job.m);
+}
+
+// Служебный поток GPU: две панели в работе, чтобы преобразование B
+// следующей панели и выгрузка C предыдущей шли, пока GPU считает текущую
+void gpu_loop(HybridJob *job) {
+  mp_gpu_panels *gpu = job->gpu;
+  int pending[2] = {-1, -1};
+  double submitted[2] = {0.0, 0.0};
+  double last_done = 0.0;
+  bool ok = true;
+  for (int slot = 0;; slot = 1 - slot) {
+    int panel = -1;
+    if (ok) {
+      panel = job->scheduler->claim(kGpu, 2.0 * job->m * job->k * job->width);
+    }
+    if (panel >= 0) {
+      long j0 = (long) panel * job->width;
+      if (gpu->submit(gpu->ctx, slot, job->B + j0 * job->k, job->k, panel_width(*job, panel))) {
+        pending[slot] = panel;
+        submitted[slot] = now_seconds();
+      } else {
+        job->failed.push_back(panel);
+        ok = false;
+        job->scheduler->retire(kGpu);
+      }
+    }
+
+    int other = 1 - slot;
+    if (pending[other] >= 0) {
+      int done = pending[other];
+      pending[other] = -1;
+      long j0 = (long) done * job->width;
+      if (gpu->finish(gpu->ctx, other, job->C + j0 * job->m, job->m)) {
+        double now = now_seconds();
+        // С двумя панелями в очереди GPU начинает панель, когда заканчивает предыдущую
+        job->scheduler->record(kGpu, panel_flops(*job, done), now - std::max(submitted[other], last_done));
+        last_done = now;
+        job->columns[kGpu] += panel_width(*job, done);
+      } else {
+        job->failed.push_back(done);
+        if (ok) job->scheduler->retire(kGpu);
+        ok = false;
+      }
+    }
+
+    if (panel < 0 && pending[slot] < 0 && pending[other] < 0) break;
+  }
+}
+
+}  // namespace
+
+// C = A * B (column-major, шаги равны числу строк) совместно на CPU и GPU
+static void mp_hybrid_dgemm(int m, int n, int k, const double *A, const double *B, double *C) {
+  int width = (n + kHybridPanels - 1) / kHybridPanels;
+  width = std::max(kMinPanelWidth, (width + kPanelAlign - 1) / kPanelAlign * kPanelAlign);
+  int panels = (n + width - 1) / width;
+
+  {
+    std::lock_guard<std::mutex> guard(rate_mutex);
+    last_split = {width, {0, n}, {0.0, 0.0}};
+  }
+
+  // Малые задачи и узкие C целиком считает BLAS
+  mp_gpu_panels gpu;
+  if (2.0 * m * n * k < kHybridMinFlops || panels < 2 || !mp_metal_panels(&gpu)) {
+    mp_blas_dgemm(0, 0, m, n, k, 1.0, A, m, B, k, 0.0, C, m);
+    return;
+  }
+  if (!gpu.prepare(gpu.ctx, A, m, k, width)) {
+    gpu.release(gpu.ctx);
+    mp_blas_dgemm(0, 0, m, n, k, 1.0, A, m, B, k, 0.0, C, m);
+    return;
+  }
+  // Буферы GPU и загрузка A в float; панели B и C преобразуются служебным
+  // потоком одновременно со счетом и относятся к вычислению
+  mp_stats_mark(MP_PHASE_CONVERT);
+
+  double rate[2];
+  {
+    std::lock_guard<std::mutex> guard(rate_mutex);
+    rate[kGpu] = known_rate[kGpu];
+    rate[kCpu] = known_rate[kCpu];
+  }
+  PanelScheduler scheduler(panels, rate);
+  HybridJob job;
+  job.m = m;
+  job.n = n;
+  job.k = k;
+  job.width = width;
+  job.A = A;
+  job.B = B;
+  job.C = C;
+  job.scheduler = &scheduler;
+  job.gpu = &gpu;
+  job.columns[kGpu] = job.columns[kCpu] = 0;
+
+  // Вызывающий поток работает как CPU-исполнитель
+  std::thread gpu_thread(gpu_loop, &job);
+  int panel;
+  while ((panel = scheduler.claim(kCpu, 2.0 * m * k * width)) >= 0) {
+    double t0 = now_seconds();
+    cpu_panel(job, panel);
+    scheduler.record(kCpu, panel_flops(job, panel), now_seconds() - t0);
+    job.columns[kCpu] += panel_width(job, panel);
+  }
+  gpu_thread.join();
+  gpu.release(gpu.ctx);
+
+  for (int failed : job.failed) {
+    cpu_panel(job, failed);
+    job.columns[kCpu] += panel_width(job, failed);
+  }
+
+  std::lock_guard<std::mutex> guard(rate_mutex);
+  for (int d = 0; d < 2; d++) {
+    double measured = scheduler.rate(d);
+    if (measured > 0) known_rate[d] = measured;
+    last_split.columns[d] = job.columns[d];
+    last_split.rate[d] = measured;
+  }
+}
+
+// Гибридное умножение для R: проверки выполняются до запуска потоков
+extern "C" SEXP hybrid_mmHuge(SEXP A_r, SEXP B_r) {
+  unsigned call = mp_stats_begin(MP_STATS_HYBRID);
+  if (!Rf_isReal(A_r) || !Rf_isReal(B_r) || !Rf_isMatrix(A_r) || !Rf_isMatrix(B_r)) {
+    Rf_error("A и B должны быть матрицами типа double");
+  }
+  SEXP dim_A = Rf_getAttrib(A_r, R_DimSymbol);
+  SEXP dim_B = Rf_getAttrib(B_r, R_DimSymbol);
+  int m = INTEGER(dim_A)[0];
+  int k = INTEGER(dim_A)[1];
+  int n = INTEGER(dim_B)[1];
+  if (INTEGER(dim_B)[0] != k) {
+    Rf_error("Несовместимые размеры матриц");
+  }
+  mp_stats_mark(MP_PHASE_SETUP);
+
+  SEXP C_r = PROTECT(Rf_allocMatrix(REALSXP, m, n));
+  mp_stats_mark(MP_PHASE_ALLOC);
+  if (m > 0 && n > 0) {
+    mp_hybrid_dgemm(m, n, k, REAL(A_r), REAL(B_r), REAL(C_r));
+  }
+  mp_stats_mark(MP_PHASE_KERNEL);
+  mp_stats_end_product(call, m, n, k, sizeof(double));
+  UNPROTECT(1);
+  return C_r;
+}
+
+// Распределение последнего вызова hybrid_mmHuge: ширина панели, число
+// столбцов C, посчитанных на GPU и CPU, и измеренная скорость (GFLOPS)
+extern "C" SEXP hybrid_split_info() {
+  SplitInfo info;
+  {
+    std::lock_guard<std::mutex> guard(rate_mutex);
+    info = last_split;
+  }
+  const char *fields[] = {"panel_width", "gpu_columns", "cpu_columns", "gpu_gflops", "cpu_gflops"};
+  double values[] = {(double) info.panel_width, (double) info.columns[kGpu], (double) info.columns[kCpu],
+                     info.rate[kGpu] / 1e9, info.rate[kCpu] / 1e9};
+  SEXP result = PROTECT(Rf_allocVector(REALSXP, 5));
+  SEXP names = PROTECT(Rf_allocVector(STRSXP, 5));
+  for (int i = 0; i < 5; i++) {
+    REAL(result)[i] = values[i];
+    SET_STRING_ELT(names, i, Rf_mkChar(fields[i]));
+  }
+  Rf_setAttrib(result, R_NamesSymbol, names);
+  UNPROTECT(2);
+  return result;
+}
@@ -0,0 +1,30 @@
+#ifndef MATRIXPROD_HYBRID_MATMUL_H
+#define MATRIXPROD_HYBRID_MATMUL_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Исполнитель панелей C = A * B[:, j0:j0+w) на GPU. Все функции, кроме
+// prepare и release, вызываются из одного служебного потока планировщика.
+// Слотов два: пока GPU считает панель одного слота, хост готовит другой.
+typedef struct {
+  void *ctx;
+  // Загружает A (m x k, column-major) и выделяет слоты для панелей шириной
+  // до max_width столбцов; 0, если памяти GPU недостаточно
+  int (*prepare)(void *ctx, const double *A, int m, int k, int max_width);
+  // Отправляет панель (столбцы B с шагом ldb) в слот без ожидания; 0 при ошибке
+  int (*submit)(void *ctx, int slot, const double *B, int ldb, int width);
+  // Ждет панель слота и записывает ее в C (шаг ldc); 0 при ошибке GPU
+  int (*finish)(void *ctx, int slot, double *C, int ldc);
+  void (*release)(void *ctx);
+} mp_gpu_panels;
+
+// Заполняет исполнителя панелей Metal; 0, если Metal недоступен
+int mp_metal_panels(mp_gpu_panels *gpu);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
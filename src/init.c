@@ -7,18 +7,99 @@
 extern SEXP rust_mmTiny_cpp(SEXP A_r, SEXP B_r);
 extern SEXP rust_mmBlocked_cpp(SEXP A_r, SEXP B_r);
 extern SEXP rust_mmAuto_cpp(SEXP A_r, SEXP B_r);
+extern SEXP rust_set_auto_threshold(SEXP threshold_r);
 extern SEXP cpp_mmAccelerate(SEXP A_r, SEXP B_r);
+extern SEXP blas_backend_info();
+extern SEXP set_blas_threads(SEXP threads_r);
 extern SEXP gpu_mmMetal(SEXP A_r, SEXP B_r);
+extern SEXP block_mmHuge(SEXP A_r, SEXP B_r);
+extern SEXP set_block_threads(SEXP threads_r, SEXP pin_r);
+extern SEXP get_block_threads();
+extern SEXP set_matmul_threads(SEXP threads_r);
+extern SEXP get_matmul_threads();
+extern SEXP batch_matmul(SEXP A_r, SEXP B_r);
+extern SEXP hybrid_mmHuge(SEXP A_r, SEXP B_r);
+extern SEXP hybrid_split_info();
+extern SEXP mmap_matmul(SEXP a_path_r, SEXP b_path_r, SEXP c_path_r,
+                        SEXP dims_r, SEXP offsets_r, SEXP budget_r);
+extern SEXP view_matmul(SEXP A_r, SEXP a_view_r, SEXP B_r, SEXP b_view_r, SEXP method_r);
+extern SEXP gemm_matmul(SEXP A_r, SEXP B_r, SEXP C_r, SEXP scalars_r, SEXP trans_r, SEXP method_r, SEXP in_place_r);
+extern SEXP syrk_matmul(SEXP X_r, SEXP trans_r, SEXP method_r);
+extern SEXP precision_matmul(SEXP A_r, SEXP B_r, SEXP precision_r, SEXP format_r, SEXP method_r);
+extern SEXP strassen_matmul(SEXP A_r, SEXP B_r, SEXP cutoff_r, SEXP base_r);
+extern SEXP sparse_matmul(SEXP A_r, SEXP B_r, SEXP fill_r);
+extern SEXP skinny_matmul(SEXP A_r, SEXP B_r);
+extern SEXP fixed_matmul(SEXP A_r, SEXP B_r);
+extern SEXP chain_matmul(SEXP mats_r, SEXP steps_r);
+extern SEXP bench_kernel(SEXP kernel_r, SEXP A_r, SEXP B_r, SEXP trans_r, SEXP samples_r, SEXP limits_r);
+extern SEXP bench_batch(SEXP A_r, SEXP B_r, SEXP samples_r, SEXP limits_r);
+extern SEXP bench_clock();
+extern SEXP bench_roofline();
+extern SEXP matmul_stats_get();
+extern SEXP matmul_stats_reset();
+extern SEXP matmul_stats_set(SEXP enabled_r, SEXP markers_r);
+extern SEXP fast_matmul(SEXP A_r, SEXP B_r, SEXP method_r, SEXP verbose_r);
+extern SEXP dispatch_set_profile(SEXP m_r, SEXP k_r, SEXP n_r, SEXP backend_r);
 extern SEXP is_metal_available();
+extern SEXP gpu_mmMetalAsync(SEXP A_r, SEXP B_r);
+extern SEXP matmul_collect(SEXP handle);
+extern SEXP matmul_is_ready(SEXP handle);
+extern SEXP metal_upload(SEXP A_r);
+extern SEXP metal_download(SEXP handle);
+extern SEXP metal_matrix_dim(SEXP handle);
+extern SEXP metal_matmul(SEXP X_r, SEXP Y_r);
+extern SEXP metal_pool_trim(SEXP keep_r);
+extern SEXP metal_pool_info();
+extern SEXP metal_pool_set_limit(SEXP limit_r);
 extern SEXP get_performance_info();
 
 static const R_CallMethodDef CallEntries[] = {
   {"rust_mmTiny_cpp", (DL_FUNC) &rust_mmTiny_cpp, 2},
   {"rust_mmBlocked_cpp", (DL_FUNC) &rust_mmBlocked_cpp, 2},
   {"rust_mmAuto_cpp", (DL_FUNC) &rust_mmAuto_cpp, 2},
+  {"rust_set_auto_threshold", (DL_FUNC) &rust_set_auto_threshold, 1},
   {"cpp_mmAccelerate", (DL_FUNC) &cpp_mmAccelerate, 2},
+  {"blas_backend_info", (DL_FUNC) &blas_backend_info, 0},
+  {"set_blas_threads", (DL_FUNC) &set_blas_threads, 1},
   {"gpu_mmMetal", (DL_FUNC) &gpu_mmMetal, 2},
+  {"block_mmHuge", (DL_FUNC) &block_mmHuge, 2},
+  {"set_block_threads", (DL_FUNC) &set_block_threads, 2},
+  {"get_block_threads", (DL_FUNC) &get_block_threads, 0},
+  {"set_matmul_threads", (DL_FUNC) &set_matmul_threads, 1},
+  {"get_matmul_threads", (DL_FUNC) &get_matmul_threads, 0},
+  {"batch_matmul", (DL_FUNC) &batch_matmul, 2},
+  {"hybrid_mmHuge", (DL_FUNC) &hybrid_mmHuge, 2},
+  {"hybrid_split_info", (DL_FUNC) &hybrid_split_info, 0},
+  {"mmap_matmul", (DL_FUNC) &mmap_matmul, 6},
+  {"view_matmul", (DL_FUNC) &view_matmul, 5},
+  {"gemm_matmul", (DL_FUNC) &gemm_matmul, 7},
+  {"syrk_matmul", (DL_FUNC) &syrk_matmul, 3},
+  {"precision_matmul", (DL_FUNC) &precision_matmul, 5},
+  {"strassen_matmul", (DL_FUNC) &strassen_matmul, 4},
+  {"sparse_matmul", (DL_FUNC) &sparse_matmul, 3},
+  {"skinny_matmul", (DL_FUNC) &skinny_matmul, 2},
+  {"fixed_matmul", (DL_FUNC) &fixed_matmul, 2},
+  {"chain_matmul", (DL_FUNC) &chain_matmul, 2},
+  {"bench_kernel", (DL_FUNC) &bench_kernel, 6},
+  {"bench_batch", (DL_FUNC) &bench_batch, 4},
+  {"bench_clock", (DL_FUNC) &bench_clock, 0},
+  {"bench_roofline", (DL_FUNC) &bench_roofline, 0},
+  {"matmul_stats_get", (DL_FUNC) &matmul_stats_get, 0},
+  {"matmul_stats_reset", (DL_FUNC) &matmul_stats_reset, 0},
+  {"matmul_stats_set", (DL_FUNC) &matmul_stats_set, 2},
+  {"fast_matmul", (DL_FUNC) &fast_matmul, 4},
+  {"dispatch_set_profile", (DL_FUNC) &dispatch_set_profile, 4},
   {"is_metal_available", (DL_FUNC) &is_metal_available, 0},
+  {"gpu_mmMetalAsync", (DL_FUNC) &gpu_mmMetalAsync, 2},
+  {"matmul_collect", (DL_FUNC) &matmul_collect, 1},
+  {"matmul_is_ready", (DL_FUNC) &matmul_is_ready, 1},
+  {"metal_upload", (DL_FUNC) &metal_upload, 1},
+  {"metal_download", (DL_FUNC) &metal_download, 1},
+  {"metal_matrix_dim", (DL_FUNC) &metal_matrix_dim, 1},
+  {"metal_matmul", (DL_FUNC) &metal_matmul, 2},
+  {"metal_pool_trim", (DL_FUNC) &metal_pool_trim, 1},
+  {"metal_pool_info", (DL_FUNC) &metal_pool_info, 0},
+  {"metal_pool_set_limit", (DL_FUNC) &metal_pool_set_limit, 1},
   {"get_performance_info", (DL_FUNC) &get_performance_info, 0},
   {NULL, NULL, 0}
 };
@@ -0,0 +1,301 @@
+// Умножение целых матриц без преобразования в double: операнды читаются
+// как int32, панели A упаковываются плитками по kMR строк, а микроядро
+// kMR x kNR держит суммы в регистрах SIMD (int32 или int64 в зависимости от
+// оценки величины сумм). Память - только панель A на поток; копий A и B в
+// double, как у as.numeric, нет.
+#define R_NO_REMAP
+#include <R.h>
+#include <Rinternals.h>
+
+#include <algorithm>
+#include <atomic>
+#include <climits>
+#include <cstdint>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#include "integer_matmul.h"
+#include "tile_pool.h"
+
+namespace {
+
+// Микроплитка: 8 строк (один регистр int32 AVX2) на 4 столбца
+const int kMR = 8;
+const int kNR = 4;
+// Упакованная панель A (строки x k значений int32) помещается в L2
+const size_t kPanelBytes = 256 * 1024;
+const int kMaxPanelRows = 64;
+// Ниже этого числа умножений пул потоков не используется
+const double kParallelMinOps = 1 << 18;
+const int kTasksPerThread = 4;
+// Граница сумм для int64 с запасом на округление оценки в double
+const double kInt64Bound = 9.0e18;
+
+// Накопление плитки kMR x nr в Acc: ap - упакованная плитка (kMR значений
+// на шаг p), b[j] - столбец j плитки в B. Арифметика беззнаковая: строки и
+// столбцы с NA могут переполняться, они все равно заменяются на NA
+template <typename Acc>
+void tile_generic(int k, int nr, const int *ap, const int *const *b, Acc acc[kNR][kMR]) {
+  typedef typename std::make_unsigned<Acc>::type U;
+  U sum[kNR][kMR] = {};
+  for (int p = 0; p < k; p++) {
+    for (int j = 0; j < nr; j++) {
+      U bv = (U) (Acc) b[j][p];
+      for (int i = 0; i < kMR; i++) sum[j][i] += (U) (Acc) ap[i] * bv;
+    }
+    ap += kMR;
+  }
+  for (int j = 0; j < nr; j++) {
+    for (int i = 0; i < kMR; i++) acc[j][i] = (Acc) sum[j][i];
+  }
+}
+
+void tile(int k, int nr, const int *ap, const int *const *b, int32_t acc[kNR][kMR]) {
+#if defined(__AVX2__)
+  if (nr == kNR) {
+    __m256i c0 = _mm256_setzero_si256(), c1 = _mm256_setzero_si256();
+    __m256i c2 = _mm256_setzero_si256(), c3 = _mm256_setzero_si256();
+    for (int p = 0; p < k; p++) {
+      __m256i a = _mm256_loadu_si256((const __m256i *) ap);
+      c0 = _mm256_add_epi32(c0, _mm256_mullo_epi32(a, _mm256_set1_epi32(b[0][p])));
+      c1 = _mm256_add_epi32(c1, _mm256_mullo_epi32(a, _mm256_set1_epi32(b[1][p])));
+      c2 = _mm256_add_epi32(c2, _mm256_mullo_epi32(a, _mm256_set1_epi32(b[2][p])));
+      c3 = _mm256_add_epi32(c3, _mm256_mullo_epi32(a, _mm256_set1_epi32(b[3][p])));
+      ap += kMR;
+    }
+    _mm256_storeu_si256((__m256i *) acc[0], c0);
+    _mm256_storeu_si256((__m256i *) acc[1], c1);
+    _mm256_storeu_si256((__m256i *) acc[2], c2);
+    _mm256_storeu_si256((__m256i *) acc[3], c3);
+    return;
+  }
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+  if (nr == kNR) {
+    int32x4_t c[kNR][2];
+    for (int j = 0; j < kNR; j++) c[j][0] = c[j][1] = vdupq_n_s32(0);
+    for (int p = 0; p < k; p++) {
+      int32x4_t a0 = vld1q_s32(ap), a1 = vld1q_s32(ap + 4);
+      for (int j = 0; j < kNR; j++) {
+        c[j][0] = vmlaq_n_s32(c[j][0], a0, b[j][p]);
+        c[j][1] = vmlaq_n_s32(c[j][1], a1, b[j][p]);
+      }
+      ap += kMR;
+    }
+    for (int j = 0; j < kNR; j++) {
+      vst1q_s32(acc[j], c[j][0]);
+      vst1q_s32(acc[j] + 4, c[j][1]);
+    }
+    return;
+  }
+#endif
+  tile_generic(k, nr, ap, b, acc);
+}
+
+void tile(int k, int nr, const int *ap, const int *const *b, int64_t acc[kNR][kMR]) {
+#if defined(__AVX2__)
+  if (nr == kNR) {
+    // _mm256_mul_epi32 умножает младшие 32 бита каждой 64-битной ячейки со
+    // знаком: произведение int32 x int32 получается в int64 без переполнения
+    __m256i c[kNR][2];
+    for (int j = 0; j < kNR; j++) c[j][0] = c[j][1] = _mm256_setzero_si256();
+    for (int p = 0; p < k; p++) {
+      __m256i a0 = _mm256_cvtepi32_epi64(_mm_loadu_si128((const __m128i *) ap));
+      __m256i a1 = _mm256_cvtepi32_epi64(_mm_loadu_si128((const __m128i *) (ap + 4)));
+      for (int j = 0; j < kNR; j++) {
+        __m256i bj = _mm256_set1_epi64x(b[j][p]);
+        c[j][0] = _mm256_add_epi64(c[j][0], _mm256_mul_epi32(a0, bj));
+        c[j][1] = _mm256_add_epi64(c[j][1], _mm256_mul_epi32(a1, bj));
+      }
+      ap += kMR;
+    }
+    for (int j = 0; j < kNR; j++) {
+      _mm256_storeu_si256((__m256i *) acc[j], c[j][0]);
+      _mm256_storeu_si256((__m256i *) (acc[j] + 4), c[j][1]);
+    }
+    return;
+  }
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+  if (nr == kNR) {
+    // vmlal_s32: умножение int32 с расширением до int64 и накоплением
+    int64x2_t c[kNR][4];
+    for (int j = 0; j < kNR; j++) c[j][0] = c[j][1] = c[j][2] = c[j][3] = vdupq_n_s64(0);
+    for (int p = 0; p < k; p++) {
+      int32x4_t a0 = vld1q_s32(ap), a1 = vld1q_s32(ap + 4);
+      for (int j = 0; j < kNR; j++) {
+        int32x2_t bj = vdup_n_s32(b[j][p]);
+        c[j][0] = vmlal_s32(c[j][0], vget_low_s32(a0), bj);
+        c[j][1] = vmlal_s32(c[j][1], vget_high_s32(a0), bj);
+        c[j][2] = vmlal_s32(c[j][2], vget_low_s32(a1), bj);
+        c[j][3] = vmlal_s32(c[j][3], vget_high_s32(a1), bj);
+      }
+      ap += kMR;
+    }
+    for (int j = 0; j < kNR; j++) {
+      for (int q = 0; q < 4; q++) vst1q_s64(acc[j] + 2 * q, c[j][q]);
+    }
+    return;
+  }
+#endif
+  tile_generic(k, nr, ap, b, acc);
+}
+
+// Наибольший модуль без учета NA; has_na - есть ли NA
+int max_abs(int rows, int cols, const int *X, int ld, bool *has_na) {
+  int result = 0;
+  bool na = false;
+  for (int j = 0; j < cols; j++) {
+    const int *x = X + (long) j * ld;
+    for (int i = 0; i < rows; i++) {
+      int v = x[i];
+      if (v == NA_INTEGER) {
+        na = true;
+      } else {
+        result = std::max(result, v < 0 ? -v : v);
+      }
+    }
+  }
+  *has_na = na;
+  return result;
+}
+
+struct IntJob {
+  int m, n, k;
+  const int *A;
+  int lda;
+  const int *B;
+  int ldb;
+  double *C;
+  int ldc;
+  int panel_rows;
+  std::atomic<int> failed;
+};
+
+thread_local std::vector<int> panel_buffer;
+
+// Строки r0..r0+rows: упаковка панели A и все плитки C этих строк
+template <typename Acc>
+void panel(IntJob *job, int r0, int rows) {
+  int k = job->k;
+  int padded = (rows + kMR - 1) / kMR * kMR;
+  try {
+    if (panel_buffer.size() < (size_t) padded * k) panel_buffer.resize((size_t) padded * k);
+  } catch (const std::bad_alloc &) {
+    job->failed = 1;
+    return;
+  }
+  int *Ap = panel_buffer.data();
+  for (int t = 0; t < rows; t += kMR) {
+    int mr = std::min(kMR, rows - t);
+    int *dst = Ap + (long) t * k;
+    for (int p = 0; p < k; p++) {
+      const int *a = job->A + r0 + t + (long) p * job->lda;
+      for (int i = 0; i < mr; i++) dst[i] = a[i];
+      for (int i = mr; i < kMR; i++) dst[i] = 0;
+      dst += kMR;
+    }
+  }
+
+  Acc acc[kNR][kMR];
+  for (int j0 = 0; j0 < job->n; j0 += kNR) {
+    int nr = std::min(kNR, job->n - j0);
+    const int *b[kNR];
+    for (int j = 0; j < kNR; j++) b[j] = job->B + (long) (j0 + std::min(j, nr - 1)) * job->ldb;
+    for (int t = 0; t < rows; t += kMR) {
+      tile(k, nr, Ap + (long) t * k, b, acc);
+      int mr = std::min(kMR, rows - t);
+      for (int j = 0; j < nr; j++) {
+        double *c = job->C + r0 + t + (long) (j0 + j) * job->ldc;
+        for (int i = 0; i < mr; i++) c[i] = (double) acc[j][i];
+      }
+    }
+  }
+}
+
+template <typename Acc>
+void panel_task(int task, int worker, void *ctx) {
+  (void) worker;
+  IntJob *job = (IntJob *) ctx;
+  int r0 = task * job->panel_rows;
+  panel<Acc>(job, r0, std::min(job->panel_rows, job->m - r0));
+}
+
+// Строки A и столбцы B с NA: соответствующие элементы C - NA, как у %*%
+void mark_na(int m, int n, int k, const int *A, int lda, const int *B, int ldb,
+             double *C, int ldc) {
+  std::vector<char> row_na(m, 0);
+  for (int p = 0; p < k; p++) {
+    for (int i = 0; i < m; i++) {
+      if (A[i + (long) p * lda] == NA_INTEGER) row_na[i] = 1;
+    }
+  }
+  for (int j = 0; j < n; j++) {
+    double *c = C + (long) j * ldc;
+    bool col_na = false;
+    for (int p = 0; p < k && !col_na; p++) col_na = B[p + (long) j * ldb] == NA_INTEGER;
+    for (int i = 0; i < m; i++) {
+      if (col_na || row_na[i]) c[i] = NA_REAL;
+    }
+  }
+}
+
+template <typename Acc>
+int run(IntJob *job) {
+  double ops = (double) job->m * job->n * job->k;
+  int panels = (job->m + job->panel_rows - 1) / job->panel_rows;
+  if (ops < kParallelMinOps || panels == 1 || mp_pool_in_worker()) {
+    for (int t = 0; t < panels && !job->failed; t++) panel_task<Acc>(t, 0, job);
+  } else {
+    // Панель не меньше kMR строк, задач - до kTasksPerThread на поток
+    int want = mp_pool_get_threads() * kTasksPerThread;
+    if (panels < want && job->panel_rows > kMR) {
+      int rows = (job->m + want - 1) / want;
+      job->panel_rows = std::max(kMR, (rows + kMR - 1) / kMR * kMR);
+      panels = (job->m + job->panel_rows - 1) / job->panel_rows;
+    }
+    mp_pool_run(panels, panel_task<Acc>, job);
+  }
+  return !job->failed;
+}
+
+}  // namespace
+
+extern "C" int mp_int_matmul(int m, int n, int k, const int *A, int lda, const int *B, int ldb,
+                             double *C, int ldc) {
+  if (m == 0 || n == 0) return 1;
+  bool a_na, b_na;
+  int a_max = max_abs(m, k, A, lda, &a_na);
+  int b_max = max_abs(k, n, B, ldb, &b_na);
+  double bound = (double) a_max * b_max * k;
+  if (bound > kInt64Bound) return 0;
+
+  IntJob job;
+  job.m = m;
+  job.n = n;
+  job.k = k;
+  job.A = A;
+  job.lda = lda;
+  job.B = B;
+  job.ldb = ldb;
+  job.C = C;
+  job.ldc = ldc;
+  int rows = (int) (kPanelBytes / (sizeof(int) * std::max(k, 1)));
+  job.panel_rows = std::max(kMR, std::min(kMaxPanelRows, rows / kMR * kMR));
+  job.failed = 0;
+  int ok = bound <= (double) INT_MAX ? run<int32_t>(&job) : run<int64_t>(&job);
+  if (!ok) return 0;
+  if (a_na || b_na) {
+    try {
+      mark_na(m, n, k, A, lda, B, ldb, C, ldc);
+    } catch (const std::bad_alloc &) {
+      return 0;
+    }
+  }
+  return 1;
+}
@@ -0,0 +1,24 @@
+#ifndef MATRIXPROD_INTEGER_MATMUL_H
+#define MATRIXPROD_INTEGER_MATMUL_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Точное C = A * B для целых матриц R (integer или logical, NA_INTEGER -
+// пропуск) в формате column-major. Суммы накапливаются в int32, если
+// max|A| * max|B| * k помещается в int32, иначе в int64; результат - double,
+// как у %*% в R (точен, пока |C| < 2^53, иначе - округление точной суммы).
+// Элементы C в строках A и столбцах B с NA равны NA_REAL. Возвращает 0,
+// если сумма может выйти за пределы int64 или не хватило памяти (тогда
+// вызывающий умножает в double).
+int mp_int_matmul(int m, int n, int k,
+                  const int *A, int lda,
+                  const int *B, int ldb,
+                  double *C, int ldc);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
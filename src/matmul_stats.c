@@ -0,0 +1,211 @@
+#include <R.h>
+#include <Rinternals.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef __has_include
+#if defined(__APPLE__) && __has_include(<os/signpost.h>)
+#include <os/signpost.h>
+#define MP_HAVE_SIGNPOST 1
+#elif defined(__linux__) && __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define MP_HAVE_SDT 1
+#endif
+#endif
+
+#include "matmul_stats.h"
+
+// Имена бэкендов и фаз в порядке перечислений из matmul_stats.h
+static const char *const backend_names[MP_STATS_BACKENDS] = {
+  "blas", "rust_tiny", "rust_blocked", "rust_auto", "metal", "metal_async", "metal_matrix",
+  "block_huge", "hybrid", "batch", "mmap", "view", "gemm", "syrk", "precision", "strassen",
+  "sparse", "skinny", "fixed", "chain", "integer", "complex"
+};
+
+static const char *const phase_names[MP_PHASES] = {
+  "setup", "alloc", "convert", "buffers", "kernel", "copyback"
+};
+
+#ifndef MATRIXPROD_NO_STATS
+
+int mp_stats_enabled = 0;
+__thread int mp_stats_active = -1;
+
+// Маркеры для внешних профилировщиков: os_signpost (Instruments) на macOS,
+// USDT-пробы (perf, bpftrace) на Linux
+static int markers_enabled = 0;
+
+// Накопленные счетчики; точки входа .Call выполняются в потоке R, поэтому
+// блокировка не нужна
+typedef struct {
+  double calls, flops, bytes, seconds;
+  double phase[MP_PHASES];
+} backend_totals;
+
+static backend_totals totals[MP_STATS_BACKENDS];
+static unsigned next_call = 0;
+
+// Текущий вызов потока
+static __thread unsigned active_call = 0;
+static __thread double active_start, active_mark;
+static __thread double active_phase[MP_PHASES];
+
+#ifdef MP_HAVE_SIGNPOST
+static os_log_t signpost_log = NULL;
+static __thread os_signpost_id_t active_signpost;
+#endif
+
+static double now_seconds(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double) ts.tv_sec + 1e-9 * (double) ts.tv_nsec;
+}
+
+unsigned mp_stats_start(int backend) {
+  if (++next_call == 0) next_call = 1;
+  active_call = next_call;
+  mp_stats_active = backend;
+  memset(active_phase, 0, sizeof(active_phase));
+  active_start = active_mark = now_seconds();
+  if (markers_enabled) {
+#ifdef MP_HAVE_SIGNPOST
+    if (__builtin_available(macOS 10.14, *)) {
+      active_signpost = os_signpost_id_generate(signpost_log);
+      os_signpost_interval_begin(signpost_log, active_signpost, "matmul", "%{public}s",
+                                 backend_names[backend]);
+    }
+#elif defined(MP_HAVE_SDT)
+    DTRACE_PROBE1(matrixprod, call_begin, backend_names[backend]);
+#endif
+  }
+  return active_call;
+}
+
+void mp_stats_record(int phase) {
+  double now = now_seconds();
+  active_phase[phase] += now - active_mark;
+  active_mark = now;
+  if (markers_enabled) {
+#ifdef MP_HAVE_SIGNPOST
+    if (__builtin_available(macOS 10.14, *)) {
+      os_signpost_event_emit(signpost_log, active_signpost, "phase", "%{public}s",
+                             phase_names[phase]);
+    }
+#elif defined(MP_HAVE_SDT)
+    DTRACE_PROBE2(matrixprod, phase, backend_names[mp_stats_active], phase_names[phase]);
+#endif
+  }
+}
+
+void mp_stats_finish(unsigned call, double flops, double bytes) {
+  // Вложенный вызов (например, bench_batch -> batch_matmul) уже заменил
+  // текущий: внешний не учитывается
+  if (call != active_call || mp_stats_active < 0) return;
+  backend_totals *t = &totals[mp_stats_active];
+  t->calls += 1;
+  t->flops += flops;
+  t->bytes += bytes;
+  t->seconds += now_seconds() - active_start;
+  for (int p = 0; p < MP_PHASES; p++) t->phase[p] += active_phase[p];
+  if (markers_enabled) {
+#ifdef MP_HAVE_SIGNPOST
+    if (__builtin_available(macOS 10.14, *)) {
+      os_signpost_interval_end(signpost_log, active_signpost, "matmul", "%{public}s",
+                               backend_names[mp_stats_active]);
+    }
+#elif defined(MP_HAVE_SDT)
+    DTRACE_PROBE1(matrixprod, call_end, backend_names[mp_stats_active]);
+#endif
+  }
+  mp_stats_active = -1;
+  active_call = 0;
+}
+
+#endif
+
+// Включает или выключает сбор (NA - не менять); возвращает прежние
+// значения c(enabled, markers)
+SEXP matmul_stats_set(SEXP enabled_r, SEXP markers_r) {
+  int enabled = asLogical(enabled_r), markers = asLogical(markers_r);
+  SEXP previous = PROTECT(allocVector(LGLSXP, 2));
+#ifndef MATRIXPROD_NO_STATS
+  LOGICAL(previous)[0] = mp_stats_enabled;
+  LOGICAL(previous)[1] = markers_enabled;
+  if (markers != NA_LOGICAL) {
+#ifdef MP_HAVE_SIGNPOST
+    if (markers && signpost_log == NULL) signpost_log = os_log_create("org.matrixprod", "matmul");
+#endif
+    markers_enabled = markers;
+  }
+  if (enabled != NA_LOGICAL) {
+    mp_stats_enabled = enabled;
+    mp_stats_active = -1;
+    active_call = 0;
+  }
+#else
+  (void) markers;
+  if (enabled == TRUE) warning("Пакет собран с MATRIXPROD_NO_STATS: статистика недоступна");
+  LOGICAL(previous)[0] = FALSE;
+  LOGICAL(previous)[1] = FALSE;
+#endif
+  UNPROTECT(1);
+  return previous;
+}
+
+SEXP matmul_stats_reset() {
+#ifndef MATRIXPROD_NO_STATS
+  memset(totals, 0, sizeof(totals));
+#endif
+  return R_NilValue;
+}
+
+// Список: enabled, markers, backend (имена), counters (бэкенды x calls,
+// flops, bytes, seconds), phases (бэкенды x фазы, секунды)
+SEXP matmul_stats_get() {
+  const char *names[] = {"enabled", "markers", "backend", "counters", "phases"};
+  SEXP result = PROTECT(allocVector(VECSXP, 5));
+  SEXP nm = PROTECT(allocVector(STRSXP, 5));
+  for (int i = 0; i < 5; i++) SET_STRING_ELT(nm, i, mkChar(names[i]));
+  setAttrib(result, R_NamesSymbol, nm);
+
+  SEXP backends = PROTECT(allocVector(STRSXP, MP_STATS_BACKENDS));
+  SEXP counters = PROTECT(allocMatrix(REALSXP, MP_STATS_BACKENDS, 4));
+  SEXP phases = PROTECT(allocMatrix(REALSXP, MP_STATS_BACKENDS, MP_PHASES));
+  for (int b = 0; b < MP_STATS_BACKENDS; b++) SET_STRING_ELT(backends, b, mkChar(backend_names[b]));
+  memset(REAL(counters), 0, sizeof(double) * MP_STATS_BACKENDS * 4);
+  memset(REAL(phases), 0, sizeof(double) * MP_STATS_BACKENDS * MP_PHASES);
+
+  SEXP counter_names = PROTECT(allocVector(STRSXP, 4));
+  const char *counter_labels[] = {"calls", "flops", "bytes", "seconds"};
+  for (int i = 0; i < 4; i++) SET_STRING_ELT(counter_names, i, mkChar(counter_labels[i]));
+  SEXP phase_labels = PROTECT(allocVector(STRSXP, MP_PHASES));
+  for (int p = 0; p < MP_PHASES; p++) SET_STRING_ELT(phase_labels, p, mkChar(phase_names[p]));
+  SEXP counter_dimnames = PROTECT(allocVector(VECSXP, 2));
+  SET_VECTOR_ELT(counter_dimnames, 1, counter_names);
+  setAttrib(counters, R_DimNamesSymbol, counter_dimnames);
+  SEXP phase_dimnames = PROTECT(allocVector(VECSXP, 2));
+  SET_VECTOR_ELT(phase_dimnames, 1, phase_labels);
+  setAttrib(phases, R_DimNamesSymbol, phase_dimnames);
+
+#ifndef MATRIXPROD_NO_STATS
+  for (int b = 0; b < MP_STATS_BACKENDS; b++) {
+    REAL(counters)[b] = totals[b].calls;
+    REAL(counters)[b + MP_STATS_BACKENDS] = totals[b].flops;
+    REAL(counters)[b + 2 * MP_STATS_BACKENDS] = totals[b].bytes;
+    REAL(counters)[b + 3 * MP_STATS_BACKENDS] = totals[b].seconds;
+    for (int p = 0; p < MP_PHASES; p++) {
+      REAL(phases)[b + p * MP_STATS_BACKENDS] = totals[b].phase[p];
+    }
+  }
+  SET_VECTOR_ELT(result, 0, ScalarLogical(mp_stats_enabled));
+  SET_VECTOR_ELT(result, 1, ScalarLogical(markers_enabled));
+#else
+  SET_VECTOR_ELT(result, 0, ScalarLogical(FALSE));
+  SET_VECTOR_ELT(result, 1, ScalarLogical(FALSE));
+#endif
+  SET_VECTOR_ELT(result, 2, backends);
+  SET_VECTOR_ELT(result, 3, counters);
+  SET_VECTOR_ELT(result, 4, phases);
+  UNPROTECT(9);
+  return result;
+}
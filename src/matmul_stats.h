@@ -0,0 +1,116 @@
+#ifndef MATRIXPROD_MATMUL_STATS_H
+#define MATRIXPROD_MATMUL_STATS_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Счетчики вызовов точек входа .Call: число вызовов, FLOP, перемещенные
+// байты и время по фазам. Сбор включается matmul_stats_enable(); когда он
+// выключен, каждая отметка - одна проверка флага, а сборка с
+// -DMATRIXPROD_NO_STATS убирает и ее.
+//
+// Использование в точке входа:
+//   unsigned call = mp_stats_begin(MP_STATS_BLAS);
+//   ... проверка аргументов ...      mp_stats_mark(MP_PHASE_SETUP);
+//   ... Rf_allocMatrix ...           mp_stats_mark(MP_PHASE_ALLOC);
+//   ... вычисление ...               mp_stats_mark(MP_PHASE_KERNEL);
+//   mp_stats_end(call, flops, bytes);
+// Отметка относит время с предыдущей отметки к фазе текущего вызова этого
+// потока, поэтому внутренние функции (например, преобразование double ->
+// float для Metal) ставят отметки без передачи состояния. Вызов, прерванный
+// Rf_error, не учитывается: следующий mp_stats_begin начинает новый.
+
+// Точки входа (бэкенды)
+enum {
+  MP_STATS_BLAS,        // cpp_mmAccelerate
+  MP_STATS_RUST_TINY,
+  MP_STATS_RUST_BLOCKED,
+  MP_STATS_RUST_AUTO,
+  MP_STATS_METAL,       // gpu_mmMetal
+  MP_STATS_METAL_ASYNC, // gpu_mmMetalAsync и matmul_collect
+  MP_STATS_METAL_MATRIX,// metal_upload, metal_matmul, metal_download
+  MP_STATS_BLOCK,       // block_mmHuge
+  MP_STATS_HYBRID,
+  MP_STATS_BATCH,
+  MP_STATS_MMAP,
+  MP_STATS_VIEW,
+  MP_STATS_GEMM,
+  MP_STATS_SYRK,
+  MP_STATS_PRECISION,
+  MP_STATS_STRASSEN,
+  MP_STATS_SPARSE,
+  MP_STATS_SKINNY,
+  MP_STATS_FIXED,
+  MP_STATS_CHAIN,
+  MP_STATS_INTEGER,     // целые матрицы в fastMatMul
+  MP_STATS_COMPLEX,     // комплексные матрицы в fastMatMul
+  MP_STATS_BACKENDS
+};
+
+// Фазы вызова
+enum {
+  MP_PHASE_SETUP,     // проверка аргументов, getAttrib
+  MP_PHASE_ALLOC,     // выделение результата и рабочей памяти
+  MP_PHASE_CONVERT,   // преобразование точности и упаковка операндов
+  MP_PHASE_BUFFERS,   // получение буферов GPU
+  MP_PHASE_KERNEL,    // вычисление (для GPU - выполнение командного буфера)
+  MP_PHASE_COPYBACK,  // перенос результата в память R
+  MP_PHASES
+};
+
+#ifndef MATRIXPROD_NO_STATS
+
+extern int mp_stats_enabled;
+extern __thread int mp_stats_active;   // бэкенд текущего вызова потока, -1 - нет
+
+unsigned mp_stats_start(int backend);
+void mp_stats_record(int phase);
+void mp_stats_finish(unsigned call, double flops, double bytes);
+
+// Начало вызова; 0, если сбор выключен
+static inline unsigned mp_stats_begin(int backend) {
+  return mp_stats_enabled ? mp_stats_start(backend) : 0u;
+}
+
+// Время с предыдущей отметки относится к фазе phase
+static inline void mp_stats_mark(int phase) {
+  if (mp_stats_active >= 0) mp_stats_record(phase);
+}
+
+// Переносит текущий вызов на другой бэкенд (диспетчер fastMatMul узнает
+// бэкенд только после проверки аргументов)
+static inline void mp_stats_backend(int backend) {
+  if (mp_stats_active >= 0) mp_stats_active = backend;
+}
+
+// Завершение вызова: flops и bytes добавляются к счетчикам бэкенда
+static inline void mp_stats_end(unsigned call, double flops, double bytes) {
+  if (call != 0) mp_stats_finish(call, flops, bytes);
+}
+
+// Завершение вызова C = A * B (A - m x k, B - k x n): 2mnk FLOP, чтение
+// A и B и запись C элементами по elem байт
+static inline void mp_stats_end_product(unsigned call, double m, double n, double k, double elem) {
+  if (call != 0) mp_stats_finish(call, 2.0 * m * n * k, elem * (m * k + k * n + m * n));
+}
+
+#else
+
+static inline unsigned mp_stats_begin(int backend) { (void) backend; return 0u; }
+static inline void mp_stats_mark(int phase) { (void) phase; }
+static inline void mp_stats_backend(int backend) { (void) backend; }
+static inline void mp_stats_end(unsigned call, double flops, double bytes) {
+  (void) call; (void) flops; (void) bytes;
+}
+static inline void mp_stats_end_product(unsigned call, double m, double n, double k, double elem) {
+  (void) call; (void) m; (void) n; (void) k; (void) elem;
+}
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,140 @@
+// Единое управление потоками: пул плиток (GEBP и другие ядра на
+// mp_pool_run), пул rayon и BLAS получают одно число потоков, чтобы их
+// потоки не конкурировали за ядра. Число потоков BLAS по умолчанию меняется
+// только по MATRIXPROD_THREADS или OMP_NUM_THREADS и только если его не
+// задают переменные самой библиотеки. После fork (parallel::mclapply) каждый
+// пул в дочернем процессе становится однопоточным: потоков родителя там
+// нет, а параллельные процессы уже занимают ядра.
+#include <R.h>
+#include <Rinternals.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "blas_info.h"
+#include "cpu_info.h"
+#include "tile_pool.h"
+
+extern int rust_mm_set_threads(int threads);
+extern int rust_mm_get_threads(void);
+extern void rust_mm_after_fork(int threads);
+
+// Установленное число потоков (0 - еще не задано) и его источник
+static int matmul_threads = 0;
+static const char *threads_source = "default";
+static int atfork_registered = 0;
+
+// Переменные окружения, которыми библиотеки BLAS задают свое число потоков
+static const char *const blas_env_vars[] = {
+  "OPENBLAS_NUM_THREADS", "GOTO_NUM_THREADS", "MKL_NUM_THREADS", "VECLIB_MAXIMUM_THREADS",
+  "BLIS_NUM_THREADS", "FLEXIBLAS_NUM_THREADS"
+};
+
+// Положительное число из переменной окружения; в OMP_NUM_THREADS может быть
+// список для вложенных уровней ("4,2") - берется первый уровень
+static int env_threads(const char *name) {
+  const char *value = getenv(name);
+  char *end;
+  long threads;
+  if (value == NULL || *value == '\0') return 0;
+  threads = strtol(value, &end, 10);
+  if (end == value || threads < 1 || threads > 4096) return 0;
+  return (int) threads;
+}
+
+// Задано ли число потоков BLAS переменной окружения самой библиотеки
+static int blas_env_threads(void) {
+  for (size_t i = 0; i < sizeof(blas_env_vars) / sizeof(blas_env_vars[0]); i++) {
+    if (env_threads(blas_env_vars[i]) > 0) return 1;
+  }
+  return 0;
+}
+
+// Число потоков по умолчанию: MATRIXPROD_THREADS, затем OMP_NUM_THREADS,
+// иначе число физических ядер
+static int default_threads(const char **source) {
+  int threads;
+  if ((threads = env_threads("MATRIXPROD_THREADS")) > 0) {
+    *source = "MATRIXPROD_THREADS";
+  } else if ((threads = env_threads("OMP_NUM_THREADS")) > 0) {
+    *source = "OMP_NUM_THREADS";
+  } else {
+    threads = mp_physical_cores();
+    if (threads < 1) threads = 1;
+    *source = "cores";
+  }
+  return threads;
+}
+
+// Дочерний процесс fork: здесь выполняется только вызвавший fork поток,
+// поэтому состояние пулов сбрасывается без ожидания чужих потоков. Функция
+// BLAS уже найдена родителем (apply_threads), dlsym не нужен
+static void after_fork_child(void) {
+  mp_pool_after_fork();
+  rust_mm_after_fork(1);
+  mp_blas_set_threads(1);
+  matmul_threads = 1;
+  threads_source = "fork";
+}
+
+// set_blas = 0 оставляет число потоков BLAS как есть
+static void apply_threads(int threads, const char *source, int set_blas) {
+  // Пулы создаются сразу, а не при первом умножении
+  mp_pool_set_threads(threads, -1);
+  rust_mm_set_threads(threads);
+  if (set_blas) {
+    mp_blas_set_threads(threads);
+  } else {
+    mp_blas_prepare_threads();
+  }
+  matmul_threads = threads;
+  threads_source = source;
+  if (!atfork_registered) {
+    pthread_atfork(NULL, NULL, after_fork_child);
+    atfork_registered = 1;
+  }
+}
+
+// set_matmul_threads(threads): NULL - по переменным окружения или числу
+// ядер; BLAS тогда получает число потоков, только если его задал
+// пользователь (MATRIXPROD_THREADS, OMP_NUM_THREADS), а не
+// OPENBLAS_NUM_THREADS и подобные. Возвращает предыдущее число потоков
+SEXP set_matmul_threads(SEXP threads_r) {
+  int previous = matmul_threads > 0 ? matmul_threads : mp_pool_get_threads();
+  const char *source = "set_matmul_threads";
+  int threads, set_blas = 1;
+  if (isNull(threads_r)) {
+    threads = default_threads(&source);
+    set_blas = strcmp(source, "cores") != 0 && !blas_env_threads();
+  } else {
+    threads = asInteger(threads_r);
+    if (threads == NA_INTEGER || threads < 1) {
+      error("Число потоков должно быть положительным целым");
+    }
+  }
+  apply_threads(threads, source, set_blas);
+  return ScalarInteger(previous);
+}
+
+// Установленное число потоков, его источник и фактическое число потоков
+// пула плиток, rayon и BLAS (NA, если BLAS его не сообщает, и для rayon,
+// если ядра Rust не собраны: заглушки только хранят число)
+SEXP get_matmul_threads(void) {
+  static const char *const names[] = {"threads", "source", "block", "rust", "blas"};
+  SEXP result = PROTECT(allocVector(VECSXP, 5));
+  SEXP result_names = PROTECT(allocVector(STRSXP, 5));
+  int blas = mp_blas_threads();
+  SET_VECTOR_ELT(result, 0, ScalarInteger(matmul_threads > 0 ? matmul_threads : NA_INTEGER));
+  SET_VECTOR_ELT(result, 1, mkString(threads_source));
+  SET_VECTOR_ELT(result, 2, ScalarInteger(mp_pool_get_threads()));
+#ifdef MATRIXPROD_HAVE_RUST
+  SET_VECTOR_ELT(result, 3, ScalarInteger(rust_mm_get_threads()));
+#else
+  SET_VECTOR_ELT(result, 3, ScalarInteger(NA_INTEGER));
+#endif
+  SET_VECTOR_ELT(result, 4, ScalarInteger(blas > 0 ? blas : NA_INTEGER));
+  for (int i = 0; i < 5; i++) SET_STRING_ELT(result_names, i, mkChar(names[i]));
+  setAttrib(result, R_NamesSymbol, result_names);
+  UNPROTECT(2);
+  return result;
+}
@@ -21,3 +21,194 @@ kernel void matrix_multiply(device const float* A [[buffer(0)]],
     // Запись результата
     C[gid.y * N + gid.x] = sum;
 }
+
+// ---------------------------------------------------------------------------
+// Блочное ядро: группа 16x16 потоков считает плитку C 64x64, каждый поток -
+// 4x4 элемента. Плитки A (64 x 16) и B (16 x 64) загружаются в память
+// группы один раз и читаются из нее 64 раза, так что ядро упирается в
+// вычисления, а не в пропускную способность памяти устройства.
+// ---------------------------------------------------------------------------
+
+constant constexpr int TILE_M = 64;
+constant constexpr int TILE_N = 64;
+constant constexpr int TILE_K = 16;
+constant constexpr int GROUP_DIM = 16;
+constant constexpr int WORK_M = TILE_M / GROUP_DIM;
+constant constexpr int WORK_N = TILE_N / GROUP_DIM;
+
+// Входы пониженной точности (precision = "mixed"): half или bfloat16,
+// который хранится как ushort (старшие 16 битов float). Блочные ядра
+// переводят их в float при загрузке плиток и накапливают в float.
+inline float to_float(float x) { return x; }
+inline float to_float(half x) { return float(x); }
+inline float to_float(ushort x) { return as_type<float>(uint(x) << 16); }
+
+template <typename T>
+inline void tiled_product(device const T* A, device const T* B, device float* C,
+                          int M, int N, int K, uint2 tid, uint2 tgid,
+                          threadgroup float* As, threadgroup float* Bs) {
+    // A хранится транспонированной (As[k][m]): соседние потоки читают соседние адреса
+    const int row0 = tgid.y * TILE_M;
+    const int col0 = tgid.x * TILE_N;
+    const int lid = tid.y * GROUP_DIM + tid.x;
+    
+    float acc[WORK_M][WORK_N];
+    for (int i = 0; i < WORK_M; i++) {
+        for (int j = 0; j < WORK_N; j++) acc[i][j] = 0.0f;
+    }
+    
+    for (int k0 = 0; k0 < K; k0 += TILE_K) {
+        // Недостающие элементы на краях заполняются нулями
+        for (int idx = lid; idx < TILE_M * TILE_K; idx += GROUP_DIM * GROUP_DIM) {
+            int r = idx / TILE_K, c = idx % TILE_K;
+            int gr = row0 + r, gc = k0 + c;
+            As[c * TILE_M + r] = (gr < M && gc < K) ? to_float(A[gr * K + gc]) : 0.0f;
+        }
+        for (int idx = lid; idx < TILE_K * TILE_N; idx += GROUP_DIM * GROUP_DIM) {
+            int r = idx / TILE_N, c = idx % TILE_N;
+            int gr = k0 + r, gc = col0 + c;
+            Bs[r * TILE_N + c] = (gr < K && gc < N) ? to_float(B[gr * N + gc]) : 0.0f;
+        }
+        threadgroup_barrier(mem_flags::mem_threadgroup);
+        
+        for (int kk = 0; kk < TILE_K; kk++) {
+            float a[WORK_M], b[WORK_N];
+            for (int i = 0; i < WORK_M; i++) a[i] = As[kk * TILE_M + tid.y + GROUP_DIM * i];
+            for (int j = 0; j < WORK_N; j++) b[j] = Bs[kk * TILE_N + tid.x + GROUP_DIM * j];
+            for (int i = 0; i < WORK_M; i++) {
+                for (int j = 0; j < WORK_N; j++) acc[i][j] = fma(a[i], b[j], acc[i][j]);
+            }
+        }
+        threadgroup_barrier(mem_flags::mem_threadgroup);
+    }
+    
+    // Элементы потока разнесены с шагом GROUP_DIM: запись в C объединяется
+    for (int i = 0; i < WORK_M; i++) {
+        int r = row0 + tid.y + GROUP_DIM * i;
+        if (r >= M) continue;
+        for (int j = 0; j < WORK_N; j++) {
+            int c = col0 + tid.x + GROUP_DIM * j;
+            if (c < N) C[r * N + c] = acc[i][j];
+        }
+    }
+}
+
+#define MP_TILED_KERNEL(name, T)                                                  \
+kernel void name(device const T* A [[buffer(0)]],                                 \
+                 device const T* B [[buffer(1)]],                                 \
+                 device float* C [[buffer(2)]],                                   \
+                 constant int& M [[buffer(3)]],                                   \
+                 constant int& N [[buffer(4)]],                                   \
+                 constant int& K [[buffer(5)]],                                   \
+                 uint2 tid [[thread_position_in_threadgroup]],                    \
+                 uint2 tgid [[threadgroup_position_in_grid]]) {                   \
+    threadgroup float As[TILE_K * TILE_M];                                        \
+    threadgroup float Bs[TILE_K * TILE_N];                                        \
+    tiled_product(A, B, C, M, N, K, tid, tgid, As, Bs);                           \
+}
+
+MP_TILED_KERNEL(matrix_multiply_tiled, float)
+MP_TILED_KERNEL(matrix_multiply_tiled_half, half)
+MP_TILED_KERNEL(matrix_multiply_tiled_bf16, ushort)
+
+// ---------------------------------------------------------------------------
+// Ядро на матричных операциях simdgroup (Apple7+, Metal 2.3): группа из
+// четырех simdgroup (128 потоков) считает плитку C 64x64, каждая simdgroup -
+// квадрант 32x32 как 4x4 фрагмента simdgroup_float8x8.
+// ---------------------------------------------------------------------------
+
+#if __METAL_VERSION__ >= 230
+#include <metal_simdgroup_matrix>
+
+constant constexpr int SG_TILE = 64;
+constant constexpr int SG_TILE_K = 16;
+constant constexpr int SG_THREADS = 128;
+
+template <typename T>
+inline void simdgroup_product(device const T* A, device const T* B, device float* C,
+                              int M, int N, int K, uint lid, uint sgid, uint2 tgid,
+                              threadgroup float* As, threadgroup float* Bs,
+                              threadgroup float* Cs) {
+    const int row0 = tgid.y * SG_TILE;
+    const int col0 = tgid.x * SG_TILE;
+    const int sg_row = (sgid / 2) * 32;
+    const int sg_col = (sgid % 2) * 32;
+    
+    simdgroup_float8x8 acc[4][4];
+    for (int i = 0; i < 4; i++) {
+        for (int j = 0; j < 4; j++) acc[i][j] = make_filled_simdgroup_matrix<float, 8, 8>(0.0f);
+    }
+    
+    for (int k0 = 0; k0 < K; k0 += SG_TILE_K) {
+        for (int idx = lid; idx < SG_TILE * SG_TILE_K; idx += SG_THREADS) {
+            int r = idx / SG_TILE_K, c = idx % SG_TILE_K;
+            int gr = row0 + r, gc = k0 + c;
+            As[idx] = (gr < M && gc < K) ? to_float(A[gr * K + gc]) : 0.0f;
+        }
+        for (int idx = lid; idx < SG_TILE_K * SG_TILE; idx += SG_THREADS) {
+            int r = idx / SG_TILE, c = idx % SG_TILE;
+            int gr = k0 + r, gc = col0 + c;
+            Bs[idx] = (gr < K && gc < N) ? to_float(B[gr * N + gc]) : 0.0f;
+        }
+        threadgroup_barrier(mem_flags::mem_threadgroup);
+        
+        for (int kk = 0; kk < SG_TILE_K; kk += 8) {
+            simdgroup_float8x8 a[4], b[4];
+            for (int i = 0; i < 4; i++) {
+                simdgroup_load(a[i], As + (sg_row + 8 * i) * SG_TILE_K + kk, SG_TILE_K);
+            }
+            for (int j = 0; j < 4; j++) {
+                simdgroup_load(b[j], Bs + kk * SG_TILE + sg_col + 8 * j, SG_TILE);
+            }
+            for (int i = 0; i < 4; i++) {
+                for (int j = 0; j < 4; j++) simdgroup_multiply_accumulate(acc[i][j], a[i], b[j], acc[i][j]);
+            }
+        }
+        threadgroup_barrier(mem_flags::mem_threadgroup);
+    }
+    
+    if (row0 + SG_TILE <= M && col0 + SG_TILE <= N) {
+        // Полная плитка записывается прямо в память устройства
+        for (int i = 0; i < 4; i++) {
+            for (int j = 0; j < 4; j++) {
+                device float* dst = C + (row0 + sg_row + 8 * i) * N + col0 + sg_col + 8 * j;
+                simdgroup_store(acc[i][j], dst, N);
+            }
+        }
+        return;
+    }
+    
+    // Краевая плитка: через память группы с проверкой границ
+    for (int i = 0; i < 4; i++) {
+        for (int j = 0; j < 4; j++) {
+            simdgroup_store(acc[i][j], Cs + (sg_row + 8 * i) * SG_TILE + sg_col + 8 * j, SG_TILE);
+        }
+    }
+    threadgroup_barrier(mem_flags::mem_threadgroup);
+    for (int idx = lid; idx < SG_TILE * SG_TILE; idx += SG_THREADS) {
+        int r = row0 + idx / SG_TILE, c = col0 + idx % SG_TILE;
+        if (r < M && c < N) C[r * N + c] = Cs[idx];
+    }
+}
+
+#define MP_SIMDGROUP_KERNEL(name, T)                                              \
+kernel void name(device const T* A [[buffer(0)]],                                 \
+                 device const T* B [[buffer(1)]],                                 \
+                 device float* C [[buffer(2)]],                                   \
+                 constant int& M [[buffer(3)]],                                   \
+                 constant int& N [[buffer(4)]],                                   \
+                 constant int& K [[buffer(5)]],                                   \
+                 uint lid [[thread_index_in_threadgroup]],                        \
+                 uint sgid [[simdgroup_index_in_threadgroup]],                    \
+                 uint2 tgid [[threadgroup_position_in_grid]]) {                   \
+    threadgroup float As[SG_TILE * SG_TILE_K];                                    \
+    threadgroup float Bs[SG_TILE_K * SG_TILE];                                    \
+    /* Буфер для краевых плиток, которые нельзя записать в C целиком */           \
+    threadgroup float Cs[SG_TILE * SG_TILE];                                      \
+    simdgroup_product(A, B, C, M, N, K, lid, sgid, tgid, As, Bs, Cs);             \
+}
+
+MP_SIMDGROUP_KERNEL(matrix_multiply_simdgroup, float)
+MP_SIMDGROUP_KERNEL(matrix_multiply_simdgroup_half, half)
+MP_SIMDGROUP_KERNEL(matrix_multiply_simdgroup_bf16, ushort)
+#endif
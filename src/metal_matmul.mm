@@ -19,6 +19,32 @@
 #include <Foundation/Foundation.h>
 #include <Metal/Metal.h>
 
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <vector>
+
+#include "hybrid_matmul.h"
+#include "matmul_stats.h"
+#include "precision.h"
+#include "tile_pool.h"
+
+// Векторные преобразования double <-> float из vDSP (Accelerate); заголовок
+// Accelerate целиком конфликтует с макросами R, поэтому объявляем вручную
+extern "C" {
+    void vDSP_vdpsp(const double *A, long IA, float *C, long IC, unsigned long N);
+    void vDSP_vspdp(const float *A, long IA, double *C, long IC, unsigned long N);
+}
+
+// Файл может собираться как с ARC, так и без него (по умолчанию в R)
+#if __has_feature(objc_arc)
+#define MP_OBJC_RETAIN(obj) (obj)
+#define MP_OBJC_RELEASE(obj) ((void) 0)
+#else
+#define MP_OBJC_RETAIN(obj) [(obj) retain]
+#define MP_OBJC_RELEASE(obj) [(obj) release]
+#endif
+
 // Глобальные переменные для Metal
 static id<MTLDevice> device = nil;
 static id<MTLLibrary> library = nil;
@@ -27,6 +53,87 @@ static id<MTLComputePipelineState> pipelineState = nil;
 static id<MTLCommandQueue> commandQueue = nil;
 static bool metal_initialized = false;
 
+// Блочные пайплайны по формату входов MP_INPUT_* (nil, если ядро
+// отсутствует в библиотеке или не поддерживается устройством); простое ядро
+// pipelineState - запасной вариант для входов float
+static id<MTLComputePipelineState> tiledPipeline[3] = {nil, nil, nil};
+static id<MTLComputePipelineState> simdgroupPipeline[3] = {nil, nil, nil};
+
+// Размер плитки C, которую считает одна группа потоков блочных ядер
+static const int kMetalTile = 64;
+
+// ---------------------------------------------------------------------------
+// Пул буферов MTLBuffer: повторные вызовы одинакового размера не создают
+// новых буферов и не вызывают повторного выделения страниц драйвером.
+// Размеры округляются вверх до степени двойки (не меньше страницы), так что
+// буфер одной корзины подходит для любого запроса из нее.
+// ---------------------------------------------------------------------------
+
+static std::mutex pool_mutex;
+static std::map<size_t, std::vector<id<MTLBuffer>>> buffer_pool;
+static size_t pooled_bytes = 0;
+// Предел памяти, удерживаемой пулом; лишние буферы освобождаются сразу
+static size_t pool_limit_bytes = (size_t) 2 << 30;
+
+static size_t pool_bucket(size_t length) {
+    size_t bucket = 4096;
+    while (bucket < length) bucket <<= 1;
+    return bucket;
+}
+
+static id<MTLBuffer> pool_acquire(size_t length) {
+    size_t bucket = pool_bucket(length);
+    {
+        std::lock_guard<std::mutex> guard(pool_mutex);
+        auto it = buffer_pool.find(bucket);
+        if (it != buffer_pool.end() && !it->second.empty()) {
+            id<MTLBuffer> buffer = it->second.back();
+            it->second.pop_back();
+            pooled_bytes -= bucket;
+            return buffer;
+        }
+    }
+    return [device newBufferWithLength:bucket options:MTLResourceStorageModeShared];
+}
+
+static void pool_release(id<MTLBuffer> buffer) {
+    if (!buffer) return;
+    size_t bucket = buffer.length;
+    std::lock_guard<std::mutex> guard(pool_mutex);
+    if (pooled_bytes + bucket > pool_limit_bytes) {
+        MP_OBJC_RELEASE(buffer);
+        return;
+    }
+    buffer_pool[bucket].push_back(buffer);
+    pooled_bytes += bucket;
+}
+
+// Освобождает буферы пула, пока в нем не останется не более keep_bytes
+static size_t pool_trim(size_t keep_bytes) {
+    std::lock_guard<std::mutex> guard(pool_mutex);
+    size_t released = 0;
+    // Сначала освобождаем самые большие буферы
+    for (auto it = buffer_pool.rbegin(); it != buffer_pool.rend() && pooled_bytes > keep_bytes; ++it) {
+        while (!it->second.empty() && pooled_bytes > keep_bytes) {
+            MP_OBJC_RELEASE(it->second.back());
+            it->second.pop_back();
+            pooled_bytes -= it->first;
+            released += it->first;
+        }
+    }
+    return released;
+}
+
+// Пайплайн для функции из загруженной библиотеки; nil, если ее нет
+static id<MTLComputePipelineState> make_pipeline(NSString *name) {
+    id<MTLFunction> fn = [library newFunctionWithName:name];
+    if (!fn) return nil;
+    NSError *error = nil;
+    id<MTLComputePipelineState> pipeline = [device newComputePipelineStateWithFunction:fn error:&error];
+    MP_OBJC_RELEASE(fn);
+    return pipeline;
+}
+
 // Функция для инициализации Metal
 bool initialize_metal() {
     if (metal_initialized) return true;
@@ -73,6 +180,18 @@ bool initialize_metal() {
             return false;
         }
         
+        // Блочные ядра необязательны: без них используется простое ядро
+        tiledPipeline[MP_INPUT_FLOAT] = make_pipeline(@"matrix_multiply_tiled");
+        tiledPipeline[MP_INPUT_HALF] = make_pipeline(@"matrix_multiply_tiled_half");
+        tiledPipeline[MP_INPUT_BFLOAT16] = make_pipeline(@"matrix_multiply_tiled_bf16");
+        if (@available(macOS 10.15, *)) {
+            if ([device supportsFamily:MTLGPUFamilyApple7]) {
+                simdgroupPipeline[MP_INPUT_FLOAT] = make_pipeline(@"matrix_multiply_simdgroup");
+                simdgroupPipeline[MP_INPUT_HALF] = make_pipeline(@"matrix_multiply_simdgroup_half");
+                simdgroupPipeline[MP_INPUT_BFLOAT16] = make_pipeline(@"matrix_multiply_simdgroup_bf16");
+            }
+        }
+        
         // Создаем очередь команд
         commandQueue = [device newCommandQueue];
         if (!commandQueue) {
@@ -85,6 +204,115 @@ bool initialize_metal() {
     }
 }
 
+// Выбор ядра по форме: на матрицах меньше плитки блочные ядра простаивают,
+// а группы с разным числом потоков требуют, чтобы пайплайн их допускал.
+// Для 16-битных входов простого ядра нет: nil, если блочные недоступны
+static id<MTLComputePipelineState> select_pipeline(int M, int N, int K, int format) {
+    id<MTLComputePipelineState> fallback = format == MP_INPUT_FLOAT ? pipelineState : nil;
+    if (format == MP_INPUT_FLOAT && (M < kMetalTile / 2 || N < kMetalTile / 2 || K < 16)) {
+        return pipelineState;
+    }
+    id<MTLComputePipelineState> simdgroup = simdgroupPipeline[format];
+    if (simdgroup && simdgroup.maxTotalThreadsPerThreadgroup >= 128 &&
+        M >= kMetalTile && N >= kMetalTile) {
+        return simdgroup;
+    }
+    id<MTLComputePipelineState> tiled = tiledPipeline[format];
+    if (tiled && tiled.maxTotalThreadsPerThreadgroup >= 256) {
+        return tiled;
+    }
+    return fallback;
+}
+
+// ---------------------------------------------------------------------------
+// Преобразование точности: vDSP на непрерывных кусках, куски распределяются
+// по пулу потоков, так что копирование в общую память GPU идет на всех ядрах
+// ---------------------------------------------------------------------------
+
+static const size_t kConvertChunk = (size_t) 1 << 18;
+
+struct ConvertJob {
+    const double *dsrc;
+    const float *fsrc;
+    double *ddst;
+    float *fdst;
+    size_t n;
+};
+
+static void convert_task(int task, int worker, void *ctx) {
+    (void) worker;
+    const ConvertJob *job = (const ConvertJob *) ctx;
+    size_t lo = (size_t) task * kConvertChunk;
+    size_t len = job->n - lo < kConvertChunk ? job->n - lo : kConvertChunk;
+    if (job->dsrc) {
+        vDSP_vdpsp(job->dsrc + lo, 1, job->fdst + lo, 1, len);
+    } else {
+        vDSP_vspdp(job->fsrc + lo, 1, job->ddst + lo, 1, len);
+    }
+}
+
+static void run_convert(ConvertJob &job) {
+    if (job.n == 0) return;
+    int tasks = (int) ((job.n + kConvertChunk - 1) / kConvertChunk);
+    if (tasks == 1) {
+        convert_task(0, 0, &job);
+    } else {
+        mp_pool_run(tasks, convert_task, &job);
+    }
+}
+
+static void double_to_float(const double *src, float *dst, size_t n) {
+    ConvertJob job = {src, NULL, NULL, dst, n};
+    run_convert(job);
+}
+
+static void float_to_double(const float *src, double *dst, size_t n) {
+    ConvertJob job = {NULL, src, dst, NULL, n};
+    run_convert(job);
+}
+
+// Кодирует C = A * B для матриц R (column-major, A - M x K, B - K x N).
+// Ядра работают в row-major; массив column-major X в row-major - это X^T,
+// поэтому считаем C^T = B^T * A^T, передавая B первым операндом: результат
+// N x M в row-major совпадает с C в column-major без транспонирования.
+// format - формат элементов A и B (MP_INPUT_*), пайплайн для него должен
+// существовать (см. select_pipeline); C всегда float.
+static void encode_product(id<MTLCommandBuffer> commandBuffer, id<MTLBuffer> bufferA,
+                           id<MTLBuffer> bufferB, id<MTLBuffer> bufferC,
+                           int M, int N, int K, int format = MP_INPUT_FLOAT) {
+    int rows = N, cols = M, depth = K;
+    id<MTLComputeCommandEncoder> computeEncoder = [commandBuffer computeCommandEncoder];
+    
+    // Выбираем пайплайн по форме задачи
+    id<MTLComputePipelineState> pipeline = select_pipeline(rows, cols, depth, format);
+    [computeEncoder setComputePipelineState:pipeline];
+    
+    // Устанавливаем буферы (операнды переставлены, см. выше)
+    [computeEncoder setBuffer:bufferB offset:0 atIndex:0];
+    [computeEncoder setBuffer:bufferA offset:0 atIndex:1];
+    [computeEncoder setBuffer:bufferC offset:0 atIndex:2];
+    [computeEncoder setBytes:&rows length:sizeof(int) atIndex:3];
+    [computeEncoder setBytes:&cols length:sizeof(int) atIndex:4];
+    [computeEncoder setBytes:&depth length:sizeof(int) atIndex:5];
+    
+    if (pipeline == pipelineState) {
+        // Простое ядро: один поток на элемент C
+        MTLSize gridSize = MTLSizeMake(cols, rows, 1);
+        NSUInteger threadGroupWidth = pipeline.threadExecutionWidth;
+        NSUInteger threadGroupHeight = pipeline.maxTotalThreadsPerThreadgroup / threadGroupWidth;
+        MTLSize threadGroupSize = MTLSizeMake(threadGroupWidth, threadGroupHeight, 1);
+        [computeEncoder dispatchThreads:gridSize threadsPerThreadgroup:threadGroupSize];
+    } else {
+        // Блочные ядра: одна группа на плитку C 64x64
+        MTLSize groups = MTLSizeMake((cols + kMetalTile - 1) / kMetalTile,
+                                     (rows + kMetalTile - 1) / kMetalTile, 1);
+        MTLSize threads = pipeline == simdgroupPipeline[format] ? MTLSizeMake(128, 1, 1)
+                                                                : MTLSizeMake(16, 16, 1);
+        [computeEncoder dispatchThreadgroups:groups threadsPerThreadgroup:threads];
+    }
+    [computeEncoder endEncoding];
+}
+
 // Функция для проверки доступности Metal
 extern "C" SEXP is_metal_available() {
     SEXP result = PROTECT(Rf_allocVector(LGLSXP, 1));
@@ -93,97 +321,743 @@ extern "C" SEXP is_metal_available() {
     return result;
 }
 
-// Функция для умножения матриц с использованием Metal
-extern "C" SEXP gpu_mmMetal(SEXP A_r, SEXP B_r) {
+// То же для диспетчера fastMatMul (dispatch_matmul.cpp): 1, если есть устройство
+extern "C" int mp_metal_available() {
+    return initialize_metal() ? 1 : 0;
+}
+
+// Инициализирует Metal и проверяет операнды; Rf_error при ошибке
+static void check_operands(SEXP A_r, SEXP B_r, int *M, int *K, int *N) {
     // Инициализируем Metal
     if (!initialize_metal()) {
         Rf_error("Metal не инициализирован");
     }
     
+    if (!Rf_isReal(A_r) || !Rf_isReal(B_r) || !Rf_isMatrix(A_r) || !Rf_isMatrix(B_r)) {
+        Rf_error("A и B должны быть матрицами типа double");
+    }
+    
     // Получаем размеры матриц
     SEXP dim_A = Rf_getAttrib(A_r, R_DimSymbol);
     SEXP dim_B = Rf_getAttrib(B_r, R_DimSymbol);
     
-    int M = INTEGER(dim_A)[0];
-    int K = INTEGER(dim_A)[1];
-    int N = INTEGER(dim_B)[1];
+    *M = INTEGER(dim_A)[0];
+    *K = INTEGER(dim_A)[1];
+    *N = INTEGER(dim_B)[1];
     
-    if (INTEGER(dim_B)[0] != K) {
+    if (INTEGER(dim_B)[0] != *K) {
         Rf_error("Несовместимые размеры матриц");
     }
+}
+
+// Имя устройства Metal и рекомендуемый объем рабочей памяти (байт) для
+// get_performance_info; 0, если Metal недоступен
+extern "C" int mp_metal_device_info(char *name, int name_len, double *memory_bytes) {
+    if (!initialize_metal()) return 0;
+    @autoreleasepool {
+        const char *device_name = [device.name UTF8String];
+        snprintf(name, name_len, "%s", device_name ? device_name : "");
+        *memory_bytes = (double) device.recommendedMaxWorkingSetSize;
+    }
+    return 1;
+}
+
+// Копирует блок rows x cols (столбцы через ld) в непрерывный буфер float и
+// обратно; непрерывные блоки преобразуются одним вызовом на пуле потоков
+struct StridedJob {
+    const double *dsrc;
+    const float *fsrc;
+    double *ddst;
+    float *fdst;
+    int rows, ld, cols_per_task, cols;
+    // Упаковка: столбец op(X) читается из строки X (с шагом ld)
+    bool trans;
+    // Распаковка: C = alpha * T + beta * C
+    double alpha, beta;
+};
+
+static void strided_task(int task, int worker, void *ctx) {
+    (void) worker;
+    const StridedJob *job = (const StridedJob *) ctx;
+    int j0 = task * job->cols_per_task;
+    int j1 = j0 + job->cols_per_task < job->cols ? j0 + job->cols_per_task : job->cols;
+    for (int j = j0; j < j1; j++) {
+        float *fcol = job->fdst + (size_t) j * job->rows;
+        if (job->dsrc && job->trans) {
+            vDSP_vdpsp(job->dsrc + j, job->ld, fcol, 1, job->rows);
+        } else if (job->dsrc) {
+            vDSP_vdpsp(job->dsrc + (size_t) j * job->ld, 1, fcol, 1, job->rows);
+        } else {
+            const float *src = job->fsrc + (size_t) j * job->rows;
+            double *dst = job->ddst + (size_t) j * job->ld;
+            if (job->alpha == 1.0 && job->beta == 0.0) {
+                vDSP_vspdp(src, 1, dst, 1, job->rows);
+            } else if (job->beta == 0.0) {
+                for (int i = 0; i < job->rows; i++) dst[i] = job->alpha * src[i];
+            } else {
+                for (int i = 0; i < job->rows; i++) dst[i] = job->alpha * src[i] + job->beta * dst[i];
+            }
+        }
+    }
+}
+
+static void run_strided(StridedJob &job) {
+    job.cols_per_task = (int) (kConvertChunk / (size_t) (job.rows > 0 ? job.rows : 1));
+    if (job.cols_per_task < 1) job.cols_per_task = 1;
+    int tasks = (job.cols + job.cols_per_task - 1) / job.cols_per_task;
+    if (tasks <= 1) {
+        strided_task(0, 0, &job);
+    } else {
+        mp_pool_run(tasks, strided_task, &job);
+    }
+}
+
+// op(X) (rows x cols) -> float; при trans X хранится как cols x rows
+static void pack_to_float(const double *src, int ld, bool trans, int rows, int cols, float *dst) {
+    if (!trans && ld == rows) {
+        double_to_float(src, dst, (size_t) rows * cols);
+        return;
+    }
+    StridedJob job = {src, NULL, NULL, dst, rows, ld, 0, cols, trans, 1.0, 0.0};
+    run_strided(job);
+}
+
+// C = alpha * T + beta * C для результата T в формате float
+static void unpack_to_double(const float *src, int rows, int cols, double alpha, double beta,
+                             double *dst, int ld) {
+    if (ld == rows && alpha == 1.0 && beta == 0.0) {
+        float_to_double(src, dst, (size_t) rows * cols);
+        return;
+    }
+    StridedJob job = {NULL, src, dst, NULL, rows, ld, 0, cols, false, alpha, beta};
+    run_strided(job);
+}
+
+// C = alpha * op(A) * op(B) + beta * C на GPU; op(X) = X^T при trans_x.
+// Транспонирование выполняется при преобразовании в float, alpha и beta -
+// при переносе результата в C, так что ядра GPU считают обычное A * B.
+// Metal должен быть инициализирован; false, если не удалось выделить буферы
+static bool metal_dgemm(bool trans_a, bool trans_b, int M, int N, int K, double alpha,
+                        const double *A, int lda, const double *B, int ldb,
+                        double beta, double *C, int ldc) {
+    bool buffers_ok = false;
+    @autoreleasepool {
+        // Буферы берем из пула; размеры M/N/K передаются через setBytes
+        size_t A_size = (size_t) M * K * sizeof(float);
+        size_t B_size = (size_t) K * N * sizeof(float);
+        size_t C_size = (size_t) M * N * sizeof(float);
+        
+        id<MTLBuffer> bufferA = pool_acquire(A_size);
+        id<MTLBuffer> bufferB = pool_acquire(B_size);
+        id<MTLBuffer> bufferC = pool_acquire(C_size);
+        buffers_ok = bufferA && bufferB && bufferC;
+        mp_stats_mark(MP_PHASE_BUFFERS);
+        if (buffers_ok) {
+            // Преобразуем double в float прямо в общую память GPU
+            pack_to_float(A, lda, trans_a, M, K, (float *)bufferA.contents);
+            pack_to_float(B, ldb, trans_b, K, N, (float *)bufferB.contents);
+            mp_stats_mark(MP_PHASE_CONVERT);
+            
+            id<MTLCommandBuffer> commandBuffer = [commandQueue commandBuffer];
+            encode_product(commandBuffer, bufferA, bufferB, bufferC, M, N, K);
+            
+            // Запускаем командный буфер и ждем завершения
+            [commandBuffer commit];
+            [commandBuffer waitUntilCompleted];
+            mp_stats_mark(MP_PHASE_KERNEL);
+            
+            // Копируем результат обратно в R
+            unpack_to_double((const float *)bufferC.contents, M, N, alpha, beta, C, ldc);
+            mp_stats_mark(MP_PHASE_COPYBACK);
+        }
+        
+        // Возвращаем буферы в пул для следующих вызовов
+        pool_release(bufferA);
+        pool_release(bufferB);
+        pool_release(bufferC);
+    }
+    return buffers_ok;
+}
+
+// Вариант для view_matmul.cpp и gemm_matmul.cpp (аргументы как у dgemm):
+// 0, если Metal недоступен или нет буферов
+extern "C" int mp_metal_dgemm(int trans_a, int trans_b, int M, int N, int K, double alpha,
+                              const double *A, int lda, const double *B, int ldb,
+                              double beta, double *C, int ldc) {
+    if (!initialize_metal()) return 0;
+    if (M == 0 || N == 0) return 1;
+    if (K == 0 || alpha == 0.0) {
+        // Произведение равно нулю: остается C = beta * C
+        for (int j = 0; j < N; j++) {
+            double *col = C + (size_t) j * ldc;
+            for (int i = 0; i < M; i++) col[i] = beta == 0.0 ? 0.0 : beta * col[i];
+        }
+        return 1;
+    }
+    return metal_dgemm(trans_a != 0, trans_b != 0, M, N, K, alpha, A, lda, B, ldb, beta, C, ldc) ? 1 : 0;
+}
+
+// Упаковка double -> half/bfloat16 в буфер GPU (по столбцам на пуле потоков)
+struct HalfPackJob {
+    const double *src;
+    uint16_t *dst;
+    int rows, ld, cols, cols_per_task, format;
+};
+
+static void half_pack_task(int task, int worker, void *ctx) {
+    (void) worker;
+    const HalfPackJob *job = (const HalfPackJob *) ctx;
+    int j0 = task * job->cols_per_task;
+    int j1 = j0 + job->cols_per_task < job->cols ? j0 + job->cols_per_task : job->cols;
+    for (int j = j0; j < j1; j++) {
+        const double *src = job->src + (size_t) j * job->ld;
+        uint16_t *dst = job->dst + (size_t) j * job->rows;
+        if (job->format == MP_INPUT_HALF) {
+            for (int i = 0; i < job->rows; i++) dst[i] = mp_float_to_half((float) src[i]);
+        } else {
+            for (int i = 0; i < job->rows; i++) dst[i] = mp_float_to_bfloat16((float) src[i]);
+        }
+    }
+}
+
+static void pack_to_half(const double *src, int ld, int rows, int cols, int format, uint16_t *dst) {
+    HalfPackJob job = {src, dst, rows, ld, cols, 0, format};
+    job.cols_per_task = (int) (kConvertChunk / (size_t) (rows > 0 ? rows : 1));
+    if (job.cols_per_task < 1) job.cols_per_task = 1;
+    int tasks = (cols + job.cols_per_task - 1) / job.cols_per_task;
+    if (tasks <= 1) {
+        half_pack_task(0, 0, &job);
+    } else {
+        mp_pool_run(tasks, half_pack_task, &job);
+    }
+}
+
+// C = A * B с входами half или bfloat16 (format = MP_INPUT_*) и
+// накоплением в float (precision = "mixed"): вдвое меньше данных, чем во
+// float, передается в память GPU и читается ядрами. 0, если Metal или
+// ядра для формата недоступны либо не удалось выделить буферы
+extern "C" int mp_metal_mixed_dgemm(int format, int M, int N, int K,
+                                    const double *A, int lda, const double *B, int ldb,
+                                    double *C, int ldc) {
+    if (!initialize_metal()) return 0;
+    if (format != MP_INPUT_HALF && format != MP_INPUT_BFLOAT16) return 0;
+    if (!tiledPipeline[format] && !simdgroupPipeline[format]) return 0;
+    if (M == 0 || N == 0) return 1;
+    if (K == 0) {
+        for (int j = 0; j < N; j++) memset(C + (size_t) j * ldc, 0, (size_t) M * sizeof(double));
+        return 1;
+    }
+    
+    bool buffers_ok = false;
+    @autoreleasepool {
+        id<MTLBuffer> bufferA = pool_acquire((size_t) M * K * sizeof(uint16_t));
+        id<MTLBuffer> bufferB = pool_acquire((size_t) K * N * sizeof(uint16_t));
+        id<MTLBuffer> bufferC = pool_acquire((size_t) M * N * sizeof(float));
+        buffers_ok = bufferA && bufferB && bufferC;
+        mp_stats_mark(MP_PHASE_BUFFERS);
+        if (buffers_ok) {
+            pack_to_half(A, lda, M, K, format, (uint16_t *)bufferA.contents);
+            pack_to_half(B, ldb, K, N, format, (uint16_t *)bufferB.contents);
+            mp_stats_mark(MP_PHASE_CONVERT);
+            
+            id<MTLCommandBuffer> commandBuffer = [commandQueue commandBuffer];
+            encode_product(commandBuffer, bufferA, bufferB, bufferC, M, N, K, format);
+            [commandBuffer commit];
+            [commandBuffer waitUntilCompleted];
+            mp_stats_mark(MP_PHASE_KERNEL);
+            
+            unpack_to_double((const float *)bufferC.contents, M, N, 1.0, 0.0, C, ldc);
+            mp_stats_mark(MP_PHASE_COPYBACK);
+        }
+        pool_release(bufferA);
+        pool_release(bufferB);
+        pool_release(bufferC);
+    }
+    return buffers_ok ? 1 : 0;
+}
+
+// Функция для умножения матриц с использованием Metal
+extern "C" SEXP gpu_mmMetal(SEXP A_r, SEXP B_r) {
+    unsigned call = mp_stats_begin(MP_STATS_METAL);
+    int M, K, N;
+    check_operands(A_r, B_r, &M, &K, &N);
+    mp_stats_mark(MP_PHASE_SETUP);
     
     // Создаем результирующую матрицу
     SEXP C_r = PROTECT(Rf_allocMatrix(REALSXP, M, N));
-    double *A = REAL(A_r);
-    double *B = REAL(B_r);
-    double *C = REAL(C_r);
+    mp_stats_mark(MP_PHASE_ALLOC);
+    
+    // Пустой результат: GPU не нужен
+    if (M == 0 || N == 0) {
+        UNPROTECT(1);
+        return C_r;
+    }
+    
+    // Rf_error вызывается вне @autoreleasepool, чтобы не прерывать его longjmp
+    if (!metal_dgemm(false, false, M, N, K, 1.0, REAL(A_r), M, REAL(B_r), K, 0.0, REAL(C_r), M)) {
+        UNPROTECT(1);
+        Rf_error("Не удалось выделить буферы Metal");
+    }
+    // Перемещаемые данные - операнды и результат в формате float в памяти GPU
+    mp_stats_end_product(call, M, N, K, sizeof(float));
+    
+    UNPROTECT(1);
+    return C_r;
+}
+
+// ---------------------------------------------------------------------------
+// Асинхронное умножение: gpu_mmMetalAsync отправляет командный буфер в общую
+// очередь и сразу возвращает внешний указатель; завершение отслеживается
+// обработчиком addCompletedHandler, результат забирает matmul_collect.
+// ---------------------------------------------------------------------------
+
+struct MetalFuture {
+    id<MTLCommandBuffer> commandBuffer;
+    id<MTLBuffer> bufferA;
+    id<MTLBuffer> bufferB;
+    id<MTLBuffer> bufferC;
+    int M, N;
+    std::mutex mutex;
+    std::condition_variable cv;
+    bool done;
+    bool failed;
+};
+
+// Ждет обработчика завершения (он может выполняться в другом потоке)
+static void future_wait(MetalFuture *future) {
+    std::unique_lock<std::mutex> lock(future->mutex);
+    future->cv.wait(lock, [future] { return future->done; });
+}
+
+static void future_free(MetalFuture *future) {
+    future_wait(future);
+    pool_release(future->bufferC);
+    MP_OBJC_RELEASE(future->commandBuffer);
+    delete future;
+}
+
+static void future_finalizer(SEXP handle) {
+    MetalFuture *future = (MetalFuture *) R_ExternalPtrAddr(handle);
+    if (!future) return;
+    future_free(future);
+    R_ClearExternalPtr(handle);
+}
+
+static MetalFuture *get_future(SEXP handle) {
+    if (TYPEOF(handle) != EXTPTRSXP || !Rf_inherits(handle, "metal_future")) {
+        Rf_error("Ожидается объект metal_future");
+    }
+    MetalFuture *future = (MetalFuture *) R_ExternalPtrAddr(handle);
+    if (!future) {
+        Rf_error("Результат уже получен или объект недействителен");
+    }
+    return future;
+}
+
+extern "C" SEXP gpu_mmMetalAsync(SEXP A_r, SEXP B_r) {
+    unsigned call = mp_stats_begin(MP_STATS_METAL_ASYNC);
+    int M, K, N;
+    check_operands(A_r, B_r, &M, &K, &N);
+    mp_stats_mark(MP_PHASE_SETUP);
+    
+    MetalFuture *future = new MetalFuture();
+    future->M = M;
+    future->N = N;
+    future->done = false;
+    future->failed = false;
+    future->commandBuffer = nil;
+    bool buffers_ok = true;
     
     @autoreleasepool {
-        // Создаем буферы для матриц
-        size_t A_size = M * K * sizeof(float);
-        size_t B_size = K * N * sizeof(float);
-        size_t C_size = M * N * sizeof(float);
-        
-        id<MTLBuffer> bufferA = [device newBufferWithLength:A_size options:MTLResourceStorageModeShared];
-        id<MTLBuffer> bufferB = [device newBufferWithLength:B_size options:MTLResourceStorageModeShared];
-        id<MTLBuffer> bufferC = [device newBufferWithLength:C_size options:MTLResourceStorageModeShared];
-        id<MTLBuffer> bufferM = [device newBufferWithBytes:&M length:sizeof(int) options:MTLResourceStorageModeShared];
-        id<MTLBuffer> bufferN = [device newBufferWithBytes:&N length:sizeof(int) options:MTLResourceStorageModeShared];
-        id<MTLBuffer> bufferK = [device newBufferWithBytes:&K length:sizeof(int) options:MTLResourceStorageModeShared];
+        future->bufferA = pool_acquire((size_t) M * K * sizeof(float));
+        future->bufferB = pool_acquire((size_t) K * N * sizeof(float));
+        future->bufferC = pool_acquire((size_t) M * N * sizeof(float));
+        mp_stats_mark(MP_PHASE_BUFFERS);
         
-        // Копируем данные из R в буферы Metal
-        float *dataA = (float *)bufferA.contents;
-        float *dataB = (float *)bufferB.contents;
-        
-        // Конвертируем double в float
-        for (int i = 0; i < M * K; i++) {
-            dataA[i] = (float)A[i];
+        if (!future->bufferA || !future->bufferB || !future->bufferC) {
+            buffers_ok = false;
+        } else if (M == 0 || N == 0) {
+            // Пустой результат: GPU не нужен, объект сразу завершен
+            future->done = true;
+            pool_release(future->bufferA);
+            pool_release(future->bufferB);
+        } else {
+            double_to_float(REAL(A_r), (float *)future->bufferA.contents, (size_t) M * K);
+            double_to_float(REAL(B_r), (float *)future->bufferB.contents, (size_t) K * N);
+            mp_stats_mark(MP_PHASE_CONVERT);
+            
+            // Командный буфер из пула автоосвобождения удерживаем до сборки
+            id<MTLCommandBuffer> commandBuffer = MP_OBJC_RETAIN([commandQueue commandBuffer]);
+            future->commandBuffer = commandBuffer;
+            encode_product(commandBuffer, future->bufferA, future->bufferB, future->bufferC, M, N, K);
+            
+            // Буферы операндов не нужны после завершения: возвращаем их в пул
+            // из обработчика, не дожидаясь matmul_collect
+            MetalFuture *target = future;
+            [commandBuffer addCompletedHandler:^(id<MTLCommandBuffer> completed) {
+                pool_release(target->bufferA);
+                pool_release(target->bufferB);
+                std::lock_guard<std::mutex> guard(target->mutex);
+                target->failed = completed.status != MTLCommandBufferStatusCompleted;
+                target->done = true;
+                target->cv.notify_all();
+            }];
+            [commandBuffer commit];
+            // Время отправки; выполнение учитывается при matmul_collect
+            mp_stats_mark(MP_PHASE_KERNEL);
         }
-        
-        for (int i = 0; i < K * N; i++) {
-            dataB[i] = (float)B[i];
+    }
+    
+    if (!buffers_ok) {
+        pool_release(future->bufferA);
+        pool_release(future->bufferB);
+        pool_release(future->bufferC);
+        delete future;
+        Rf_error("Не удалось выделить буферы Metal");
+    }
+    
+    SEXP handle = PROTECT(R_MakeExternalPtr(future, R_NilValue, R_NilValue));
+    R_RegisterCFinalizerEx(handle, future_finalizer, TRUE);
+    Rf_setAttrib(handle, R_ClassSymbol, Rf_mkString("metal_future"));
+    // Произведение учитывается здесь: FLOP и загрузка операндов
+    mp_stats_end(call, 2.0 * M * N * K, sizeof(float) * ((double) M * K + (double) K * N));
+    UNPROTECT(1);
+    return handle;
+}
+
+// TRUE, если GPU закончил вычисление (не блокирует)
+extern "C" SEXP matmul_is_ready(SEXP handle) {
+    MetalFuture *future = get_future(handle);
+    std::lock_guard<std::mutex> guard(future->mutex);
+    return Rf_ScalarLogical(future->done);
+}
+
+// Ждет завершения и возвращает результат; повторный вызов - ошибка
+extern "C" SEXP matmul_collect(SEXP handle) {
+    unsigned call = mp_stats_begin(MP_STATS_METAL_ASYNC);
+    MetalFuture *future = get_future(handle);
+    future_wait(future);
+    mp_stats_mark(MP_PHASE_KERNEL);
+    if (future->failed) {
+        future_free(future);
+        R_ClearExternalPtr(handle);
+        Rf_error("Ошибка выполнения командного буфера Metal");
+    }
+    
+    SEXP C_r = PROTECT(Rf_allocMatrix(REALSXP, future->M, future->N));
+    mp_stats_mark(MP_PHASE_ALLOC);
+    float_to_double((const float *)future->bufferC.contents, REAL(C_r), (size_t) future->M * future->N);
+    mp_stats_mark(MP_PHASE_COPYBACK);
+    mp_stats_end(call, 0.0, sizeof(float) * (double) future->M * future->N);
+    
+    // Буфер результата возвращается в пул сразу, не дожидаясь сборщика мусора
+    future_free(future);
+    R_ClearExternalPtr(handle);
+    UNPROTECT(1);
+    return C_r;
+}
+
+// ---------------------------------------------------------------------------
+// Матрицы в памяти GPU (класс metal_matrix): float, column-major, как в R.
+// Произведения metal_matrix отправляются в общую очередь без ожидания;
+// очередь выполняет их по порядку, поэтому цепочка произведений не требует
+// синхронизации, а хост ждет только при выгрузке результата.
+// ---------------------------------------------------------------------------
+
+struct MetalMatrix {
+    id<MTLBuffer> buffer;
+    int rows, cols;
+    // Последний командный буфер, читающий или пишущий buffer
+    id<MTLCommandBuffer> lastUse;
+};
+
+static void matrix_wait(MetalMatrix *matrix) {
+    if (matrix->lastUse) {
+        [matrix->lastUse waitUntilCompleted];
+        MP_OBJC_RELEASE(matrix->lastUse);
+        matrix->lastUse = nil;
+    }
+}
+
+static void matrix_set_last_use(MetalMatrix *matrix, id<MTLCommandBuffer> commandBuffer) {
+    MP_OBJC_RELEASE(matrix->lastUse);
+    matrix->lastUse = MP_OBJC_RETAIN(commandBuffer);
+}
+
+static void matrix_finalizer(SEXP handle) {
+    MetalMatrix *matrix = (MetalMatrix *) R_ExternalPtrAddr(handle);
+    if (!matrix) return;
+    // Буфер возвращается в пул только после того, как GPU перестал его использовать
+    matrix_wait(matrix);
+    pool_release(matrix->buffer);
+    delete matrix;
+    R_ClearExternalPtr(handle);
+}
+
+static MetalMatrix *get_matrix(SEXP handle) {
+    if (TYPEOF(handle) != EXTPTRSXP || !Rf_inherits(handle, "metal_matrix")) {
+        Rf_error("Ожидается объект metal_matrix");
+    }
+    MetalMatrix *matrix = (MetalMatrix *) R_ExternalPtrAddr(handle);
+    if (!matrix) {
+        Rf_error("Объект metal_matrix недействителен");
+    }
+    return matrix;
+}
+
+// Оборачивает новую матрицу во внешний указатель; при ошибке выделения буфера
+// освобождает ее и вызывает Rf_error
+static SEXP wrap_matrix(MetalMatrix *matrix) {
+    if (!matrix->buffer) {
+        delete matrix;
+        Rf_error("Не удалось выделить буферы Metal");
+    }
+    SEXP handle = PROTECT(R_MakeExternalPtr(matrix, R_NilValue, R_NilValue));
+    R_RegisterCFinalizerEx(handle, matrix_finalizer, TRUE);
+    Rf_setAttrib(handle, R_ClassSymbol, Rf_mkString("metal_matrix"));
+    UNPROTECT(1);
+    return handle;
+}
+
+// Копирует матрицу R в память GPU (с преобразованием в float)
+extern "C" SEXP metal_upload(SEXP A_r) {
+    unsigned call = mp_stats_begin(MP_STATS_METAL_MATRIX);
+    if (!initialize_metal()) {
+        Rf_error("Metal не инициализирован");
+    }
+    if (!Rf_isReal(A_r) || !Rf_isMatrix(A_r)) {
+        Rf_error("A должна быть матрицей типа double");
+    }
+    SEXP dim = Rf_getAttrib(A_r, R_DimSymbol);
+    MetalMatrix *matrix = new MetalMatrix();
+    matrix->rows = INTEGER(dim)[0];
+    matrix->cols = INTEGER(dim)[1];
+    matrix->lastUse = nil;
+    size_t count = (size_t) matrix->rows * matrix->cols;
+    mp_stats_mark(MP_PHASE_SETUP);
+    matrix->buffer = pool_acquire(count * sizeof(float));
+    mp_stats_mark(MP_PHASE_BUFFERS);
+    if (matrix->buffer) {
+        double_to_float(REAL(A_r), (float *)matrix->buffer.contents, count);
+        mp_stats_mark(MP_PHASE_CONVERT);
+    }
+    SEXP handle = wrap_matrix(matrix);
+    mp_stats_end(call, 0.0, sizeof(float) * (double) count);
+    return handle;
+}
+
+// Ждет вычислений над матрицей и копирует ее в матрицу R
+extern "C" SEXP metal_download(SEXP handle) {
+    unsigned call = mp_stats_begin(MP_STATS_METAL_MATRIX);
+    MetalMatrix *matrix = get_matrix(handle);
+    // Ожидание отправленных произведений - время выполнения на GPU
+    matrix_wait(matrix);
+    mp_stats_mark(MP_PHASE_KERNEL);
+    SEXP C_r = PROTECT(Rf_allocMatrix(REALSXP, matrix->rows, matrix->cols));
+    mp_stats_mark(MP_PHASE_ALLOC);
+    float_to_double((const float *)matrix->buffer.contents, REAL(C_r), (size_t) matrix->rows * matrix->cols);
+    mp_stats_mark(MP_PHASE_COPYBACK);
+    mp_stats_end(call, 0.0, sizeof(float) * (double) matrix->rows * matrix->cols);
+    UNPROTECT(1);
+    return C_r;
+}
+
+extern "C" SEXP metal_matrix_dim(SEXP handle) {
+    MetalMatrix *matrix = get_matrix(handle);
+    SEXP dim = PROTECT(Rf_allocVector(INTSXP, 2));
+    INTEGER(dim)[0] = matrix->rows;
+    INTEGER(dim)[1] = matrix->cols;
+    UNPROTECT(1);
+    return dim;
+}
+
+// X * Y целиком на GPU; результат остается в памяти GPU
+extern "C" SEXP metal_matmul(SEXP X_r, SEXP Y_r) {
+    unsigned call = mp_stats_begin(MP_STATS_METAL_MATRIX);
+    MetalMatrix *X = get_matrix(X_r);
+    MetalMatrix *Y = get_matrix(Y_r);
+    if (X->cols != Y->rows) {
+        Rf_error("Несовместимые размеры матриц");
+    }
+    
+    MetalMatrix *Z = new MetalMatrix();
+    Z->rows = X->rows;
+    Z->cols = Y->cols;
+    Z->lastUse = nil;
+    mp_stats_mark(MP_PHASE_SETUP);
+    Z->buffer = pool_acquire((size_t) Z->rows * Z->cols * sizeof(float));
+    mp_stats_mark(MP_PHASE_BUFFERS);
+    
+    if (Z->buffer && Z->rows > 0 && Z->cols > 0) {
+        @autoreleasepool {
+            id<MTLCommandBuffer> commandBuffer = [commandQueue commandBuffer];
+            encode_product(commandBuffer, X->buffer, Y->buffer, Z->buffer, X->rows, Y->cols, X->cols);
+            [commandBuffer commit];
+            // Все три буфера заняты этим командным буфером до его завершения
+            matrix_set_last_use(X, commandBuffer);
+            matrix_set_last_use(Y, commandBuffer);
+            matrix_set_last_use(Z, commandBuffer);
         }
-        
-        // Создаем командный буфер
+        mp_stats_mark(MP_PHASE_KERNEL);
+    }
+    // Данные остаются в памяти GPU: перемещенных байт нет, ожидание
+    // вычисления учитывается в metal_download
+    SEXP handle = wrap_matrix(Z);
+    mp_stats_end(call, 2.0 * X->rows * Y->cols * (double) X->cols, 0.0);
+    return handle;
+}
+
+// ---------------------------------------------------------------------------
+// Исполнитель панелей для гибридного умножения (hybrid_matmul.cpp): A
+// загружается на GPU один раз, а панели B и C проходят через два слота.
+// Вызовы submit/finish идут из служебного потока планировщика, поэтому
+// преобразования здесь последовательные: пул потоков в это время занят CPU.
+// ---------------------------------------------------------------------------
+
+struct PanelContext {
+    id<MTLBuffer> bufferA;
+    id<MTLBuffer> bufferB[2];
+    id<MTLBuffer> bufferC[2];
+    id<MTLCommandBuffer> pending[2];
+    int M, K, width[2];
+};
+
+static int panels_prepare(void *ctx, const double *A, int m, int k, int max_width) {
+    PanelContext *panels = (PanelContext *) ctx;
+    // A и два слота должны помещаться в рабочую память GPU с запасом
+    double need = ((double) m * k + 2.0 * ((double) k + m) * max_width) * sizeof(float);
+    if (need > 0.75 * (double) device.recommendedMaxWorkingSetSize) return 0;
+    
+    panels->M = m;
+    panels->K = k;
+    panels->bufferA = pool_acquire((size_t) m * k * sizeof(float));
+    for (int slot = 0; slot < 2; slot++) {
+        panels->bufferB[slot] = pool_acquire((size_t) k * max_width * sizeof(float));
+        panels->bufferC[slot] = pool_acquire((size_t) m * max_width * sizeof(float));
+    }
+    if (!panels->bufferA || !panels->bufferB[0] || !panels->bufferB[1] ||
+        !panels->bufferC[0] || !panels->bufferC[1]) {
+        return 0;
+    }
+    double_to_float(A, (float *)panels->bufferA.contents, (size_t) m * k);
+    return 1;
+}
+
+static int panels_submit(void *ctx, int slot, const double *B, int ldb, int width) {
+    PanelContext *panels = (PanelContext *) ctx;
+    int K = panels->K;
+    float *dst = (float *)panels->bufferB[slot].contents;
+    if (ldb == K) {
+        vDSP_vdpsp(B, 1, dst, 1, (size_t) K * width);
+    } else {
+        for (int j = 0; j < width; j++) vDSP_vdpsp(B + (size_t) j * ldb, 1, dst + (size_t) j * K, 1, K);
+    }
+    
+    @autoreleasepool {
         id<MTLCommandBuffer> commandBuffer = [commandQueue commandBuffer];
-        
-        // Создаем энкодер вычислений
-        id<MTLComputeCommandEncoder> computeEncoder = [commandBuffer computeCommandEncoder];
-        
-        // Устанавливаем пайплайн
-        [computeEncoder setComputePipelineState:pipelineState];
-        
-        // Устанавливаем буферы
-        [computeEncoder setBuffer:bufferA offset:0 atIndex:0];
-        [computeEncoder setBuffer:bufferB offset:0 atIndex:1];
-        [computeEncoder setBuffer:bufferC offset:0 atIndex:2];
-        [computeEncoder setBuffer:bufferM offset:0 atIndex:3];
-        [computeEncoder setBuffer:bufferN offset:0 atIndex:4];
-        [computeEncoder setBuffer:bufferK offset:0 atIndex:5];
-        
-        // Вычисляем размер сетки и группы потоков
-        MTLSize gridSize = MTLSizeMake(N, M, 1);
-        
-        // Определяем оптимальный размер группы потоков
-        NSUInteger threadGroupWidth = pipelineState.threadExecutionWidth;
-        NSUInteger threadGroupHeight = pipelineState.maxTotalThreadsPerThreadgroup / threadGroupWidth;
-        MTLSize threadGroupSize = MTLSizeMake(threadGroupWidth, threadGroupHeight, 1);
-        
-        // Запускаем вычисления
-        [computeEncoder dispatchThreads:gridSize threadsPerThreadgroup:threadGroupSize];
-        [computeEncoder endEncoding];
-        
-        // Запускаем командный буфер и ждем завершения
+        if (!commandBuffer) return 0;
+        encode_product(commandBuffer, panels->bufferA, panels->bufferB[slot], panels->bufferC[slot],
+                       panels->M, width, K);
         [commandBuffer commit];
-        [commandBuffer waitUntilCompleted];
-        
-        // Копируем результат обратно в R
-        float *dataC = (float *)bufferC.contents;
-        for (int i = 0; i < M * N; i++) {
-            C[i] = (double)dataC[i];
-        }
+        panels->pending[slot] = MP_OBJC_RETAIN(commandBuffer);
+        panels->width[slot] = width;
     }
+    return 1;
+}
+
+static int panels_finish(void *ctx, int slot, double *C, int ldc) {
+    PanelContext *panels = (PanelContext *) ctx;
+    id<MTLCommandBuffer> commandBuffer = panels->pending[slot];
+    if (!commandBuffer) return 0;
+    [commandBuffer waitUntilCompleted];
+    int ok = commandBuffer.status == MTLCommandBufferStatusCompleted;
+    MP_OBJC_RELEASE(commandBuffer);
+    panels->pending[slot] = nil;
+    if (!ok) return 0;
     
-    UNPROTECT(1);
-    return C_r;
+    int M = panels->M;
+    int width = panels->width[slot];
+    const float *src = (const float *)panels->bufferC[slot].contents;
+    if (ldc == M) {
+        vDSP_vspdp(src, 1, C, 1, (size_t) M * width);
+    } else {
+        for (int j = 0; j < width; j++) vDSP_vspdp(src + (size_t) j * M, 1, C + (size_t) j * ldc, 1, M);
+    }
+    return 1;
+}
+
+static void panels_release(void *ctx) {
+    PanelContext *panels = (PanelContext *) ctx;
+    for (int slot = 0; slot < 2; slot++) {
+        if (panels->pending[slot]) {
+            [panels->pending[slot] waitUntilCompleted];
+            MP_OBJC_RELEASE(panels->pending[slot]);
+        }
+        pool_release(panels->bufferB[slot]);
+        pool_release(panels->bufferC[slot]);
+    }
+    pool_release(panels->bufferA);
+    delete panels;
+}
+
+extern "C" int mp_metal_panels(mp_gpu_panels *gpu) {
+    if (!initialize_metal()) return 0;
+    PanelContext *panels = new PanelContext();
+    panels->bufferA = nil;
+    for (int slot = 0; slot < 2; slot++) {
+        panels->bufferB[slot] = nil;
+        panels->bufferC[slot] = nil;
+        panels->pending[slot] = nil;
+    }
+    gpu->ctx = panels;
+    gpu->prepare = panels_prepare;
+    gpu->submit = panels_submit;
+    gpu->finish = panels_finish;
+    gpu->release = panels_release;
+    return 1;
+}
+
+// Освобождает буферы пула Metal, оставляя не более keep_bytes байт.
+// Возвращает число освобожденных байт.
+extern "C" SEXP metal_pool_trim(SEXP keep_r) {
+    double keep = Rf_asReal(keep_r);
+    if (ISNAN(keep) || keep < 0) keep = 0;
+    size_t released = pool_trim((size_t) keep);
+    return Rf_ScalarReal((double) released);
+}
+
+// Состояние пула: число свободных буферов, занятый объем и предел
+extern "C" SEXP metal_pool_info() {
+    size_t buffers = 0;
+    size_t bytes = 0;
+    size_t limit = 0;
+    {
+        std::lock_guard<std::mutex> guard(pool_mutex);
+        for (const auto &entry : buffer_pool) buffers += entry.second.size();
+        bytes = pooled_bytes;
+        limit = pool_limit_bytes;
+    }
+    SEXP result = PROTECT(Rf_allocVector(REALSXP, 3));
+    SEXP names = PROTECT(Rf_allocVector(STRSXP, 3));
+    REAL(result)[0] = (double) buffers;
+    REAL(result)[1] = (double) bytes;
+    REAL(result)[2] = (double) limit;
+    SET_STRING_ELT(names, 0, Rf_mkChar("buffers"));
+    SET_STRING_ELT(names, 1, Rf_mkChar("bytes"));
+    SET_STRING_ELT(names, 2, Rf_mkChar("limit_bytes"));
+    Rf_setAttrib(result, R_NamesSymbol, names);
+    UNPROTECT(2);
+    return result;
+}
+
+// Устанавливает предел памяти пула (байт); лишнее освобождается сразу
+extern "C" SEXP metal_pool_set_limit(SEXP limit_r) {
+    double limit = Rf_asReal(limit_r);
+    if (ISNAN(limit) || limit < 0) Rf_error("Предел пула должен быть неотрицательным числом");
+    {
+        std::lock_guard<std::mutex> guard(pool_mutex);
+        pool_limit_bytes = (size_t) limit;
+    }
+    pool_trim((size_t) limit);
+    return R_NilValue;
 }
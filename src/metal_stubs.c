@@ -0,0 +1,71 @@
+#include <R.h>
+#include <Rinternals.h>
+
+#include "hybrid_matmul.h"
+
+// Заглушки функций Metal для систем без Metal (все, кроме macOS):
+// configure включает этот файл вместо metal_matmul.mm, чтобы таблица
+// регистрации в init.c не зависела от платформы
+
+static SEXP metal_unavailable(void) {
+  error("Metal недоступен на этой платформе");
+  return R_NilValue;
+}
+
+SEXP is_metal_available(void) {
+  return ScalarLogical(FALSE);
+}
+
+// Диспетчер fastMatMul: устройства нет
+int mp_metal_available(void) {
+  return 0;
+}
+
+SEXP gpu_mmMetal(SEXP A_r, SEXP B_r) { return metal_unavailable(); }
+SEXP gpu_mmMetalAsync(SEXP A_r, SEXP B_r) { return metal_unavailable(); }
+SEXP matmul_collect(SEXP handle) { return metal_unavailable(); }
+SEXP matmul_is_ready(SEXP handle) { return metal_unavailable(); }
+SEXP metal_upload(SEXP A_r) { return metal_unavailable(); }
+SEXP metal_download(SEXP handle) { return metal_unavailable(); }
+SEXP metal_matrix_dim(SEXP handle) { return metal_unavailable(); }
+SEXP metal_matmul(SEXP X_r, SEXP Y_r) { return metal_unavailable(); }
+
+// Гибридное умножение без GPU: hybrid_mmHuge считает все панели на CPU
+int mp_metal_panels(mp_gpu_panels *gpu) {
+  return 0;
+}
+
+// Входы half/bfloat16 на GPU (precision = "mixed"): Metal недоступен
+int mp_metal_mixed_dgemm(int format, int M, int N, int K,
+                         const double *A, int lda, const double *B, int ldb,
+                         double *C, int ldc) {
+  return 0;
+}
+
+// Умножение на GPU для view_matmul и fastGemm: Metal недоступен
+int mp_metal_dgemm(int trans_a, int trans_b, int M, int N, int K, double alpha,
+                   const double *A, int lda, const double *B, int ldb,
+                   double beta, double *C, int ldc) {
+  return 0;
+}
+
+// Пула буферов нет: освобождать нечего
+SEXP metal_pool_trim(SEXP keep_r) {
+  return ScalarReal(0.0);
+}
+
+SEXP metal_pool_info(void) {
+  SEXP result = PROTECT(allocVector(REALSXP, 3));
+  SEXP names = PROTECT(allocVector(STRSXP, 3));
+  REAL(result)[0] = REAL(result)[1] = REAL(result)[2] = 0.0;
+  SET_STRING_ELT(names, 0, mkChar("buffers"));
+  SET_STRING_ELT(names, 1, mkChar("bytes"));
+  SET_STRING_ELT(names, 2, mkChar("limit_bytes"));
+  setAttrib(result, R_NamesSymbol, names);
+  UNPROTECT(2);
+  return result;
+}
+
+SEXP metal_pool_set_limit(SEXP limit_r) {
+  return R_NilValue;
+}
@@ -0,0 +1,304 @@
+// Внешнее (out-of-core) умножение: A, B и C хранятся в двоичных файлах
+// (double, column-major, как файлы bigmemory и ff) и отображаются в память.
+// C считается блоками mb x nb, глубина делится на панели kb; панели A и B
+// копируются из отображений в два буфера: пока BLAS считает текущую пару,
+// поток предвыборки читает следующую. Объем буферов ограничен бюджетом
+// памяти, а прочитанные страницы отображений сразу освобождаются.
+#define R_NO_REMAP
+#include <R.h>
+#include <Rinternals.h>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <vector>
+
+#include "blas_backend.h"
+#include "matmul_stats.h"
+
+namespace {
+
+// Блоки меньше этого размера не окупают вызов BLAS и системные вызовы
+const int kMinBlock = 64;
+
+struct Mapping {
+  void *base = MAP_FAILED;
+  size_t length = 0;
+  int fd = -1;
+};
+
+void unmap_file(Mapping &map) {
+  if (map.base != MAP_FAILED) munmap(map.base, map.length);
+  if (map.fd >= 0) close(map.fd);
+  map.base = MAP_FAILED;
+  map.fd = -1;
+}
+
+// Отображает файл не меньше need байт; writable - создать или расширить файл
+// для записи результата. Возвращает текст ошибки или NULL.
+const char *map_file(const char *path, size_t need, bool writable, Mapping *map) {
+  map->fd = writable ? open(path, O_RDWR | O_CREAT, 0644) : open(path, O_RDONLY);
+  if (map->fd < 0) return "Не удалось открыть файл матрицы";
+  struct stat st;
+  if (fstat(map->fd, &st) != 0) return "Не удалось определить размер файла матрицы";
+  if (writable) {
+    if ((size_t) st.st_size < need && ftruncate(map->fd, (off_t) need) != 0) {
+      return "Не удалось расширить файл результата";
+    }
+  } else if ((size_t) st.st_size < need) {
+    return "Файл меньше, чем требуют размеры матрицы";
+  }
+  map->length = std::max(need, (size_t) 1);
+  map->base = mmap(NULL, map->length, writable ? PROT_READ | PROT_WRITE : PROT_READ,
+                   MAP_SHARED, map->fd, 0);
+  if (map->base == MAP_FAILED) return "Не удалось отобразить файл в память";
+  return NULL;
+}
+
+// Освобождает страницы входного отображения, целиком лежащие в диапазоне;
+// данные остаются в файле и при повторном чтении загружаются снова
+void drop_pages(const void *ptr, size_t bytes) {
+  static const size_t page = (size_t) sysconf(_SC_PAGESIZE);
+  uintptr_t lo = ((uintptr_t) ptr + page - 1) / page * page;
+  uintptr_t hi = ((uintptr_t) ptr + bytes) / page * page;
+  if (hi > lo) madvise((void *) lo, hi - lo, MADV_DONTNEED);
+}
+
+struct Blocking {
+  int mb, nb, kb;
+};
+
+// Размеры блоков по бюджету (в элементах): два буфера панелей A (mb x kb) и
+// B (kb x nb) плюс блок C (mb x nb). Если вся глубина k помещается, панель
+// A читается один раз на блок C и сложение частичных сумм не нужно.
+Blocking choose_blocking(int m, int n, int k, double budget) {
+  Blocking bl;
+  double s = -2.0 * k + std::sqrt(4.0 * k * k + budget);
+  if (s >= kMinBlock || s >= std::min(m, n)) {
+    bl.kb = k;
+  } else {
+    s = std::sqrt(budget / 5.0);
+    bl.kb = std::min(k, (int) s);
+  }
+  bl.mb = std::min(m, (int) std::min(s, 2e9));
+  // Оставшийся после ограничения mb бюджет отдаем столбцам блока C
+  double nb = (budget - 2.0 * bl.mb * bl.kb) / (2.0 * bl.kb + bl.mb);
+  bl.nb = std::min(n, (int) std::min(nb, 2e9));
+  return bl;
+}
+
+struct Step {
+  int i0, j0, p0;
+  int mb, nb, kb;
+};
+
+// Панели одного шага; ready - буфер заполнен и ждет вычисления
+struct Stage {
+  std::vector<double> a, b;
+  bool ready = false;
+};
+
+struct StreamJob {
+  const double *A;
+  const double *B;
+  int m, k;
+  std::vector<Step> steps;
+  Stage stages[2];
+  std::mutex mutex;
+  std::condition_variable cv;
+};
+
+// Поток предвыборки: заполняет буферы шагов по очереди, не обгоняя
+// вычисление больше чем на один шаг
+void prefetch_loop(StreamJob *job) {
+  for (size_t s = 0; s < job->steps.size(); s++) {
+    const Step &st = job->steps[s];
+    Stage &stage = job->stages[s % 2];
+    {
+      std::unique_lock<std::mutex> lock(job->mutex);
+      job->cv.wait(lock, [&stage] { return !stage.ready; });
+    }
+    for (int c = 0; c < st.kb; c++) {
+      const double *src = job->A + (size_t) (st.p0 + c) * job->m + st.i0;
+      std::memcpy(stage.a.data() + (size_t) c * st.mb, src, (size_t) st.mb * sizeof(double));
+      drop_pages(src, (size_t) st.mb * sizeof(double));
+    }
+    for (int c = 0; c < st.nb; c++) {
+      const double *src = job->B + (size_t) (st.j0 + c) * job->k + st.p0;
+      std::memcpy(stage.b.data() + (size_t) c * st.kb, src, (size_t) st.kb * sizeof(double));
+      drop_pages(src, (size_t) st.kb * sizeof(double));
+    }
+    {
+      std::lock_guard<std::mutex> guard(job->mutex);
+      stage.ready = true;
+    }
+    job->cv.notify_all();
+  }
+}
+
+double now_seconds() {
+  return std::chrono::duration<double>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Потоковое умножение файлов с блоками bl; возвращает текст ошибки или NULL.
+// Rf_error вызывает вызывающая сторона, когда буферы и потоки уже освобождены.
+const char *stream_product(const char *a_path, const char *b_path, const char *c_path,
+                           int m, int k, int n, size_t offset_a, size_t offset_b,
+                           Blocking bl, double *wait_seconds) {
+  Mapping map_a, map_b, map_c;
+  const char *failure = map_file(a_path, offset_a + (size_t) m * k * sizeof(double), false, &map_a);
+  if (!failure) {
+    failure = map_file(b_path, offset_b + (size_t) k * n * sizeof(double), false, &map_b);
+  }
+  if (!failure) {
+    failure = map_file(c_path, (size_t) m * n * sizeof(double), true, &map_c);
+  }
+
+  StreamJob job;
+  std::vector<double> cbuf;
+  if (!failure) {
+    job.A = (const double *) ((const char *) map_a.base + offset_a);
+    job.B = (const double *) ((const char *) map_b.base + offset_b);
+    job.m = m;
+    job.k = k;
+    try {
+      // Порядок шагов: блоки C по столбцам, внутри блока - все панели глубины
+      for (int j0 = 0; j0 < n; j0 += bl.nb) {
+        for (int i0 = 0; i0 < m; i0 += bl.mb) {
+          for (int p0 = 0; p0 < k; p0 += bl.kb) {
+            Step st = {i0, j0, p0, std::min(bl.mb, m - i0), std::min(bl.nb, n - j0), std::min(bl.kb, k - p0)};
+            job.steps.push_back(st);
+          }
+        }
+      }
+      for (int s = 0; s < 2; s++) {
+        job.stages[s].a.resize((size_t) bl.mb * bl.kb);
+        job.stages[s].b.resize((size_t) bl.kb * bl.nb);
+      }
+      cbuf.resize((size_t) bl.mb * bl.nb);
+    } catch (const std::bad_alloc &) {
+      failure = "Не удалось выделить буферы в пределах бюджета памяти";
+    }
+  }
+  if (failure) {
+    unmap_file(map_a);
+    unmap_file(map_b);
+    unmap_file(map_c);
+    return failure;
+  }
+
+  double *C = (double *) map_c.base;
+  *wait_seconds = 0.0;
+  std::thread prefetcher(prefetch_loop, &job);
+  for (size_t s = 0; s < job.steps.size(); s++) {
+    const Step &st = job.steps[s];
+    Stage &stage = job.stages[s % 2];
+    {
+      double t0 = now_seconds();
+      std::unique_lock<std::mutex> lock(job.mutex);
+      job.cv.wait(lock, [&stage] { return stage.ready; });
+      *wait_seconds += now_seconds() - t0;
+    }
+    mp_blas_dgemm(0, 0, st.mb, st.nb, st.kb, 1.0, stage.a.data(), st.mb,
+                  stage.b.data(), st.kb, st.p0 == 0 ? 0.0 : 1.0, cbuf.data(), st.mb);
+    {
+      std::lock_guard<std::mutex> guard(job.mutex);
+      stage.ready = false;
+    }
+    job.cv.notify_all();
+
+    // Последняя панель глубины: блок C готов, записываем его в файл
+    if (st.p0 + st.kb == k) {
+      for (int c = 0; c < st.nb; c++) {
+        double *dst = C + (size_t) (st.j0 + c) * m + st.i0;
+        std::memcpy(dst, cbuf.data() + (size_t) c * st.mb, (size_t) st.mb * sizeof(double));
+      }
+    }
+    // Столбцы блока C заполнены целиком: запускаем запись их страниц в файл,
+    // чтобы измененные страницы не копились в памяти
+    if (st.p0 + st.kb == k && st.i0 + st.mb == m) {
+      uintptr_t page = (uintptr_t) sysconf(_SC_PAGESIZE);
+      uintptr_t lo = (uintptr_t) (C + (size_t) st.j0 * m) / page * page;
+      uintptr_t hi = (uintptr_t) (C + (size_t) (st.j0 + st.nb) * m);
+      msync((void *) lo, hi - lo, MS_ASYNC);
+    }
+  }
+  prefetcher.join();
+
+  int synced = msync(map_c.base, map_c.length, MS_SYNC) == 0;
+  unmap_file(map_a);
+  unmap_file(map_b);
+  unmap_file(map_c);
+  return synced ? NULL : "Не удалось записать файл результата";
+}
+
+}  // namespace
+
+// C = A * B для матриц в файлах. dims - (m, k, n), offsets - смещения данных
+// A и B в файлах (байт), budget - бюджет буферов в байтах. Возвращает размеры
+// блоков, объем буферов и время ожидания чтения (секунды).
+extern "C" SEXP mmap_matmul(SEXP a_path_r, SEXP b_path_r, SEXP c_path_r,
+                            SEXP dims_r, SEXP offsets_r, SEXP budget_r) {
+  unsigned call = mp_stats_begin(MP_STATS_MMAP);
+  if (!Rf_isString(a_path_r) || !Rf_isString(b_path_r) || !Rf_isString(c_path_r)) {
+    Rf_error("Пути к файлам должны быть строками");
+  }
+  if (!Rf_isInteger(dims_r) || Rf_length(dims_r) != 3 || !Rf_isReal(offsets_r) || Rf_length(offsets_r) != 2) {
+    Rf_error("Некорректные размеры или смещения матриц");
+  }
+  int m = INTEGER(dims_r)[0];
+  int k = INTEGER(dims_r)[1];
+  int n = INTEGER(dims_r)[2];
+  double offset_a = REAL(offsets_r)[0];
+  double offset_b = REAL(offsets_r)[1];
+  double budget = Rf_asReal(budget_r);
+  if (m == NA_INTEGER || k == NA_INTEGER || n == NA_INTEGER || m < 1 || k < 1 || n < 1) {
+    Rf_error("Размеры матриц должны быть положительными");
+  }
+  if (ISNAN(offset_a) || ISNAN(offset_b) || offset_a < 0 || offset_b < 0 ||
+      std::fmod(offset_a, sizeof(double)) != 0 || std::fmod(offset_b, sizeof(double)) != 0) {
+    Rf_error("Смещения должны быть неотрицательными и кратными 8 байтам");
+  }
+  if (ISNAN(budget)) Rf_error("Бюджет памяти должен быть числом");
+
+  Blocking bl = choose_blocking(m, n, k, budget / sizeof(double));
+  if (bl.mb < 1 || bl.nb < 1 || bl.kb < 1 ||
+      (bl.mb < std::min(m, kMinBlock) && bl.nb < std::min(n, kMinBlock))) {
+    Rf_error("Бюджет памяти слишком мал для блочного умножения");
+  }
+  mp_stats_mark(MP_PHASE_SETUP);
+
+  double wait_seconds = 0.0;
+  const char *failure = stream_product(CHAR(STRING_ELT(a_path_r, 0)), CHAR(STRING_ELT(b_path_r, 0)),
+                                       CHAR(STRING_ELT(c_path_r, 0)), m, k, n,
+                                       (size_t) offset_a, (size_t) offset_b, bl, &wait_seconds);
+  if (failure) Rf_error("%s", failure);
+  // Чтение блоков из файлов идет одновременно со счетом и входит в вычисление
+  mp_stats_mark(MP_PHASE_KERNEL);
+  mp_stats_end_product(call, m, n, k, sizeof(double));
+
+  const char *fields[] = {"block_rows", "block_cols", "block_depth", "buffer_bytes", "io_wait_seconds"};
+  double buffer_bytes = (2.0 * ((double) bl.mb * bl.kb + (double) bl.kb * bl.nb) + (double) bl.mb * bl.nb) * sizeof(double);
+  double values[] = {(double) bl.mb, (double) bl.nb, (double) bl.kb, buffer_bytes, wait_seconds};
+  SEXP result = PROTECT(Rf_allocVector(REALSXP, 5));
+  SEXP names = PROTECT(Rf_allocVector(STRSXP, 5));
+  for (int i = 0; i < 5; i++) {
+    REAL(result)[i] = values[i];
+    SET_STRING_ELT(names, i, Rf_mkChar(fields[i]));
+  }
+  Rf_setAttrib(result, R_NamesSymbol, names);
+  UNPROTECT(2);
+  return result;
+}
@@ -1,21 +1,130 @@
 #include <R.h>
 #include <Rinternals.h>
+#include <string.h>
 
-// Информация о производительности - отдельная реализация
+#include "blas_backend.h"
+#include "blas_info.h"
+#include "cpu_info.h"
+#include "gebp_engine.h"
+
+#ifdef __APPLE__
+extern int mp_metal_device_info(char *name, int name_len, double *memory_bytes);
+#endif
+
+// Результат определяется один раз и хранится защищенным от сборщика мусора
+static SEXP cached_info = NULL;
+
+// Именованный список из n элементов; имена задаются строками names
+static SEXP named_list(int n, const char **names) {
+  SEXP list = PROTECT(allocVector(VECSXP, n));
+  SEXP nm = PROTECT(allocVector(STRSXP, n));
+  for (int i = 0; i < n; i++) SET_STRING_ELT(nm, i, mkChar(names[i]));
+  setAttrib(list, R_NamesSymbol, nm);
+  UNPROTECT(2);
+  return list;
+}
+
+static SEXP cpu_section(void) {
+  const char *names[] = {"logical_cores", "physical_cores", "performance_cores",
+                         "efficiency_cores", "simd", "features", "cache"};
+  SEXP cpu = PROTECT(named_list(7, names));
+  int perf, eff;
+  mp_core_classes(&perf, &eff);
+  SET_VECTOR_ELT(cpu, 0, ScalarInteger(mp_logical_cores()));
+  SET_VECTOR_ELT(cpu, 1, ScalarInteger(mp_physical_cores()));
+  SET_VECTOR_ELT(cpu, 2, ScalarInteger(perf));
+  SET_VECTOR_ELT(cpu, 3, ScalarInteger(eff));
+  SET_VECTOR_ELT(cpu, 4, mkString(mp_simd_isa()));
+
+  // Все поддерживаемые наборы инструкций
+  static const struct { int flag; const char *name; } isa[] = {
+    {MP_SIMD_SSE2, "sse2"}, {MP_SIMD_AVX2, "avx2"}, {MP_SIMD_FMA, "fma"},
+    {MP_SIMD_AVX512F, "avx512f"}, {MP_SIMD_AMX, "amx"}, {MP_SIMD_NEON, "neon"},
+    {MP_SIMD_SVE, "sve"}, {MP_SIMD_SME, "sme"}
+  };
+  int flags = mp_simd_flags(), count = 0;
+  for (size_t i = 0; i < sizeof(isa) / sizeof(isa[0]); i++) count += (flags & isa[i].flag) != 0;
+  SEXP features = PROTECT(allocVector(STRSXP, count));
+  count = 0;
+  for (size_t i = 0; i < sizeof(isa) / sizeof(isa[0]); i++) {
+    if (flags & isa[i].flag) SET_STRING_ELT(features, count++, mkChar(isa[i].name));
+  }
+  SET_VECTOR_ELT(cpu, 5, features);
+
+  const mp_cache_info *cache = mp_get_cache_info();
+  const char *cache_names[] = {"l1d", "l2", "l3", "line"};
+  SEXP sizes = PROTECT(allocVector(REALSXP, 4));
+  SEXP size_names = PROTECT(allocVector(STRSXP, 4));
+  REAL(sizes)[0] = (double) cache->l1d;
+  REAL(sizes)[1] = (double) cache->l2;
+  REAL(sizes)[2] = (double) cache->l3;
+  REAL(sizes)[3] = (double) cache->line;
+  for (int i = 0; i < 4; i++) SET_STRING_ELT(size_names, i, mkChar(cache_names[i]));
+  setAttrib(sizes, R_NamesSymbol, size_names);
+  SET_VECTOR_ELT(cpu, 6, sizes);
+
+  UNPROTECT(4);
+  return cpu;
+}
+
+static SEXP metal_section(void) {
+  const char *names[] = {"available", "device", "memory_bytes"};
+  SEXP metal = PROTECT(named_list(3, names));
+  char device[256] = "";
+  double memory = 0.0;
+  int available = 0;
+#ifdef __APPLE__
+  available = mp_metal_device_info(device, (int) sizeof(device), &memory);
+#endif
+  SET_VECTOR_ELT(metal, 0, ScalarLogical(available));
+  SET_VECTOR_ELT(metal, 1, available ? mkString(device) : ScalarString(NA_STRING));
+  SET_VECTOR_ELT(metal, 2, ScalarReal(available ? memory : NA_REAL));
+  UNPROTECT(1);
+  return metal;
+}
+
+static SEXP blas_section(void) {
+  const char *names[] = {"backend", "vendor", "threads"};
+  SEXP blas = PROTECT(named_list(3, names));
+  int threads = mp_blas_threads();
+  SET_VECTOR_ELT(blas, 0, mkString(mp_blas_backend()));
+  SET_VECTOR_ELT(blas, 1, mkString(mp_blas_vendor()));
+  SET_VECTOR_ELT(blas, 2, ScalarInteger(threads > 0 ? threads : NA_INTEGER));
+  UNPROTECT(1);
+  return blas;
+}
+
+// Параметры блочного движка, выведенные из размеров кэшей
+static SEXP blocking_section(void) {
+  const mp_gebp_blocking *bl = mp_gebp_get_blocking();
+  const char *names[] = {"mr", "nr", "mc", "kc", "nc"};
+  SEXP blocking = PROTECT(allocVector(INTSXP, 5));
+  SEXP nm = PROTECT(allocVector(STRSXP, 5));
+  INTEGER(blocking)[0] = bl->mr;
+  INTEGER(blocking)[1] = bl->nr;
+  INTEGER(blocking)[2] = bl->mc;
+  INTEGER(blocking)[3] = bl->kc;
+  INTEGER(blocking)[4] = bl->nc;
+  for (int i = 0; i < 5; i++) SET_STRING_ELT(nm, i, mkChar(names[i]));
+  setAttrib(blocking, R_NamesSymbol, nm);
+  UNPROTECT(2);
+  return blocking;
+}
+
+// Информация об оборудовании: процессор, GPU Metal, BLAS и параметры
+// блочного движка. Определяется при первом вызове и затем кэшируется
 SEXP get_performance_info(void) {
-  SEXP result = PROTECT(allocVector(REALSXP, 8));
-  double *res_ptr = REAL(result);
-  
-  // Заполняем базовой информацией
-  res_ptr[0] = 1.0;  // Есть Accelerate framework (macOS)
-  res_ptr[1] = 0.0;  // Нет OpenCL
-  res_ptr[2] = 0.0;  // Нет Metal
-  res_ptr[3] = 8.0;  // Примерное количество потоков CPU
-  res_ptr[4] = 1.0;  // Базовый уровень поддержки SIMD
-  res_ptr[5] = 10.0; // Примерная производительность для малых матриц (GFLOPS)
-  res_ptr[6] = 20.0; // Примерная производительность для средних матриц (GFLOPS)
-  res_ptr[7] = 0.0;  // Нет GPU для больших матриц
-  
+  if (cached_info) return cached_info;
+
+  const char *names[] = {"cpu", "metal", "blas", "blocking"};
+  SEXP info = PROTECT(named_list(4, names));
+  SET_VECTOR_ELT(info, 0, cpu_section());
+  SET_VECTOR_ELT(info, 1, metal_section());
+  SET_VECTOR_ELT(info, 2, blas_section());
+  SET_VECTOR_ELT(info, 3, blocking_section());
+
+  R_PreserveObject(info);
+  cached_info = info;
   UNPROTECT(1);
-  return result;
+  return info;
 }
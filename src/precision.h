@@ -0,0 +1,76 @@
+#ifndef MATRIXPROD_PRECISION_H
+#define MATRIXPROD_PRECISION_H
+
+#include <stdint.h>
+#include <string.h>
+
+// Форматы входов пониженной точности. Преобразования округляют к
+// ближайшему четному, как аппаратные, и одинаковы на CPU и при подготовке
+// буферов Metal, так что режим "mixed" дает один результат на всех бэкендах.
+enum { MP_INPUT_FLOAT = 0, MP_INPUT_HALF = 1, MP_INPUT_BFLOAT16 = 2 };
+
+static inline uint32_t mp_float_bits(float f) {
+  uint32_t u;
+  memcpy(&u, &f, sizeof(u));
+  return u;
+}
+
+static inline float mp_bits_float(uint32_t u) {
+  float f;
+  memcpy(&f, &u, sizeof(f));
+  return f;
+}
+
+// float -> IEEE binary16. Округление выполняет сложение в float: после
+// масштабирования лишние биты мантиссы выходят за разрядную сетку float
+static inline uint16_t mp_float_to_half(float f) {
+  uint32_t w = mp_float_bits(f);
+  uint32_t sign = (w >> 16) & 0x8000u;
+  uint32_t abs_w = w & 0x7fffffffu;
+  if (abs_w > 0x7f800000u) return (uint16_t) (sign | 0x7e00u);  // NaN
+  // Значения от 65520 округляются к бесконечности
+  if (abs_w >= 0x477ff000u) return (uint16_t) (sign | 0x7c00u);
+  if (abs_w < 0x38800000u) {
+    // Субнормальные half: шаг сетки 2^-24
+    float scaled = mp_bits_float(abs_w) + 0.5f;
+    return (uint16_t) (sign | (mp_float_bits(scaled) - 0x3f000000u));
+  }
+  // Нормальные: 13 младших битов мантиссы округляются к ближайшему четному
+  uint32_t rounded = abs_w + 0x0fffu + ((abs_w >> 13) & 1u);
+  return (uint16_t) (sign | ((rounded - 0x38000000u) >> 13));
+}
+
+static inline float mp_half_to_float(uint16_t h) {
+  uint32_t sign = (uint32_t) (h & 0x8000u) << 16;
+  uint32_t exp = (h >> 10) & 0x1fu;
+  uint32_t mant = h & 0x3ffu;
+  if (exp == 0x1fu) return mp_bits_float(sign | 0x7f800000u | (mant << 13));
+  if (exp == 0) {
+    // Субнормальные и ноль: mant * 2^-24 точно представимо в float
+    float value = (float) mant * 5.9604644775390625e-8f;
+    return mp_bits_float(sign | mp_float_bits(value));
+  }
+  return mp_bits_float(sign | ((exp + 112u) << 23) | (mant << 13));
+}
+
+// float -> bfloat16 (старшие 16 битов float с округлением)
+static inline uint16_t mp_float_to_bfloat16(float f) {
+  uint32_t w = mp_float_bits(f);
+  if ((w & 0x7fffffffu) > 0x7f800000u) return (uint16_t) ((w >> 16) | 0x40u);  // NaN
+  w += 0x7fffu + ((w >> 16) & 1u);
+  return (uint16_t) (w >> 16);
+}
+
+static inline float mp_bfloat16_to_float(uint16_t h) {
+  return mp_bits_float((uint32_t) h << 16);
+}
+
+// Значение double после округления до формата входа (результат в float)
+static inline float mp_round_input(double x, int format) {
+  float f = (float) x;
+  if (format == MP_INPUT_HALF) return mp_half_to_float(mp_float_to_half(f));
+  if (format == MP_INPUT_BFLOAT16) return mp_bfloat16_to_float(mp_float_to_bfloat16(f));
+  return f;
+}
+
+#endif
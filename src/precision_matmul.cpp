@@ -0,0 +1,266 @@
+// Умножение с выбранной точностью: "single" - входы и накопление float,
+// "mixed" - входы half/bfloat16 с накоплением float, "double" - обычный путь.
+// На CPU режим "mixed" воспроизводит вычисление GPU: входы округляются до
+// 16-битного формата и перемножаются в одинарной точности.
+#define R_NO_REMAP
+#include <R.h>
+#include <Rinternals.h>
+
+#include <algorithm>
+#include <cstring>
+#include <new>
+#include <vector>
+
+#include "blas_backend.h"
+#include "gebp_engine.h"
+#include "matmul_stats.h"
+#include "precision.h"
+#include "tile_pool.h"
+
+extern "C" {
+void rust_mm_gemm(int trans_a, int trans_b, int m, int n, int k,
+                  double alpha, const double *a_ptr, int lda,
+                  const double *b_ptr, int ldb,
+                  double beta, double *c_ptr, int ldc);
+void rust_mm_sgemm(int m, int n, int k, const float *a_ptr, int lda,
+                   const float *b_ptr, int ldb, float *c_ptr, int ldc);
+int mp_metal_dgemm(int trans_a, int trans_b, int M, int N, int K, double alpha,
+                   const double *A, int lda, const double *B, int ldb,
+                   double beta, double *C, int ldc);
+int mp_metal_mixed_dgemm(int format, int M, int N, int K,
+                         const double *A, int lda, const double *B, int ldb,
+                         double *C, int ldc);
+}
+
+namespace {
+
+enum { kDouble, kSingle, kMixed };
+
+const char *const kPrecisionMethods[] = {"auto", "cpp_accelerate", "block_huge", "rust_blocked",
+                                         "metal_gpu"};
+enum { kAuto, kBlas, kBlockHuge, kRust, kMetal, kPrecisionMethodCount };
+
+// С этого размера "auto" считает на GPU, если Metal доступен (как fastMatMul)
+const int kMetalMinDim = 1000;
+// Элементов на задачу пула при преобразовании точности
+const size_t kConvertChunk = (size_t) 1 << 18;
+
+int match_string(SEXP value_r, const char *const *choices, int count, const char *what) {
+  if (!Rf_isString(value_r) || Rf_length(value_r) != 1) {
+    Rf_error("%s должен быть строкой", what);
+  }
+  const char *value = CHAR(STRING_ELT(value_r, 0));
+  for (int i = 0; i < count; i++) {
+    if (std::strcmp(value, choices[i]) == 0) return i;
+  }
+  Rf_error("Неизвестное значение %s: %s", what, value);
+  return -1;
+}
+
+struct ConvertJob {
+  const double *dsrc;
+  float *fdst;
+  const float *fsrc;
+  double *ddst;
+  size_t n;
+  int format;
+};
+
+void convert_task(int task, int worker, void *ctx) {
+  (void) worker;
+  const ConvertJob *job = (const ConvertJob *) ctx;
+  size_t lo = (size_t) task * kConvertChunk;
+  size_t hi = std::min(job->n, lo + kConvertChunk);
+  if (job->dsrc) {
+    for (size_t i = lo; i < hi; i++) job->fdst[i] = mp_round_input(job->dsrc[i], job->format);
+  } else {
+    for (size_t i = lo; i < hi; i++) job->ddst[i] = job->fsrc[i];
+  }
+}
+
+void run_convert(ConvertJob &job) {
+  int tasks = (int) ((job.n + kConvertChunk - 1) / kConvertChunk);
+  if (tasks <= 1) {
+    if (job.n > 0) convert_task(0, 0, &job);
+  } else {
+    mp_pool_run(tasks, convert_task, &job);
+  }
+}
+
+#ifndef MATRIXPROD_HAVE_RUST
+// Ядро float для сборки без Rust, когда в BLAS нет sgemm. Задача пула -
+// блок столбцов C; внутри блоки строк и глубины держат панель A в кэше, а
+// внутренний цикл по строкам (axpy по столбцу) векторизуется компилятором
+const int kSgemmBlockM = 512;
+const int kSgemmBlockN = 32;
+const int kSgemmBlockK = 256;
+
+struct SgemmJob {
+  int m, n, k;
+  const float *A;
+  int lda;
+  const float *B;
+  int ldb;
+  float *C;
+  int ldc;
+};
+
+void sgemm_task(int task, int worker, void *ctx) {
+  (void) worker;
+  const SgemmJob *job = (const SgemmJob *) ctx;
+  int j0 = task * kSgemmBlockN;
+  int j1 = std::min(job->n, j0 + kSgemmBlockN);
+  for (int j = j0; j < j1; j++) {
+    std::fill(job->C + (size_t) j * job->ldc, job->C + (size_t) j * job->ldc + job->m, 0.0f);
+  }
+  for (int i0 = 0; i0 < job->m; i0 += kSgemmBlockM) {
+    int mb = std::min(job->m - i0, kSgemmBlockM);
+    for (int l0 = 0; l0 < job->k; l0 += kSgemmBlockK) {
+      int l1 = std::min(job->k, l0 + kSgemmBlockK);
+      for (int j = j0; j < j1; j++) {
+        float *c = job->C + (size_t) j * job->ldc + i0;
+        const float *b = job->B + (size_t) j * job->ldb;
+        for (int l = l0; l < l1; l++) {
+          // Нули B не пропускаются: Inf и NaN в A должны дать NaN, как в sgemm
+          const float *a = job->A + (size_t) l * job->lda + i0;
+          float bl = b[l];
+          for (int i = 0; i < mb; i++) c[i] += a[i] * bl;
+        }
+      }
+    }
+  }
+}
+
+void blocked_sgemm(int m, int n, int k, const float *A, int lda, const float *B, int ldb,
+                   float *C, int ldc) {
+  SgemmJob job = {m, n, k, A, lda, B, ldb, C, ldc};
+  int tasks = (n + kSgemmBlockN - 1) / kSgemmBlockN;
+  if (tasks <= 1 || (size_t) m * n * k < ((size_t) 1 << 18)) {
+    for (int task = 0; task < tasks; task++) sgemm_task(task, 0, &job);
+  } else {
+    mp_pool_run(tasks, sgemm_task, &job);
+  }
+}
+#endif
+
+// C = A * B в float после округления входов до format; NULL или текст
+// ошибки (Rf_error вызывается после освобождения буферов)
+const char *cpu_single(int method, int format, int m, int n, int k,
+                       const double *A, const double *B, double *C) {
+  std::vector<float> af, bf, cf;
+  try {
+    af.resize((size_t) m * k);
+    bf.resize((size_t) k * n);
+    cf.resize((size_t) m * n);
+  } catch (const std::bad_alloc &) {
+    return "Не удалось выделить буферы одинарной точности";
+  }
+  mp_stats_mark(MP_PHASE_ALLOC);
+  ConvertJob to_a = {A, af.data(), NULL, NULL, af.size(), format};
+  ConvertJob to_b = {B, bf.data(), NULL, NULL, bf.size(), format};
+  run_convert(to_a);
+  run_convert(to_b);
+  mp_stats_mark(MP_PHASE_CONVERT);
+
+  int lda = m > 0 ? m : 1, ldb = k > 0 ? k : 1;
+  bool done = false;
+  if (method != kRust) {
+    done = mp_blas_sgemm(m, n, k, af.data(), lda, bf.data(), ldb, cf.data(), m) != 0;
+    if (!done && method == kBlas) return "Библиотека BLAS не содержит sgemm";
+  }
+#ifdef MATRIXPROD_HAVE_RUST
+  if (!done) rust_mm_sgemm(m, n, k, af.data(), lda, bf.data(), ldb, cf.data(), m);
+#else
+  if (!done) blocked_sgemm(m, n, k, af.data(), lda, bf.data(), ldb, cf.data(), m);
+#endif
+  mp_stats_mark(MP_PHASE_KERNEL);
+
+  ConvertJob back = {NULL, NULL, cf.data(), C, cf.size(), format};
+  run_convert(back);
+  mp_stats_mark(MP_PHASE_COPYBACK);
+  return NULL;
+}
+
+}  // namespace
+
+// precision_r: "double", "single" или "mixed"; format_r: "half" или
+// "bfloat16" (формат входов режима "mixed")
+extern "C" SEXP precision_matmul(SEXP A_r, SEXP B_r, SEXP precision_r, SEXP format_r,
+                                 SEXP method_r) {
+  unsigned call = mp_stats_begin(MP_STATS_PRECISION);
+  if (!Rf_isReal(A_r) || !Rf_isReal(B_r) || !Rf_isMatrix(A_r) || !Rf_isMatrix(B_r)) {
+    Rf_error("A и B должны быть матрицами типа double");
+  }
+  const char *const precisions[] = {"double", "single", "mixed"};
+  const char *const formats[] = {"half", "bfloat16"};
+  int precision = match_string(precision_r, precisions, 3, "precision");
+  int format = match_string(format_r, formats, 2, "mixed_format") == 0 ? MP_INPUT_HALF
+                                                                       : MP_INPUT_BFLOAT16;
+  int method = match_string(method_r, kPrecisionMethods, kPrecisionMethodCount, "method");
+  if (precision != kDouble && method == kBlockHuge) {
+    Rf_error("Метод block_huge поддерживает только precision = \"double\"");
+  }
+  if (precision == kDouble && method == kMetal) {
+    Rf_error("Metal не поддерживает двойную точность");
+  }
+
+  SEXP dim_A = Rf_getAttrib(A_r, R_DimSymbol);
+  SEXP dim_B = Rf_getAttrib(B_r, R_DimSymbol);
+  int m = INTEGER(dim_A)[0];
+  int k = INTEGER(dim_A)[1];
+  int n = INTEGER(dim_B)[1];
+  if (INTEGER(dim_B)[0] != k) {
+    Rf_error("Несовместимые размеры матриц");
+  }
+  mp_stats_mark(MP_PHASE_SETUP);
+
+  SEXP C_r = PROTECT(Rf_allocMatrix(REALSXP, m, n));
+  mp_stats_mark(MP_PHASE_ALLOC);
+  if (m == 0 || n == 0) {
+    UNPROTECT(1);
+    return C_r;
+  }
+  const double *A = REAL(A_r);
+  const double *B = REAL(B_r);
+  double *C = REAL(C_r);
+  int lda = m, ldb = k > 0 ? k : 1;
+
+  if (precision == kDouble) {
+    if (method == kBlockHuge) {
+      mp_gebp_dgemm(m, n, k, 1.0, A, lda, B, ldb, 0.0, C, m);
+    } else if (method == kRust) {
+      rust_mm_gemm(0, 0, m, n, k, 1.0, A, lda, B, ldb, 0.0, C, m);
+    } else {
+      mp_blas_dgemm(0, 0, m, n, k, 1.0, A, lda, B, ldb, 0.0, C, m);
+    }
+    mp_stats_mark(MP_PHASE_KERNEL);
+    mp_stats_end_product(call, m, n, k, sizeof(double));
+    UNPROTECT(1);
+    return C_r;
+  }
+
+  // GPU: явно заказанный или "auto" для больших матриц при наличии Metal
+  bool want_gpu = method == kMetal ||
+                  (method == kAuto && std::max(m, std::max(n, k)) >= kMetalMinDim);
+  if (want_gpu) {
+    int done = precision == kSingle
+                   ? mp_metal_dgemm(0, 0, m, n, k, 1.0, A, lda, B, ldb, 0.0, C, m)
+                   : mp_metal_mixed_dgemm(format, m, n, k, A, lda, B, ldb, C, m);
+    if (done) {
+      mp_stats_end_product(call, m, n, k, precision == kSingle ? sizeof(float) : sizeof(uint16_t));
+      UNPROTECT(1);
+      return C_r;
+    }
+    if (method == kMetal) {
+      UNPROTECT(1);
+      Rf_error("Metal недоступен или не удалось выделить буферы");
+    }
+  }
+
+  const char *failure = cpu_single(method, precision == kSingle ? MP_INPUT_FLOAT : format,
+                                   m, n, k, A, B, C);
+  UNPROTECT(1);
+  if (failure) Rf_error("%s", failure);
+  mp_stats_end_product(call, m, n, k, precision == kSingle ? sizeof(float) : sizeof(uint16_t));
+  return C_r;
+}
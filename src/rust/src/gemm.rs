@@ -0,0 +1,337 @@
+// Упакованное блочное умножение матриц (схема GEBP) для матриц R
+// в формате column-major: панели A и B копируются в непрерывные буферы,
+// внутренний цикл выполняет регистровое микроядро MR x NR с SIMD.
+
+use std::cell::RefCell;
+
+// Размер микроядра: 8 строк A на 6 столбцов B (12 регистров AVX2 / 24 NEON)
+pub const MR: usize = 8;
+pub const NR: usize = 6;
+
+// Глубина панели по k (MR x KC и KC x NR помещаются в L1)
+pub const KC: usize = 256;
+// Высота блока A (MC x KC помещается в L2)
+pub const MC: usize = 120;
+
+// Буферы упаковки переиспользуются в каждом потоке rayon между вызовами
+thread_local! {
+    static PACK_BUFFERS: RefCell<(Vec<f64>, Vec<f64>)> = RefCell::new((Vec::new(), Vec::new()));
+}
+
+type KernelFn = unsafe fn(usize, *const f64, *const f64, *mut f64, usize, bool);
+
+// Смещение элемента op(X)[r, c] для X с шагом ld; при транспонировании
+// op(X)[r, c] = X[c + r * ld]
+pub fn op_offset(trans: bool, r: usize, c: usize, ld: usize) -> usize {
+    if trans {
+        c + r * ld
+    } else {
+        r + c * ld
+    }
+}
+
+// alpha * op(A)[0:mc, 0:kc] -> панели по MR строк; недостающие строки
+// заполняются нулями
+fn pack_a(mc: usize, kc: usize, a: &[f64], lda: usize, trans: bool, alpha: f64, ap: &mut [f64]) {
+    let mut dst = 0;
+    for ir in (0..mc).step_by(MR) {
+        let mr = MR.min(mc - ir);
+        if trans {
+            // Строка op(A) - столбец A: читаем подряд, пишем с шагом MR
+            for i in 0..MR {
+                for p in 0..kc {
+                    ap[dst + p * MR + i] = if i < mr { alpha * a[p + (ir + i) * lda] } else { 0.0 };
+                }
+            }
+            dst += kc * MR;
+            continue;
+        }
+        for p in 0..kc {
+            let col = &a[ir + p * lda..ir + p * lda + mr];
+            if alpha == 1.0 {
+                ap[dst..dst + mr].copy_from_slice(col);
+            } else {
+                for (x, y) in ap[dst..dst + mr].iter_mut().zip(col) {
+                    *x = alpha * *y;
+                }
+            }
+            for v in &mut ap[dst + mr..dst + MR] {
+                *v = 0.0;
+            }
+            dst += MR;
+        }
+    }
+}
+
+// op(B)[0:kc, 0:nc] -> панели по NR столбцов; недостающие столбцы заполняются нулями
+fn pack_b(kc: usize, nc: usize, b: &[f64], ldb: usize, trans: bool, bp: &mut [f64]) {
+    let mut dst = 0;
+    for jr in (0..nc).step_by(NR) {
+        let nr = NR.min(nc - jr);
+        for p in 0..kc {
+            for j in 0..NR {
+                bp[dst + j] = if j < nr { b[op_offset(trans, p, jr + j, ldb)] } else { 0.0 };
+            }
+            dst += NR;
+        }
+    }
+}
+
+// C[0:m, 0:n] *= beta (при beta == 0 C не читается)
+pub fn scale_c(m: usize, n: usize, beta: f64, c: &mut [f64], ldc: usize) {
+    if beta == 1.0 {
+        return;
+    }
+    for j in 0..n {
+        for v in &mut c[j * ldc..j * ldc + m] {
+            *v = if beta == 0.0 { 0.0 } else { beta * *v };
+        }
+    }
+}
+
+// Переносимое ядро: C[0:MR, 0:NR] (+)= Ap * Bp; LLVM векторизует его сам
+unsafe fn kernel_generic(kc: usize, a: *const f64, b: *const f64, c: *mut f64, ldc: usize, acc_c: bool) {
+    let mut acc = [[0.0f64; MR]; NR];
+    for p in 0..kc {
+        let ap = std::slice::from_raw_parts(a.add(p * MR), MR);
+        let bp = std::slice::from_raw_parts(b.add(p * NR), NR);
+        for j in 0..NR {
+            for i in 0..MR {
+                acc[j][i] += ap[i] * bp[j];
+            }
+        }
+    }
+    for j in 0..NR {
+        let col = c.add(j * ldc);
+        for i in 0..MR {
+            let v = if acc_c { *col.add(i) + acc[j][i] } else { acc[j][i] };
+            *col.add(i) = v;
+        }
+    }
+}
+
+#[cfg(target_arch = "x86_64")]
+#[target_feature(enable = "avx2,fma")]
+unsafe fn kernel_avx2(kc: usize, a: *const f64, b: *const f64, c: *mut f64, ldc: usize, acc_c: bool) {
+    use std::arch::x86_64::*;
+    let mut acc = [[_mm256_setzero_pd(); 2]; NR];
+    let mut a = a;
+    let mut b = b;
+    for _ in 0..kc {
+        let a0 = _mm256_loadu_pd(a);
+        let a1 = _mm256_loadu_pd(a.add(4));
+        for j in 0..NR {
+            let bj = _mm256_broadcast_sd(&*b.add(j));
+            acc[j][0] = _mm256_fmadd_pd(a0, bj, acc[j][0]);
+            acc[j][1] = _mm256_fmadd_pd(a1, bj, acc[j][1]);
+        }
+        a = a.add(MR);
+        b = b.add(NR);
+    }
+    for j in 0..NR {
+        let col = c.add(j * ldc);
+        if acc_c {
+            _mm256_storeu_pd(col, _mm256_add_pd(_mm256_loadu_pd(col), acc[j][0]));
+            _mm256_storeu_pd(col.add(4), _mm256_add_pd(_mm256_loadu_pd(col.add(4)), acc[j][1]));
+        } else {
+            _mm256_storeu_pd(col, acc[j][0]);
+            _mm256_storeu_pd(col.add(4), acc[j][1]);
+        }
+    }
+}
+
+#[cfg(target_arch = "aarch64")]
+unsafe fn kernel_neon(kc: usize, a: *const f64, b: *const f64, c: *mut f64, ldc: usize, acc_c: bool) {
+    use std::arch::aarch64::*;
+    let mut acc = [[vdupq_n_f64(0.0); 4]; NR];
+    let mut a = a;
+    let mut b = b;
+    for _ in 0..kc {
+        let av = [vld1q_f64(a), vld1q_f64(a.add(2)), vld1q_f64(a.add(4)), vld1q_f64(a.add(6))];
+        let b01 = vld1q_f64(b);
+        let b23 = vld1q_f64(b.add(2));
+        let b45 = vld1q_f64(b.add(4));
+        for i in 0..4 {
+            acc[0][i] = vfmaq_laneq_f64::<0>(acc[0][i], av[i], b01);
+            acc[1][i] = vfmaq_laneq_f64::<1>(acc[1][i], av[i], b01);
+            acc[2][i] = vfmaq_laneq_f64::<0>(acc[2][i], av[i], b23);
+            acc[3][i] = vfmaq_laneq_f64::<1>(acc[3][i], av[i], b23);
+            acc[4][i] = vfmaq_laneq_f64::<0>(acc[4][i], av[i], b45);
+            acc[5][i] = vfmaq_laneq_f64::<1>(acc[5][i], av[i], b45);
+        }
+        a = a.add(MR);
+        b = b.add(NR);
+    }
+    for j in 0..NR {
+        let col = c.add(j * ldc);
+        for i in 0..4 {
+            let r = if acc_c { vaddq_f64(vld1q_f64(col.add(2 * i)), acc[j][i]) } else { acc[j][i] };
+            vst1q_f64(col.add(2 * i), r);
+        }
+    }
+}
+
+// Выбор микроядра по возможностям процессора (проверка кэшируется std)
+fn select_kernel() -> KernelFn {
+    #[cfg(target_arch = "x86_64")]
+    {
+        if is_x86_feature_detected!("avx2") && is_x86_feature_detected!("fma") {
+            return kernel_avx2;
+        }
+    }
+    #[cfg(target_arch = "aarch64")]
+    {
+        return kernel_neon;
+    }
+    #[allow(unreachable_code)]
+    kernel_generic
+}
+
+// Блок C[0:mc, 0:nc] (+)= Ap * Bp; краевые плитки считаются во временный
+// буфер и затем переносятся в C
+fn macro_kernel(kernel: KernelFn, mc: usize, nc: usize, kc: usize, ap: &[f64], bp: &[f64],
+                c: &mut [f64], ldc: usize, acc_c: bool) {
+    let mut edge = [0.0f64; MR * NR];
+    for jr in (0..nc).step_by(NR) {
+        let nr = NR.min(nc - jr);
+        let bpp = bp[jr * kc..].as_ptr();
+        for ir in (0..mc).step_by(MR) {
+            let mr = MR.min(mc - ir);
+            let app = ap[ir * kc..].as_ptr();
+            let offset = ir + jr * ldc;
+            if mr == MR && nr == NR {
+                // Полная плитка целиком лежит внутри c (проверено границами mc/nc)
+                unsafe { kernel(kc, app, bpp, c[offset..].as_mut_ptr(), ldc, acc_c) };
+            } else {
+                unsafe { kernel(kc, app, bpp, edge.as_mut_ptr(), MR, false) };
+                for j in 0..nr {
+                    let col = &mut c[offset + j * ldc..offset + j * ldc + mr];
+                    let e = &edge[j * MR..j * MR + mr];
+                    if acc_c {
+                        for (x, y) in col.iter_mut().zip(e) {
+                            *x += *y;
+                        }
+                    } else {
+                        col.copy_from_slice(e);
+                    }
+                }
+            }
+        }
+    }
+}
+
+// C[0:m, 0:n] = A[0:m, 0:k] * B[0:k, 0:n] в одном потоке.
+// Срезы начинаются с первого элемента блока; шаги lda/ldb/ldc - расстояние
+// между столбцами. C перезаписывается (не читается), если k > 0.
+pub fn gemm_serial(m: usize, n: usize, k: usize, a: &[f64], lda: usize, b: &[f64], ldb: usize,
+                   c: &mut [f64], ldc: usize) {
+    gemm_ex(false, false, m, n, k, 1.0, a, lda, b, ldb, 0.0, c, ldc);
+}
+
+// C = alpha * op(A) * op(B) + beta * C в одном потоке; op(X) = X^T при
+// trans_x (тогда A хранится как k x m, B - как n x k). alpha применяется
+// при упаковке A, beta - до накопления; при beta == 0 C не читается.
+pub fn gemm_ex(trans_a: bool, trans_b: bool, m: usize, n: usize, k: usize, alpha: f64,
+               a: &[f64], lda: usize, b: &[f64], ldb: usize, beta: f64,
+               c: &mut [f64], ldc: usize) {
+    if m == 0 || n == 0 {
+        return;
+    }
+    if k == 0 || alpha == 0.0 {
+        scale_c(m, n, beta, c, ldc);
+        return;
+    }
+    if beta != 0.0 {
+        scale_c(m, n, beta, c, ldc);
+    }
+
+    let kernel = select_kernel();
+    let mc_max = MC.min((m + MR - 1) / MR * MR);
+    let kc_max = KC.min(k);
+    let nc_pad = (n + NR - 1) / NR * NR;
+
+    PACK_BUFFERS.with(|cell| {
+        let mut bufs = cell.borrow_mut();
+        let (ap, bp) = &mut *bufs;
+        if ap.len() < mc_max * kc_max {
+            ap.resize(mc_max * kc_max, 0.0);
+        }
+        if bp.len() < kc_max * nc_pad {
+            bp.resize(kc_max * nc_pad, 0.0);
+        }
+
+        for pc in (0..k).step_by(KC) {
+            let kc = KC.min(k - pc);
+            pack_b(kc, n, &b[op_offset(trans_b, pc, 0, ldb)..], ldb, trans_b, bp);
+            for ic in (0..m).step_by(MC) {
+                let mc = MC.min(m - ic);
+                pack_a(mc, kc, &a[op_offset(trans_a, ic, pc, lda)..], lda, trans_a, alpha, ap);
+                // Первая панель по k записывает результат (если beta == 0),
+                // остальные накапливают
+                macro_kernel(kernel, mc, n, kc, ap, bp, &mut c[ic..], ldc, pc > 0 || beta != 0.0);
+            }
+        }
+    });
+}
+
+// C[0:m, 0:n] = A * B для малых матриц без упаковки и без выделения памяти:
+// столбцы C считаются группами по 4 как линейные комбинации столбцов A,
+// так что каждый загруженный столбец A используется четыре раза, а все
+// обращения к памяти идут с единичным шагом. Строки обрабатываются
+// полосами по SMALL_ROWS: полоса четырех столбцов C остается в L1, пока к
+// ней прибавляются столбцы A (иначе высокий C читался бы k раз из памяти).
+pub fn gemm_small(m: usize, n: usize, k: usize, a: &[f64], lda: usize, b: &[f64], ldb: usize,
+                  c: &mut [f64], ldc: usize) {
+    for i0 in (0..m).step_by(SMALL_ROWS) {
+        let rows = SMALL_ROWS.min(m - i0);
+        gemm_small_rows(rows, n, k, &a[i0..], lda, b, ldb, &mut c[i0..], ldc);
+    }
+}
+
+// Высота полосы строк gemm_small: 4 столбца C по 512 строк - 16 КБ
+pub const SMALL_ROWS: usize = 512;
+
+fn gemm_small_rows(m: usize, n: usize, k: usize, a: &[f64], lda: usize, b: &[f64], ldb: usize,
+                   c: &mut [f64], ldc: usize) {
+    let mut j = 0;
+    while j + 4 <= n {
+        let (c0, rest) = c[j * ldc..].split_at_mut(ldc);
+        let (c1, rest) = rest.split_at_mut(ldc);
+        let (c2, c3) = rest.split_at_mut(ldc);
+        let (c0, c1, c2, c3) = (&mut c0[..m], &mut c1[..m], &mut c2[..m], &mut c3[..m]);
+        for i in 0..m {
+            c0[i] = 0.0;
+            c1[i] = 0.0;
+            c2[i] = 0.0;
+            c3[i] = 0.0;
+        }
+        for l in 0..k {
+            let a_col = &a[l * lda..l * lda + m];
+            let b0 = b[l + j * ldb];
+            let b1 = b[l + (j + 1) * ldb];
+            let b2 = b[l + (j + 2) * ldb];
+            let b3 = b[l + (j + 3) * ldb];
+            for i in 0..m {
+                let av = a_col[i];
+                c0[i] += av * b0;
+                c1[i] += av * b1;
+                c2[i] += av * b2;
+                c3[i] += av * b3;
+            }
+        }
+        j += 4;
+    }
+    for j in j..n {
+        let c_col = &mut c[j * ldc..j * ldc + m];
+        for v in c_col.iter_mut() {
+            *v = 0.0;
+        }
+        for l in 0..k {
+            let a_col = &a[l * lda..l * lda + m];
+            let bv = b[l + j * ldb];
+            for i in 0..m {
+                c_col[i] += a_col[i] * bv;
+            }
+        }
+    }
+}
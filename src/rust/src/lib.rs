@@ -1,10 +1,133 @@
-use libc::{c_double, c_int};
-use ndarray::{Array2, ArrayView2};
+use libc::{c_double, c_float, c_int};
 use rayon::prelude::*;
+use rayon::{ThreadPool, ThreadPoolBuilder};
 use std::slice;
+use std::sync::atomic::{AtomicI32, AtomicUsize, Ordering};
+use std::sync::{Arc, RwLock, RwLockReadGuard, RwLockWriteGuard};
 
-// Оптимизированная реализация умножения матриц на Rust
-// с использованием параллелизма и SIMD-оптимизаций
+mod gemm;
+mod sgemm;
+
+// Минимальный объем работы (m * n * k), при котором малое умножение
+// распараллеливается: ниже него накладные расходы rayon больше выигрыша
+const PARALLEL_MIN_WORK: usize = 1 << 20;
+
+// Порог rust_mm_auto: если все размеры не больше него, используется малое
+// умножение. По умолчанию 512; tune_matmul() подбирает его для машины
+static AUTO_THRESHOLD: AtomicI32 = AtomicI32::new(512);
+
+// Пул потоков rayon пакета. Глобальный пул rayon не используется: его
+// размер нельзя изменить после создания, а после fork он недоступен.
+// Пул создается set_matmul_threads() при загрузке пакета и переиспользуется
+// всеми вызовами; пересоздается только при смене числа потоков
+static POOL: RwLock<Option<PoolEntry>> = RwLock::new(None);
+
+// Номер поколения процесса: rust_mm_after_fork увеличивает его в дочернем
+// процессе без блокировок, и пул прежнего поколения считается недействительным
+static FORK_GENERATION: AtomicUsize = AtomicUsize::new(0);
+
+struct PoolEntry {
+    generation: usize,
+    pool: Arc<ThreadPool>,
+}
+
+impl PoolEntry {
+    // Пул, если он создан в текущем процессе
+    fn current(&self, generation: usize) -> Option<Arc<ThreadPool>> {
+        if self.generation == generation {
+            Some(self.pool.clone())
+        } else {
+            None
+        }
+    }
+}
+
+// Число потоков для пула, который создается при первом вызове (после fork
+// или если set_matmul_threads() не вызывалась); 0 - по числу ядер
+static POOL_THREADS: AtomicUsize = AtomicUsize::new(0);
+
+fn build_pool(threads: usize) -> Option<Arc<ThreadPool>> {
+    ThreadPoolBuilder::new()
+        .num_threads(threads)
+        .thread_name(|i| format!("matrixprod-rayon-{}", i))
+        .build()
+        .ok()
+        .map(Arc::new)
+}
+
+// После fork блокировка могла остаться захваченной потоком родителя,
+// которого в дочернем процессе нет, поэтому там она берется без ожидания;
+// None - блокировка недоступна (умножение тогда выполняется без пула)
+fn read_pool() -> Option<RwLockReadGuard<'static, Option<PoolEntry>>> {
+    if FORK_GENERATION.load(Ordering::Acquire) == 0 {
+        POOL.read().ok()
+    } else {
+        POOL.try_read().ok()
+    }
+}
+
+fn write_pool() -> Option<RwLockWriteGuard<'static, Option<PoolEntry>>> {
+    if FORK_GENERATION.load(Ordering::Acquire) == 0 {
+        POOL.write().ok()
+    } else {
+        POOL.try_write().ok()
+    }
+}
+
+// Записывает новый пул; пул прежнего поколения забывается без уничтожения:
+// его потоков нет, и деструктор ждал бы их на блокировках
+fn replace_pool(slot: &mut Option<PoolEntry>, generation: usize, pool: Arc<ThreadPool>) {
+    if let Some(old) = slot.replace(PoolEntry { generation, pool }) {
+        if old.generation != generation {
+            std::mem::forget(old);
+        }
+    }
+}
+
+fn pool() -> Option<Arc<ThreadPool>> {
+    let generation = FORK_GENERATION.load(Ordering::Acquire);
+    if let Some(pool) = read_pool()?.as_ref().and_then(|entry| entry.current(generation)) {
+        return Some(pool);
+    }
+    let mut slot = write_pool()?;
+    if let Some(pool) = slot.as_ref().and_then(|entry| entry.current(generation)) {
+        return Some(pool);
+    }
+    let pool = build_pool(POOL_THREADS.load(Ordering::Relaxed))?;
+    replace_pool(&mut slot, generation, pool.clone());
+    Some(pool)
+}
+
+// Выполняет параллельную часть умножения в пуле пакета
+fn with_pool<R: Send, F: FnOnce() -> R + Send>(f: F) -> R {
+    match pool() {
+        Some(pool) => pool.install(f),
+        None => f(),
+    }
+}
+
+// Число элементов, которые занимает блок rows x cols со столбцами через ld
+fn span(rows: usize, cols: usize, ld: usize) -> usize {
+    if rows == 0 || cols == 0 {
+        0
+    } else {
+        ld * (cols - 1) + rows
+    }
+}
+
+// Пустая сумма (k = 0): C = 0
+fn zero_columns(m: usize, n: usize, c: &mut [f64], ldc: usize) {
+    for j in 0..n {
+        for v in &mut c[j * ldc..j * ldc + m] {
+            *v = 0.0;
+        }
+    }
+}
+
+// Оптимизированная реализация умножения матриц на Rust для малых матриц.
+// Результат считается прямо в буфере R (column-major) без временных
+// матриц и выделения памяти; параллелизм по блокам столбцов включается
+// только для достаточно больших произведений.
 #[no_mangle]
 pub extern "C" fn rust_mm_optimized(
     a_ptr: *const c_double,
@@ -13,49 +136,89 @@ pub extern "C" fn rust_mm_optimized(
     m: c_int,
     k: c_int,
     n: c_int,
+) {
+    rust_mm_optimized_ld(a_ptr, m, b_ptr, k, c_ptr, m, m, k, n);
+}
+
+// То же для подматриц: lda/ldb/ldc - расстояние между столбцами A, B и C,
+// так что блок внутри большей матрицы передается без копирования
+#[no_mangle]
+pub extern "C" fn rust_mm_optimized_ld(
+    a_ptr: *const c_double,
+    lda: c_int,
+    b_ptr: *const c_double,
+    ldb: c_int,
+    c_ptr: *mut c_double,
+    ldc: c_int,
+    m: c_int,
+    k: c_int,
+    n: c_int,
 ) {
     // Преобразуем указатели в срезы Rust
     let m = m as usize;
     let k = k as usize;
     let n = n as usize;
+    let (lda, ldb, ldc) = (lda as usize, ldb as usize, ldc as usize);
+    if m == 0 || n == 0 {
+        return;
+    }
 
     // Безопасно преобразуем указатели в срезы Rust
-    let a_slice = unsafe { slice::from_raw_parts(a_ptr, m * k) };
-    let b_slice = unsafe { slice::from_raw_parts(b_ptr, k * n) };
-    let c_slice = unsafe { slice::from_raw_parts_mut(c_ptr, m * n) };
-
-    // Создаем представления ndarray для матриц
-    // R хранит матрицы в формате column-major, поэтому учитываем это
-    let a = ArrayView2::from_shape((k, m), a_slice).unwrap().t();
-    let b = ArrayView2::from_shape((n, k), b_slice).unwrap().t();
-
-    // Создаем результирующую матрицу
-    let mut c = Array2::zeros((m, n));
-
-    // Используем параллельную обработку для умножения матриц
-    c.axis_iter_mut(ndarray::Axis(0))
-        .into_par_iter()
-        .enumerate()
-        .for_each(|(i, mut row)| {
-            for j in 0..n {
-                let mut sum = 0.0;
-                for l in 0..k {
-                    sum += a[[i, l]] * b[[l, j]];
+    let a_slice = unsafe { slice::from_raw_parts(a_ptr, span(m, k, lda)) };
+    let b_slice = unsafe { slice::from_raw_parts(b_ptr, span(k, n, ldb)) };
+    let c_slice = unsafe { slice::from_raw_parts_mut(c_ptr, span(m, n, ldc)) };
+    if k == 0 {
+        zero_columns(m, n, c_slice, ldc);
+        return;
+    }
+
+    if m * n * k < PARALLEL_MIN_WORK || n < 8 && m < 2 * gemm::SMALL_ROWS {
+        gemm::gemm_small(m, n, k, a_slice, lda, b_slice, ldb, c_slice, ldc);
+        return;
+    }
+
+    with_pool(|| {
+        let threads = rayon::current_num_threads().max(1);
+        if n < 8 {
+            // Узкий B (в том числе GEMV): столбцов слишком мало для деления,
+            // поэтому потоки делят строки. Каждый поток читает свою полосу A
+            // один раз и пишет в локальный буфер, который затем копируется в C
+            let block_m = ((m + threads - 1) / threads).max(gemm::SMALL_ROWS);
+            let blocks: Vec<Vec<f64>> = (0..(m + block_m - 1) / block_m)
+                .into_par_iter()
+                .map(|ib| {
+                    let i0 = ib * block_m;
+                    let mb = block_m.min(m - i0);
+                    let mut c_block = vec![0.0; mb * n];
+                    gemm::gemm_small(mb, n, k, &a_slice[i0..], lda, b_slice, ldb, &mut c_block, mb);
+                    c_block
+                })
+                .collect();
+            for (ib, c_block) in blocks.iter().enumerate() {
+                let i0 = ib * block_m;
+                let mb = c_block.len() / n;
+                for j in 0..n {
+                    c_slice[j * ldc + i0..j * ldc + i0 + mb].copy_from_slice(&c_block[j * mb..(j + 1) * mb]);
                 }
-                row[j] = sum;
             }
-        });
-
-    // Копируем результат обратно в C-массив
-    // с учетом column-major формата R
-    for i in 0..m {
-        for j in 0..n {
-            c_slice[i + j * m] = c[[i, j]];
+            return;
         }
-    }
+
+        // Блоки по столбцам кратны 4 - ширине группы столбцов в gemm_small
+        let block_n = (((n + threads - 1) / threads + 3) / 4 * 4).max(4);
+        c_slice
+            .par_chunks_mut(block_n * ldc)
+            .enumerate()
+            .for_each(|(jb, c_block)| {
+                let j0 = jb * block_n;
+                let nb = block_n.min(n - j0);
+                gemm::gemm_small(m, nb, k, a_slice, lda, &b_slice[j0 * ldb..], ldb, c_block, ldc);
+            });
+    });
 }
 
-// Блочная реализация умножения матриц для больших матриц
+// Блочная реализация умножения матриц для больших матриц:
+// упакованные панели, SIMD-микроядро и параллелизм по блокам столбцов C
 #[no_mangle]
 pub extern "C" fn rust_mm_blocked(
     a_ptr: *const c_double,
@@ -64,59 +227,159 @@ pub extern "C" fn rust_mm_blocked(
     m: c_int,
     k: c_int,
     n: c_int,
+) {
+    rust_mm_blocked_ld(a_ptr, m, b_ptr, k, c_ptr, m, m, k, n);
+}
+
+#[no_mangle]
+pub extern "C" fn rust_mm_blocked_ld(
+    a_ptr: *const c_double,
+    lda: c_int,
+    b_ptr: *const c_double,
+    ldb: c_int,
+    c_ptr: *mut c_double,
+    ldc: c_int,
+    m: c_int,
+    k: c_int,
+    n: c_int,
 ) {
     // Преобразуем указатели в срезы Rust
     let m = m as usize;
     let k = k as usize;
     let n = n as usize;
+    let (lda, ldb, ldc) = (lda as usize, ldb as usize, ldc as usize);
+    if m == 0 || n == 0 {
+        return;
+    }
 
     // Безопасно преобразуем указатели в срезы Rust
-    let a_slice = unsafe { slice::from_raw_parts(a_ptr, m * k) };
-    let b_slice = unsafe { slice::from_raw_parts(b_ptr, k * n) };
-    let c_slice = unsafe { slice::from_raw_parts_mut(c_ptr, m * n) };
-
-    // Создаем представления ndarray для матриц
-    // R хранит матрицы в формате column-major, поэтому учитываем это
-    let a = ArrayView2::from_shape((k, m), a_slice).unwrap().t();
-    let b = ArrayView2::from_shape((n, k), b_slice).unwrap().t();
-
-    // Создаем результирующую матрицу
-    let mut c = Array2::zeros((m, n));
-
-    // Определяем размер блока
-    const BLOCK_SIZE: usize = 64;
-
-    // Блочное умножение матриц
-    for i_block in (0..m).step_by(BLOCK_SIZE) {
-        let i_end = std::cmp::min(i_block + BLOCK_SIZE, m);
-        
-        for j_block in (0..n).step_by(BLOCK_SIZE) {
-            let j_end = std::cmp::min(j_block + BLOCK_SIZE, n);
-            
-            for k_block in (0..k).step_by(BLOCK_SIZE) {
-                let k_end = std::cmp::min(k_block + BLOCK_SIZE, k);
-                
-                // Умножение блоков матриц
-                for i in i_block..i_end {
-                    for j in j_block..j_end {
-                        let mut sum = 0.0;
-                        for l in k_block..k_end {
-                            sum += a[[i, l]] * b[[l, j]];
-                        }
-                        c[[i, j]] += sum;
-                    }
-                }
-            }
-        }
+    let a_slice = unsafe { slice::from_raw_parts(a_ptr, span(m, k, lda)) };
+    let b_slice = unsafe { slice::from_raw_parts(b_ptr, span(k, n, ldb)) };
+    let c_slice = unsafe { slice::from_raw_parts_mut(c_ptr, span(m, n, ldc)) };
+    if k == 0 {
+        zero_columns(m, n, c_slice, ldc);
+        return;
     }
 
-    // Копируем результат обратно в C-массив
-    // с учетом column-major формата R
-    for i in 0..m {
-        for j in 0..n {
-            c_slice[i + j * m] = c[[i, j]];
-        }
+    // В column-major формате блок столбцов C - непрерывный участок памяти
+    // (с шагом ldc), поэтому каждый поток пишет прямо в буфер R
+    with_pool(|| {
+        let threads = rayon::current_num_threads().max(1);
+        let tasks = (threads * 4).min((n + gemm::NR - 1) / gemm::NR).max(1);
+        let block_n = ((n + tasks - 1) / tasks + gemm::NR - 1) / gemm::NR * gemm::NR;
+
+        c_slice
+            .par_chunks_mut(block_n * ldc)
+            .enumerate()
+            .for_each(|(jb, c_block)| {
+                let j0 = jb * block_n;
+                let nb = block_n.min(n - j0);
+                gemm::gemm_serial(m, nb, k, a_slice, lda, &b_slice[j0 * ldb..], ldb, c_block, ldc);
+            });
+    });
+}
+
+// Полный GEMM: C = alpha * op(A) * op(B) + beta * C, op(X) = X^T при
+// ненулевом trans_x. Транспонирование выполняется при упаковке панелей,
+// поэтому ни транспонированные копии, ни временная матрица не создаются;
+// C может быть существующей матрицей R, которая обновляется на месте.
+#[no_mangle]
+pub extern "C" fn rust_mm_gemm(
+    trans_a: c_int,
+    trans_b: c_int,
+    m: c_int,
+    n: c_int,
+    k: c_int,
+    alpha: c_double,
+    a_ptr: *const c_double,
+    lda: c_int,
+    b_ptr: *const c_double,
+    ldb: c_int,
+    beta: c_double,
+    c_ptr: *mut c_double,
+    ldc: c_int,
+) {
+    let (ta, tb) = (trans_a != 0, trans_b != 0);
+    let m = m as usize;
+    let k = k as usize;
+    let n = n as usize;
+    let (lda, ldb, ldc) = (lda as usize, ldb as usize, ldc as usize);
+    if m == 0 || n == 0 {
+        return;
+    }
+
+    // Хранимые размеры A и B зависят от транспонирования
+    let (a_rows, a_cols) = if ta { (k, m) } else { (m, k) };
+    let (b_rows, b_cols) = if tb { (n, k) } else { (k, n) };
+    let a_slice = unsafe { slice::from_raw_parts(a_ptr, span(a_rows, a_cols, lda)) };
+    let b_slice = unsafe { slice::from_raw_parts(b_ptr, span(b_rows, b_cols, ldb)) };
+    let c_slice = unsafe { slice::from_raw_parts_mut(c_ptr, span(m, n, ldc)) };
+    if k == 0 || alpha == 0.0 || m * n * k < PARALLEL_MIN_WORK {
+        gemm::gemm_ex(ta, tb, m, n, k, alpha, a_slice, lda, b_slice, ldb, beta, c_slice, ldc);
+        return;
+    }
+
+    with_pool(|| {
+        let threads = rayon::current_num_threads().max(1);
+        let tasks = (threads * 4).min((n + gemm::NR - 1) / gemm::NR).max(1);
+        let block_n = ((n + tasks - 1) / tasks + gemm::NR - 1) / gemm::NR * gemm::NR;
+
+        c_slice
+            .par_chunks_mut(block_n * ldc)
+            .enumerate()
+            .for_each(|(jb, c_block)| {
+                let j0 = jb * block_n;
+                let nb = block_n.min(n - j0);
+                let b_block = &b_slice[gemm::op_offset(tb, 0, j0, ldb)..];
+                gemm::gemm_ex(ta, tb, m, nb, k, alpha, a_slice, lda, b_block, ldb, beta, c_block, ldc);
+            });
+    });
+}
+
+// C = A * B в одинарной точности (режимы precision = "single"/"mixed"):
+// блочное ядро f32 с параллелизмом по блокам столбцов C
+#[no_mangle]
+pub extern "C" fn rust_mm_sgemm(
+    m: c_int,
+    n: c_int,
+    k: c_int,
+    a_ptr: *const c_float,
+    lda: c_int,
+    b_ptr: *const c_float,
+    ldb: c_int,
+    c_ptr: *mut c_float,
+    ldc: c_int,
+) {
+    let m = m as usize;
+    let k = k as usize;
+    let n = n as usize;
+    let (lda, ldb, ldc) = (lda as usize, ldb as usize, ldc as usize);
+    if m == 0 || n == 0 {
+        return;
     }
+
+    let a_slice = unsafe { slice::from_raw_parts(a_ptr, span(m, k, lda)) };
+    let b_slice = unsafe { slice::from_raw_parts(b_ptr, span(k, n, ldb)) };
+    let c_slice = unsafe { slice::from_raw_parts_mut(c_ptr, span(m, n, ldc)) };
+    if k == 0 || m * n * k < PARALLEL_MIN_WORK {
+        sgemm::sgemm_serial(m, n, k, a_slice, lda, b_slice, ldb, c_slice, ldc);
+        return;
+    }
+
+    with_pool(|| {
+        let threads = rayon::current_num_threads().max(1);
+        let tasks = (threads * 4).min((n + sgemm::NR - 1) / sgemm::NR).max(1);
+        let block_n = ((n + tasks - 1) / tasks + sgemm::NR - 1) / sgemm::NR * sgemm::NR;
+
+        c_slice
+            .par_chunks_mut(block_n * ldc)
+            .enumerate()
+            .for_each(|(jb, c_block)| {
+                let j0 = jb * block_n;
+                let nb = block_n.min(n - j0);
+                sgemm::sgemm_serial(m, nb, k, a_slice, lda, &b_slice[j0 * ldb..], ldb, c_block, ldc);
+            });
+    });
 }
 
 // Функция для определения оптимального алгоритма в зависимости от размера матриц
@@ -129,11 +392,77 @@ pub extern "C" fn rust_mm_auto(
     k: c_int,
     n: c_int,
 ) {
-    if m <= 512 && k <= 512 && n <= 512 {
+    rust_mm_auto_ld(a_ptr, m, b_ptr, k, c_ptr, m, m, k, n);
+}
+
+#[no_mangle]
+pub extern "C" fn rust_mm_auto_ld(
+    a_ptr: *const c_double,
+    lda: c_int,
+    b_ptr: *const c_double,
+    ldb: c_int,
+    c_ptr: *mut c_double,
+    ldc: c_int,
+    m: c_int,
+    k: c_int,
+    n: c_int,
+) {
+    let threshold = AUTO_THRESHOLD.load(Ordering::Relaxed);
+    if m <= threshold && k <= threshold && n <= threshold {
         // Для малых матриц используем оптимизированный алгоритм
-        rust_mm_optimized(a_ptr, b_ptr, c_ptr, m, k, n);
+        rust_mm_optimized_ld(a_ptr, lda, b_ptr, ldb, c_ptr, ldc, m, k, n);
     } else {
         // Для больших матриц используем блочный алгоритм
-        rust_mm_blocked(a_ptr, b_ptr, c_ptr, m, k, n);
+        rust_mm_blocked_ld(a_ptr, lda, b_ptr, ldb, c_ptr, ldc, m, k, n);
+    }
+}
+
+// Устанавливает порог rust_mm_auto (значения <= 0 не меняют его) и
+// возвращает предыдущее значение
+#[no_mangle]
+pub extern "C" fn rust_mm_set_auto_threshold(threshold: c_int) -> c_int {
+    if threshold <= 0 {
+        return AUTO_THRESHOLD.load(Ordering::Relaxed);
+    }
+    AUTO_THRESHOLD.swap(threshold, Ordering::Relaxed)
+}
+
+// Устанавливает число потоков пула rayon (<= 0 - по числу ядер) и сразу
+// создает пул; возвращает предыдущее число потоков. Тот же размер пул не
+// пересоздает
+#[no_mangle]
+pub extern "C" fn rust_mm_set_threads(threads: c_int) -> c_int {
+    let threads = if threads > 0 { threads as usize } else { 0 };
+    POOL_THREADS.store(threads, Ordering::Relaxed);
+    let generation = FORK_GENERATION.load(Ordering::Acquire);
+    let mut slot = match write_pool() {
+        Some(slot) => slot,
+        None => return 0,
+    };
+    let previous = slot
+        .as_ref()
+        .and_then(|entry| entry.current(generation))
+        .map_or(0, |pool| pool.current_num_threads());
+    if threads == 0 || threads != previous {
+        // Старый пул завершает потоки, когда его перестанут использовать
+        if let Some(pool) = build_pool(threads) {
+            replace_pool(&mut slot, generation, pool);
+        }
     }
+    previous as c_int
+}
+
+#[no_mangle]
+pub extern "C" fn rust_mm_get_threads() -> c_int {
+    pool().map_or(1, |pool| pool.current_num_threads()) as c_int
+}
+
+// Обработчик pthread_atfork в дочернем процессе. Потоков пула там нет, а
+// блокировку POOL мог держать поток родителя, поэтому пул не трогается:
+// новое поколение делает его недействительным, и новый пул из threads
+// потоков создается при первом умножении (старый забывается без уничтожения)
+#[no_mangle]
+pub extern "C" fn rust_mm_after_fork(threads: c_int) {
+    POOL_THREADS.store(if threads > 0 { threads as usize } else { 0 }, Ordering::Relaxed);
+    FORK_GENERATION.fetch_add(1, Ordering::AcqRel);
 }
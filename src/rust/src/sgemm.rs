@@ -0,0 +1,165 @@
+// Упакованное блочное умножение в одинарной точности (f32) по той же схеме
+// GEBP, что и gemm.rs. В регистре SIMD помещается вдвое больше f32, чем
+// f64, и панели вдвое меньше по объему, поэтому микроядро шире по строкам.
+
+use std::cell::RefCell;
+
+// Размер микроядра: 16 строк A на 6 столбцов B (12 регистров AVX2 / 24 NEON)
+pub const MR: usize = 16;
+pub const NR: usize = 6;
+
+// Глубина панели по k и высота блока A (в f32 те же байты, что и в gemm.rs)
+const KC: usize = 256;
+const MC: usize = 240;
+
+thread_local! {
+    static PACK_BUFFERS: RefCell<(Vec<f32>, Vec<f32>)> = RefCell::new((Vec::new(), Vec::new()));
+}
+
+type KernelFn = unsafe fn(usize, *const f32, *const f32, *mut f32, usize, bool);
+
+// A[0:mc, 0:kc] -> панели по MR строк; недостающие строки заполняются нулями
+fn pack_a(mc: usize, kc: usize, a: &[f32], lda: usize, ap: &mut [f32]) {
+    let mut dst = 0;
+    for ir in (0..mc).step_by(MR) {
+        let mr = MR.min(mc - ir);
+        for p in 0..kc {
+            ap[dst..dst + mr].copy_from_slice(&a[ir + p * lda..ir + p * lda + mr]);
+            for v in &mut ap[dst + mr..dst + MR] {
+                *v = 0.0;
+            }
+            dst += MR;
+        }
+    }
+}
+
+// B[0:kc, 0:nc] -> панели по NR столбцов; недостающие столбцы заполняются нулями
+fn pack_b(kc: usize, nc: usize, b: &[f32], ldb: usize, bp: &mut [f32]) {
+    let mut dst = 0;
+    for jr in (0..nc).step_by(NR) {
+        let nr = NR.min(nc - jr);
+        for p in 0..kc {
+            for j in 0..NR {
+                bp[dst + j] = if j < nr { b[p + (jr + j) * ldb] } else { 0.0 };
+            }
+            dst += NR;
+        }
+    }
+}
+
+// C[0:MR, 0:NR] (+)= Ap * Bp. Тело встраивается в функции с разными
+// наборами инструкций, и LLVM векторизует цикл по i под каждый из них
+#[inline(always)]
+unsafe fn kernel_body(kc: usize, a: *const f32, b: *const f32, c: *mut f32, ldc: usize, acc_c: bool) {
+    let mut acc = [[0.0f32; MR]; NR];
+    for p in 0..kc {
+        let ap = std::slice::from_raw_parts(a.add(p * MR), MR);
+        let bp = std::slice::from_raw_parts(b.add(p * NR), NR);
+        for j in 0..NR {
+            for i in 0..MR {
+                acc[j][i] += ap[i] * bp[j];
+            }
+        }
+    }
+    for j in 0..NR {
+        let col = c.add(j * ldc);
+        for i in 0..MR {
+            let v = if acc_c { *col.add(i) + acc[j][i] } else { acc[j][i] };
+            *col.add(i) = v;
+        }
+    }
+}
+
+// Базовый набор инструкций (SSE2 на x86_64, NEON на aarch64)
+unsafe fn kernel_generic(kc: usize, a: *const f32, b: *const f32, c: *mut f32, ldc: usize, acc_c: bool) {
+    kernel_body(kc, a, b, c, ldc, acc_c)
+}
+
+#[cfg(target_arch = "x86_64")]
+#[target_feature(enable = "avx2,fma")]
+unsafe fn kernel_avx2(kc: usize, a: *const f32, b: *const f32, c: *mut f32, ldc: usize, acc_c: bool) {
+    kernel_body(kc, a, b, c, ldc, acc_c)
+}
+
+fn select_kernel() -> KernelFn {
+    #[cfg(target_arch = "x86_64")]
+    {
+        if is_x86_feature_detected!("avx2") && is_x86_feature_detected!("fma") {
+            return kernel_avx2;
+        }
+    }
+    kernel_generic
+}
+
+// Блок C[0:mc, 0:nc] (+)= Ap * Bp; краевые плитки через временный буфер
+fn macro_kernel(kernel: KernelFn, mc: usize, nc: usize, kc: usize, ap: &[f32], bp: &[f32],
+                c: &mut [f32], ldc: usize, acc_c: bool) {
+    let mut edge = [0.0f32; MR * NR];
+    for jr in (0..nc).step_by(NR) {
+        let nr = NR.min(nc - jr);
+        let bpp = bp[jr * kc..].as_ptr();
+        for ir in (0..mc).step_by(MR) {
+            let mr = MR.min(mc - ir);
+            let app = ap[ir * kc..].as_ptr();
+            let offset = ir + jr * ldc;
+            if mr == MR && nr == NR {
+                unsafe { kernel(kc, app, bpp, c[offset..].as_mut_ptr(), ldc, acc_c) };
+            } else {
+                unsafe { kernel(kc, app, bpp, edge.as_mut_ptr(), MR, false) };
+                for j in 0..nr {
+                    let col = &mut c[offset + j * ldc..offset + j * ldc + mr];
+                    let e = &edge[j * MR..j * MR + mr];
+                    if acc_c {
+                        for (x, y) in col.iter_mut().zip(e) {
+                            *x += *y;
+                        }
+                    } else {
+                        col.copy_from_slice(e);
+                    }
+                }
+            }
+        }
+    }
+}
+
+// C[0:m, 0:n] = A * B в одном потоке (шаги lda/ldb/ldc - между столбцами)
+pub fn sgemm_serial(m: usize, n: usize, k: usize, a: &[f32], lda: usize, b: &[f32], ldb: usize,
+                    c: &mut [f32], ldc: usize) {
+    if m == 0 || n == 0 {
+        return;
+    }
+    if k == 0 {
+        for j in 0..n {
+            for v in &mut c[j * ldc..j * ldc + m] {
+                *v = 0.0;
+            }
+        }
+        return;
+    }
+
+    let kernel = select_kernel();
+    let mc_max = MC.min((m + MR - 1) / MR * MR);
+    let kc_max = KC.min(k);
+    let nc_pad = (n + NR - 1) / NR * NR;
+
+    PACK_BUFFERS.with(|cell| {
+        let mut bufs = cell.borrow_mut();
+        let (ap, bp) = &mut *bufs;
+        if ap.len() < mc_max * kc_max {
+            ap.resize(mc_max * kc_max, 0.0);
+        }
+        if bp.len() < kc_max * nc_pad {
+            bp.resize(kc_max * nc_pad, 0.0);
+        }
+
+        for pc in (0..k).step_by(KC) {
+            let kc = KC.min(k - pc);
+            pack_b(kc, n, &b[pc..], ldb, bp);
+            for ic in (0..m).step_by(MC) {
+                let mc = MC.min(m - ic);
+                pack_a(mc, kc, &a[ic + pc * lda..], lda, ap);
+                macro_kernel(kernel, mc, n, kc, ap, bp, &mut c[ic..], ldc, pc > 0);
+            }
+        }
+    });
+}
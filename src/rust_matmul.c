@@ -1,6 +1,8 @@
 #include <R.h>
 #include <Rinternals.h>
 
+#include "matmul_stats.h"
+
 // Объявляем внешние функции из Rust
 extern void rust_mm_optimized(const double* a_ptr, const double* b_ptr, double* c_ptr, 
                              int m, int k, int n);
@@ -8,9 +10,14 @@ extern void rust_mm_blocked(const double* a_ptr, const double* b_ptr, double* c_
                            int m, int k, int n);
 extern void rust_mm_auto(const double* a_ptr, const double* b_ptr, double* c_ptr, 
                         int m, int k, int n);
+extern int rust_mm_set_auto_threshold(int threshold);
 
 // Обертка для оптимизированной Rust-реализации
 SEXP rust_mmTiny_cpp(SEXP A_r, SEXP B_r) {
+  unsigned call = mp_stats_begin(MP_STATS_RUST_TINY);
+  if (!isReal(A_r) || !isReal(B_r) || !isMatrix(A_r) || !isMatrix(B_r)) {
+    error("A и B должны быть матрицами типа double");
+  }
   // Получаем размеры матриц
   SEXP dim_A = getAttrib(A_r, R_DimSymbol);
   SEXP dim_B = getAttrib(B_r, R_DimSymbol);
@@ -22,15 +29,19 @@ SEXP rust_mmTiny_cpp(SEXP A_r, SEXP B_r) {
   if (INTEGER(dim_B)[0] != k) {
     error("Несовместимые размеры матриц");
   }
+  mp_stats_mark(MP_PHASE_SETUP);
   
   // Создаем результирующую матрицу
   SEXP C_r = PROTECT(allocMatrix(REALSXP, m, n));
+  mp_stats_mark(MP_PHASE_ALLOC);
   double *A = REAL(A_r);
   double *B = REAL(B_r);
   double *C = REAL(C_r);
   
   // Вызываем оптимизированную Rust-функцию
   rust_mm_optimized(A, B, C, m, k, n);
+  mp_stats_mark(MP_PHASE_KERNEL);
+  mp_stats_end_product(call, m, n, k, sizeof(double));
   
   UNPROTECT(1);
   return C_r;
@@ -38,6 +49,10 @@ SEXP rust_mmTiny_cpp(SEXP A_r, SEXP B_r) {
 
 // Обертка для блочной Rust-реализации
 SEXP rust_mmBlocked_cpp(SEXP A_r, SEXP B_r) {
+  unsigned call = mp_stats_begin(MP_STATS_RUST_BLOCKED);
+  if (!isReal(A_r) || !isReal(B_r) || !isMatrix(A_r) || !isMatrix(B_r)) {
+    error("A и B должны быть матрицами типа double");
+  }
   // Получаем размеры матриц
   SEXP dim_A = getAttrib(A_r, R_DimSymbol);
   SEXP dim_B = getAttrib(B_r, R_DimSymbol);
@@ -49,15 +64,19 @@ SEXP rust_mmBlocked_cpp(SEXP A_r, SEXP B_r) {
   if (INTEGER(dim_B)[0] != k) {
     error("Несовместимые размеры матриц");
   }
+  mp_stats_mark(MP_PHASE_SETUP);
   
   // Создаем результирующую матрицу
   SEXP C_r = PROTECT(allocMatrix(REALSXP, m, n));
+  mp_stats_mark(MP_PHASE_ALLOC);
   double *A = REAL(A_r);
   double *B = REAL(B_r);
   double *C = REAL(C_r);
   
   // Вызываем блочную Rust-функцию
   rust_mm_blocked(A, B, C, m, k, n);
+  mp_stats_mark(MP_PHASE_KERNEL);
+  mp_stats_end_product(call, m, n, k, sizeof(double));
   
   UNPROTECT(1);
   return C_r;
@@ -65,6 +84,10 @@ SEXP rust_mmBlocked_cpp(SEXP A_r, SEXP B_r) {
 
 // Обертка для автоматического выбора Rust-реализации
 SEXP rust_mmAuto_cpp(SEXP A_r, SEXP B_r) {
+  unsigned call = mp_stats_begin(MP_STATS_RUST_AUTO);
+  if (!isReal(A_r) || !isReal(B_r) || !isMatrix(A_r) || !isMatrix(B_r)) {
+    error("A и B должны быть матрицами типа double");
+  }
   // Получаем размеры матриц
   SEXP dim_A = getAttrib(A_r, R_DimSymbol);
   SEXP dim_B = getAttrib(B_r, R_DimSymbol);
@@ -76,16 +99,31 @@ SEXP rust_mmAuto_cpp(SEXP A_r, SEXP B_r) {
   if (INTEGER(dim_B)[0] != k) {
     error("Несовместимые размеры матриц");
   }
+  mp_stats_mark(MP_PHASE_SETUP);
   
   // Создаем результирующую матрицу
   SEXP C_r = PROTECT(allocMatrix(REALSXP, m, n));
+  mp_stats_mark(MP_PHASE_ALLOC);
   double *A = REAL(A_r);
   double *B = REAL(B_r);
   double *C = REAL(C_r);
   
   // Вызываем автоматическую Rust-функцию
   rust_mm_auto(A, B, C, m, k, n);
+  mp_stats_mark(MP_PHASE_KERNEL);
+  mp_stats_end_product(call, m, n, k, sizeof(double));
   
   UNPROTECT(1);
   return C_r;
 }
+
+// Порог выбора алгоритма в rust_mm_auto; NULL/NA - только прочитать.
+// Возвращает предыдущее значение
+SEXP rust_set_auto_threshold(SEXP threshold_r) {
+  int threshold = 0;
+  if (!isNull(threshold_r)) {
+    threshold = asInteger(threshold_r);
+    if (threshold == NA_INTEGER) threshold = 0;
+  }
+  return ScalarInteger(rust_mm_set_auto_threshold(threshold));
+}
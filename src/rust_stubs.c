@@ -2,28 +2,35 @@
 #include <Rinternals.h>
 
 // Заглушки для Rust-функций для тестирования
-void rust_mm_optimized(const double* a_ptr, const double* b_ptr, double* c_ptr, 
-                      int m, int k, int n) {
+void rust_mm_optimized_ld(const double* a_ptr, int lda, const double* b_ptr, int ldb,
+                          double* c_ptr, int ldc, int m, int k, int n) {
     // Простая реализация матричного умножения
     for (int i = 0; i < m; i++) {
         for (int j = 0; j < n; j++) {
             double sum = 0.0;
             for (int l = 0; l < k; l++) {
-                sum += a_ptr[i + l * m] * b_ptr[l + j * k];
+                sum += a_ptr[i + (size_t) l * lda] * b_ptr[l + (size_t) j * ldb];
             }
-            c_ptr[i + j * m] = sum;
+            c_ptr[i + (size_t) j * ldc] = sum;
         }
     }
 }
 
-void rust_mm_blocked(const double* a_ptr, const double* b_ptr, double* c_ptr, 
-                    int m, int k, int n) {
+void rust_mm_optimized(const double* a_ptr, const double* b_ptr, double* c_ptr, 
+                      int m, int k, int n) {
+    rust_mm_optimized_ld(a_ptr, m, b_ptr, k, c_ptr, m, m, k, n);
+}
+
+void rust_mm_blocked_ld(const double* a_ptr, int lda, const double* b_ptr, int ldb,
+                        double* c_ptr, int ldc, int m, int k, int n) {
     // Блочная реализация матричного умножения
     const int block_size = 64;
     
     // Инициализируем результат нулями
-    for (int i = 0; i < m * n; i++) {
-        c_ptr[i] = 0.0;
+    for (int j = 0; j < n; j++) {
+        for (int i = 0; i < m; i++) {
+            c_ptr[i + (size_t) j * ldc] = 0.0;
+        }
     }
     
     // Блочное матричное умножение
@@ -37,11 +44,11 @@ void rust_mm_blocked(const double* a_ptr, const double* b_ptr, double* c_ptr,
                 // Умножение блоков
                 for (int i = i0; i < imax; i++) {
                     for (int j = j0; j < jmax; j++) {
-                        double sum = c_ptr[i + j * m]; // Получаем текущее значение
+                        double sum = c_ptr[i + (size_t) j * ldc]; // Получаем текущее значение
                         for (int l = l0; l < lmax; l++) {
-                            sum += a_ptr[i + l * m] * b_ptr[l + j * k];
+                            sum += a_ptr[i + (size_t) l * lda] * b_ptr[l + (size_t) j * ldb];
                         }
-                        c_ptr[i + j * m] = sum;
+                        c_ptr[i + (size_t) j * ldc] = sum;
                     }
                 }
             }
@@ -49,14 +56,82 @@ void rust_mm_blocked(const double* a_ptr, const double* b_ptr, double* c_ptr,
     }
 }
 
-void rust_mm_auto(const double* a_ptr, const double* b_ptr, double* c_ptr, 
-                 int m, int k, int n) {
+void rust_mm_blocked(const double* a_ptr, const double* b_ptr, double* c_ptr, 
+                    int m, int k, int n) {
+    rust_mm_blocked_ld(a_ptr, m, b_ptr, k, c_ptr, m, m, k, n);
+}
+
+void rust_mm_gemm(int trans_a, int trans_b, int m, int n, int k,
+                  double alpha, const double* a_ptr, int lda,
+                  const double* b_ptr, int ldb,
+                  double beta, double* c_ptr, int ldc) {
+    // Простая реализация C = alpha * op(A) * op(B) + beta * C
+    for (int j = 0; j < n; j++) {
+        for (int i = 0; i < m; i++) {
+            double sum = 0.0;
+            for (int l = 0; l < k; l++) {
+                double a = trans_a ? a_ptr[l + (size_t) i * lda] : a_ptr[i + (size_t) l * lda];
+                double b = trans_b ? b_ptr[j + (size_t) l * ldb] : b_ptr[l + (size_t) j * ldb];
+                sum += a * b;
+            }
+            double *c = c_ptr + i + (size_t) j * ldc;
+            *c = alpha * sum + (beta == 0.0 ? 0.0 : beta * *c);
+        }
+    }
+}
+
+void rust_mm_sgemm(int m, int n, int k, const float* a_ptr, int lda,
+                   const float* b_ptr, int ldb, float* c_ptr, int ldc) {
+    // Простая реализация в одинарной точности
+    for (int j = 0; j < n; j++) {
+        for (int i = 0; i < m; i++) {
+            float sum = 0.0f;
+            for (int l = 0; l < k; l++) {
+                sum += a_ptr[i + (size_t) l * lda] * b_ptr[l + (size_t) j * ldb];
+            }
+            c_ptr[i + (size_t) j * ldc] = sum;
+        }
+    }
+}
+
+static int auto_threshold = 512;
+
+void rust_mm_auto_ld(const double* a_ptr, int lda, const double* b_ptr, int ldb,
+                     double* c_ptr, int ldc, int m, int k, int n) {
     // Автоматический выбор алгоритма в зависимости от размера матриц
-    if (m < 200 && k < 200 && n < 200) {
+    if (m <= auto_threshold && k <= auto_threshold && n <= auto_threshold) {
         // Для малых матриц используем простую реализацию
-        rust_mm_optimized(a_ptr, b_ptr, c_ptr, m, k, n);
+        rust_mm_optimized_ld(a_ptr, lda, b_ptr, ldb, c_ptr, ldc, m, k, n);
     } else {
         // Для больших матриц используем блочную реализацию
-        rust_mm_blocked(a_ptr, b_ptr, c_ptr, m, k, n);
+        rust_mm_blocked_ld(a_ptr, lda, b_ptr, ldb, c_ptr, ldc, m, k, n);
     }
 }
+
+void rust_mm_auto(const double* a_ptr, const double* b_ptr, double* c_ptr, 
+                 int m, int k, int n) {
+    rust_mm_auto_ld(a_ptr, m, b_ptr, k, c_ptr, m, m, k, n);
+}
+
+int rust_mm_set_auto_threshold(int threshold) {
+    int previous = auto_threshold;
+    if (threshold > 0) auto_threshold = threshold;
+    return previous;
+}
+
+// Заглушки однопоточные: запоминается только запрошенное число потоков
+static int rust_threads = 1;
+
+int rust_mm_set_threads(int threads) {
+    int previous = rust_threads;
+    rust_threads = threads > 0 ? threads : 1;
+    return previous;
+}
+
+int rust_mm_get_threads(void) {
+    return rust_threads;
+}
+
+void rust_mm_after_fork(int threads) {
+    rust_threads = threads > 0 ? threads : 1;
+}
@@ -3,11 +3,20 @@
 #include <R.h>
 #include <Rinternals.h>
 
+#include "gebp_engine.h"
+#include "matmul_stats.h"
+#include "tile_pool.h"
+
 // Примечание: функции rust_mmTiny_cpp и cpp_mmAccelerate перенесены в отдельные файлы
 // для избежания дублирования символов при компиляции
 
-// Простая реализация блочного матричного умножения
+// Блочное матричное умножение (GEBP) для больших матриц
 extern "C" SEXP block_mmHuge(SEXP A_r, SEXP B_r) {
+  unsigned call = mp_stats_begin(MP_STATS_BLOCK);
+  if (!Rf_isReal(A_r) || !Rf_isReal(B_r) || !Rf_isMatrix(A_r) || !Rf_isMatrix(B_r)) {
+    Rf_error("A и B должны быть матрицами типа double");
+  }
+  
   // Получаем размеры матриц
   SEXP dim_A = Rf_getAttrib(A_r, R_DimSymbol);
   SEXP dim_B = Rf_getAttrib(B_r, R_DimSymbol);
@@ -21,45 +30,40 @@ extern "C" SEXP block_mmHuge(SEXP A_r, SEXP B_r) {
   if (k != p) {
     Rf_error("Несовместимые размеры матриц");
   }
+  mp_stats_mark(MP_PHASE_SETUP);
   
   // Создаем результирующую матрицу
   SEXP C_r = PROTECT(Rf_allocMatrix(REALSXP, m, n));
+  mp_stats_mark(MP_PHASE_ALLOC);
   double *A = REAL(A_r);
   double *B = REAL(B_r);
   double *C = REAL(C_r);
   
-  // Инициализируем результат нулями
-  for (int i = 0; i < m * n; i++) {
-    C[i] = 0.0;
-  }
-  
-  // Размер блока (можно оптимизировать для конкретной архитектуры)
-  const int block_size = 64;
-  
-  // Блочное матричное умножение
-  for (int i0 = 0; i0 < m; i0 += block_size) {
-    int imax = (i0 + block_size < m) ? i0 + block_size : m;
-    for (int j0 = 0; j0 < n; j0 += block_size) {
-      int jmax = (j0 + block_size < n) ? j0 + block_size : n;
-      for (int l0 = 0; l0 < k; l0 += block_size) {
-        int lmax = (l0 + block_size < k) ? l0 + block_size : k;
-        
-        // Умножение блоков
-        for (int i = i0; i < imax; i++) {
-          for (int j = j0; j < jmax; j++) {
-            double sum = C[i + j * m]; // Получаем текущее значение
-            for (int l = l0; l < lmax; l++) {
-              sum += A[i + l * m] * B[l + j * k];
-            }
-            C[i + j * m] = sum;
-          }
-        }
-      }
-    }
-  }
+  // Упакованное блочное умножение с регистровым микроядром;
+  // размеры блоков MC/KC/NC подбираются по размерам кэшей L1/L2/L3,
+  // плитки C распределяются по пулу потоков с перехватом работы
+  mp_gebp_dgemm(m, n, k, 1.0, A, m, B, k, 0.0, C, m);
+  mp_stats_mark(MP_PHASE_KERNEL);
+  mp_stats_end_product(call, m, n, k, sizeof(double));
   
   UNPROTECT(1);
   return C_r;
 }
 
+// Число потоков для block_mmHuge (NULL или NA - по числу физических ядер)
+extern "C" SEXP set_block_threads(SEXP threads_r, SEXP pin_r) {
+  int threads = Rf_isNull(threads_r) ? NA_INTEGER : Rf_asInteger(threads_r);
+  int pin = Rf_asLogical(pin_r);
+  if (threads != NA_INTEGER && threads < 1) {
+    Rf_error("Число потоков должно быть положительным");
+  }
+  int previous = mp_pool_set_threads(threads == NA_INTEGER ? 0 : threads,
+                                     pin == NA_LOGICAL ? -1 : pin);
+  return Rf_ScalarInteger(previous);
+}
+
+extern "C" SEXP get_block_threads(void) {
+  return Rf_ScalarInteger(mp_pool_get_threads());
+}
+
 // Информация о производительности перенесена в отдельный файл performance_info.c
@@ -0,0 +1,298 @@
+// Узкие произведения (GEMV и родственные формы): высокое A * B с n <= 16,
+// широкое A * B с m <= 16 и случай, когда обе внешние размерности малы, а
+// k велико. Число операций на загруженный элемент большого операнда не
+// больше 16, поэтому такие произведения ограничены памятью, а не
+// вычислениями: вместо упаковки панелей GEMM большой операнд один раз
+// читается полосами с SIMD, а полосы делятся между потоками пула.
+#define R_NO_REMAP
+#include <R.h>
+#include <Rinternals.h>
+
+#include <algorithm>
+#include <cstring>
+#include <new>
+#include <vector>
+
+#if defined(__AVX2__) && defined(__FMA__)
+#include <immintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#include "blas_backend.h"
+#include "matmul_stats.h"
+#include "skinny_matmul.h"
+#include "tile_pool.h"
+
+namespace {
+
+// Панель A^T широкого случая помещается в L2
+const size_t kWidePanelBytes = 128 * 1024;
+// Полоса C высокого случая (panel x n) помещается в L1
+const size_t kPanelBytes = 16 * 1024;
+// Столбцов A за один проход по полосе C (регистры av в column_group)
+const int kGroup = 8;
+// Ниже этого числа элементов большого операнда пул потоков не используется
+const double kParallelMinElements = 1 << 15;
+// Задач на поток (для перехвата работы)
+const int kTasksPerThread = 4;
+
+// C[0:len, 0:n] += A[0:len, 0:L] * B[0:L, 0:n], bt - блок B по строкам
+// (bt[j * L + t] = B[t, j]). Столбцы A загружаются в регистры один раз
+// на 4 строки и умножаются на все n столбцов полосы C, лежащей в L1
+template <int L>
+inline void column_group(int len, int n, const double *a, int lda, const double *bt,
+                         double *c, int ldc) {
+  int i = 0;
+#if defined(__AVX2__) && defined(__FMA__)
+  for (; i + 4 <= len; i += 4) {
+    __m256d av[L];
+    for (int t = 0; t < L; t++) av[t] = _mm256_loadu_pd(a + i + (long) t * lda);
+    for (int j = 0; j < n; j++) {
+      double *cj = c + i + (long) j * ldc;
+      __m256d v = _mm256_loadu_pd(cj);
+      for (int t = 0; t < L; t++) v = _mm256_fmadd_pd(av[t], _mm256_broadcast_sd(bt + j * L + t), v);
+      _mm256_storeu_pd(cj, v);
+    }
+  }
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+  for (; i + 2 <= len; i += 2) {
+    float64x2_t av[L];
+    for (int t = 0; t < L; t++) av[t] = vld1q_f64(a + i + (long) t * lda);
+    for (int j = 0; j < n; j++) {
+      double *cj = c + i + (long) j * ldc;
+      float64x2_t v = vld1q_f64(cj);
+      for (int t = 0; t < L; t++) v = vfmaq_n_f64(v, av[t], bt[j * L + t]);
+      vst1q_f64(cj, v);
+    }
+  }
+#endif
+  for (; i < len; i++) {
+    for (int j = 0; j < n; j++) {
+      double v = c[i + (long) j * ldc];
+      for (int t = 0; t < L; t++) v += a[i + (long) t * lda] * bt[j * L + t];
+      c[i + (long) j * ldc] = v;
+    }
+  }
+}
+
+// Скалярное произведение x[0:len] и y[0:len]
+inline double dot(int len, const double *x, const double *y) {
+  int i = 0;
+  double sum = 0.0;
+#if defined(__AVX2__) && defined(__FMA__)
+  __m256d s0 = _mm256_setzero_pd(), s1 = _mm256_setzero_pd();
+  __m256d s2 = _mm256_setzero_pd(), s3 = _mm256_setzero_pd();
+  for (; i + 16 <= len; i += 16) {
+    s0 = _mm256_fmadd_pd(_mm256_loadu_pd(x + i), _mm256_loadu_pd(y + i), s0);
+    s1 = _mm256_fmadd_pd(_mm256_loadu_pd(x + i + 4), _mm256_loadu_pd(y + i + 4), s1);
+    s2 = _mm256_fmadd_pd(_mm256_loadu_pd(x + i + 8), _mm256_loadu_pd(y + i + 8), s2);
+    s3 = _mm256_fmadd_pd(_mm256_loadu_pd(x + i + 12), _mm256_loadu_pd(y + i + 12), s3);
+  }
+  for (; i + 4 <= len; i += 4) {
+    s0 = _mm256_fmadd_pd(_mm256_loadu_pd(x + i), _mm256_loadu_pd(y + i), s0);
+  }
+  __m256d s = _mm256_add_pd(_mm256_add_pd(s0, s1), _mm256_add_pd(s2, s3));
+  __m128d h = _mm_add_pd(_mm256_castpd256_pd128(s), _mm256_extractf128_pd(s, 1));
+  sum = _mm_cvtsd_f64(_mm_add_sd(h, _mm_unpackhi_pd(h, h)));
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+  float64x2_t s0 = vdupq_n_f64(0.0), s1 = vdupq_n_f64(0.0);
+  for (; i + 4 <= len; i += 4) {
+    s0 = vfmaq_f64(s0, vld1q_f64(x + i), vld1q_f64(y + i));
+    s1 = vfmaq_f64(s1, vld1q_f64(x + i + 2), vld1q_f64(y + i + 2));
+  }
+  sum = vaddvq_f64(vaddq_f64(s0, s1));
+#endif
+  for (; i < len; i++) sum += x[i] * y[i];
+  return sum;
+}
+
+// Высота полосы строк C (кратна 4), при которой полоса занимает kPanelBytes
+int panel_rows(int n) {
+  return std::max(64, (int) (kPanelBytes / (sizeof(double) * n)) / 4 * 4);
+}
+
+// C[r0:r1, 0:n] = A[r0:r1, 0:k] * B. A читается один раз непрерывными
+// отрезками столбцов, по kGroup столбцов за проход по полосе C
+void tall_rows(int r0, int r1, int n, int k, const double *A, int lda, const double *B, int ldb,
+               double *C, int ldc) {
+  int panel = panel_rows(n);
+  double bt[kGroup * MP_SKINNY_MAX];
+  for (int p0 = r0; p0 < r1; p0 += panel) {
+    int len = std::min(panel, r1 - p0);
+    double *c = C + p0;
+    for (int j = 0; j < n; j++) std::memset(c + (long) j * ldc, 0, sizeof(double) * len);
+    int l = 0;
+    for (; l + kGroup <= k; l += kGroup) {
+      for (int j = 0; j < n; j++) {
+        for (int t = 0; t < kGroup; t++) bt[j * kGroup + t] = B[l + t + (long) j * ldb];
+      }
+      column_group<kGroup>(len, n, A + p0 + (long) l * lda, lda, bt, c, ldc);
+    }
+    for (; l < k; l++) {
+      for (int j = 0; j < n; j++) bt[j] = B[l + (long) j * ldb];
+      column_group<1>(len, n, A + p0 + (long) l * lda, lda, bt, c, ldc);
+    }
+  }
+}
+
+struct SkinnyJob {
+  int m, n, k;
+  const double *A;
+  int lda;
+  const double *B;
+  int ldb;
+  double *C;
+  int ldc;
+  int per_task;        // строк, столбцов или индексов k на задачу
+  const double *At;    // A^T (m x k -> k-строки подряд), широкий случай
+  double *partial;     // частичные суммы m x n по задачам (малые m и n)
+};
+
+// Полоса строк C[r0:r1, :] высокого случая
+void tall_task(int task, int worker, void *ctx) {
+  (void) worker;
+  const SkinnyJob *job = (const SkinnyJob *) ctx;
+  int r0 = task * job->per_task;
+  int r1 = std::min(job->m, r0 + job->per_task);
+  tall_rows(r0, r1, job->n, job->k, job->A, job->lda, job->B, job->ldb, job->C, job->ldc);
+}
+
+// Столбцы C[:, j0:j1] по m скалярным произведениям строк A^T и столбцов
+// B; панели A^T по k остаются в L2, каждый столбец B читается один раз
+void wide_task(int task, int worker, void *ctx) {
+  (void) worker;
+  const SkinnyJob *job = (const SkinnyJob *) ctx;
+  int m = job->m, k = job->k;
+  int j0 = task * job->per_task;
+  int j1 = std::min(job->n, j0 + job->per_task);
+  int kp = std::max(256, (int) (kWidePanelBytes / (sizeof(double) * m)));
+  for (int l0 = 0; l0 < k; l0 += kp) {
+    int len = std::min(kp, k - l0);
+    for (int j = j0; j < j1; j++) {
+      const double *b = job->B + l0 + (long) j * job->ldb;
+      double *c = job->C + (long) j * job->ldc;
+      for (int i = 0; i < m; i++) {
+        double v = dot(len, job->At + (long) i * k + l0, b);
+        c[i] = l0 == 0 ? v : c[i] + v;
+      }
+    }
+  }
+}
+
+// Малые m и n: задача считает вклад своего диапазона k в отдельный буфер
+void inner_task(int task, int worker, void *ctx) {
+  (void) worker;
+  const SkinnyJob *job = (const SkinnyJob *) ctx;
+  int l0 = task * job->per_task;
+  int l1 = std::min(job->k, l0 + job->per_task);
+  double *dst = job->partial + (long) task * job->m * job->n;
+  tall_rows(0, job->m, job->n, l1 - l0, job->A + (long) l0 * job->lda, job->lda,
+            job->B + l0, job->ldb, dst, job->m);
+}
+
+// Число задач для объема work (элементов большого операнда) и длины len
+int task_count(double work, int len) {
+  if (work < kParallelMinElements || mp_pool_in_worker()) return 1;
+  return std::max(1, std::min(len, mp_pool_get_threads() * kTasksPerThread));
+}
+
+void run_tasks(int tasks, mp_task_fn fn, SkinnyJob *job) {
+  if (tasks == 1) {
+    fn(0, 0, job);
+  } else {
+    mp_pool_run(tasks, fn, job);
+  }
+}
+
+}  // namespace
+
+extern "C" int mp_skinny_dgemm(int m, int n, int k, const double *A, int lda,
+                               const double *B, int ldb, double *C, int ldc) {
+  if (n > MP_SKINNY_MAX && m > MP_SKINNY_MAX) return 0;
+  if (m == 0 || n == 0) return 1;
+  if (k == 0) {
+    for (int j = 0; j < n; j++) std::memset(C + (long) j * ldc, 0, sizeof(double) * m);
+    return 1;
+  }
+  SkinnyJob job = {m, n, k, A, lda, B, ldb, C, ldc, 0, NULL, NULL};
+
+  if (n <= MP_SKINNY_MAX && m > MP_SKINNY_MAX) {
+    // Высокое A: задачи - полосы строк, кратные 4 (ширине SIMD)
+    int tasks = task_count((double) m * k, (m + 3) / 4);
+    job.per_task = ((m + tasks - 1) / tasks + 3) / 4 * 4;
+    run_tasks((m + job.per_task - 1) / job.per_task, tall_task, &job);
+    return 1;
+  }
+
+  if (n <= MP_SKINNY_MAX) {
+    // Малые m и n, длинное k: большие здесь оба операнда, параллелизм - по k
+    int tasks = task_count((double) (m + n) * k, k);
+    if (tasks == 1) {
+      tall_rows(0, m, n, k, A, lda, B, ldb, C, ldc);
+      return 1;
+    }
+    std::vector<double> partial;
+    try {
+      partial.resize((size_t) tasks * m * n);
+    } catch (const std::bad_alloc &) {
+      return 0;
+    }
+    job.per_task = (k + tasks - 1) / tasks;
+    tasks = (k + job.per_task - 1) / job.per_task;
+    job.partial = partial.data();
+    mp_pool_run(tasks, inner_task, &job);
+    for (int j = 0; j < n; j++) {
+      for (int i = 0; i < m; i++) {
+        double sum = 0.0;
+        for (int t = 0; t < tasks; t++) sum += partial[(size_t) t * m * n + i + (size_t) j * m];
+        C[i + (long) j * ldc] = sum;
+      }
+    }
+    return 1;
+  }
+
+  // Широкое B: A^T упаковывается, чтобы строки A читались подряд
+  std::vector<double> At;
+  try {
+    At.resize((size_t) m * k);
+  } catch (const std::bad_alloc &) {
+    return 0;
+  }
+  for (int l = 0; l < k; l++) {
+    for (int i = 0; i < m; i++) At[(size_t) i * k + l] = A[i + (long) l * lda];
+  }
+  job.At = At.data();
+  int tasks = task_count((double) k * n, n);
+  job.per_task = (n + tasks - 1) / tasks;
+  run_tasks((n + job.per_task - 1) / job.per_task, wide_task, &job);
+  return 1;
+}
+
+// C = A * B узким ядром; для прочих форм (или при нехватке памяти) - BLAS
+extern "C" SEXP skinny_matmul(SEXP A_r, SEXP B_r) {
+  unsigned call = mp_stats_begin(MP_STATS_SKINNY);
+  if (!Rf_isReal(A_r) || !Rf_isReal(B_r) || !Rf_isMatrix(A_r) || !Rf_isMatrix(B_r)) {
+    Rf_error("A и B должны быть матрицами типа double");
+  }
+  SEXP dim_A = Rf_getAttrib(A_r, R_DimSymbol);
+  SEXP dim_B = Rf_getAttrib(B_r, R_DimSymbol);
+  int m = INTEGER(dim_A)[0];
+  int k = INTEGER(dim_A)[1];
+  int n = INTEGER(dim_B)[1];
+  if (INTEGER(dim_B)[0] != k) {
+    Rf_error("Несовместимые размеры матриц");
+  }
+  mp_stats_mark(MP_PHASE_SETUP);
+
+  SEXP C_r = PROTECT(Rf_allocMatrix(REALSXP, m, n));
+  mp_stats_mark(MP_PHASE_ALLOC);
+  int lda = m > 0 ? m : 1, ldb = k > 0 ? k : 1;
+  if (!mp_skinny_dgemm(m, n, k, REAL(A_r), lda, REAL(B_r), ldb, REAL(C_r), lda)) {
+    mp_blas_dgemm(0, 0, m, n, k, 1.0, REAL(A_r), lda, REAL(B_r), ldb, 0.0, REAL(C_r), lda);
+  }
+  mp_stats_mark(MP_PHASE_KERNEL);
+  mp_stats_end_product(call, m, n, k, sizeof(double));
+  UNPROTECT(1);
+  return C_r;
+}
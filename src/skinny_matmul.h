@@ -0,0 +1,26 @@
+#ifndef MATRIXPROD_SKINNY_MATMUL_H
+#define MATRIXPROD_SKINNY_MATMUL_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Наибольшая "узкая" размерность: n для высоких (A * узкая B, в том числе
+// GEMV) и m для широких (узкая A * B) произведений
+#define MP_SKINNY_MAX 16
+
+// C = A * B в формате column-major, когда n <= MP_SKINNY_MAX или
+// m <= MP_SKINNY_MAX. Такие произведения ограничены пропускной
+// способностью памяти: большой операнд читается ровно один раз, полосами,
+// которые делятся между потоками пула. Возвращает 0, если форма не узкая
+// или не хватило памяти (тогда вызывающий использует обычное ядро).
+int mp_skinny_dgemm(int m, int n, int k,
+                    const double *A, int lda,
+                    const double *B, int ldb,
+                    double *C, int ldc);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
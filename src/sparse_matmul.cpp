@@ -0,0 +1,375 @@
+// Произведения с разреженными матрицами в формате CSC (Matrix::dgCMatrix):
+// разреженная x плотная (SpMM), плотная x разреженная и разреженная x
+// разреженная (SpGEMM, алгоритм Густавсона). Столбцы результата делятся на
+// блоки, которые считаются параллельно на пуле потоков. Результат SpGEMM
+// возвращается плотным, если его заполнение превышает порог.
+#define R_NO_REMAP
+#include <R.h>
+#include <Rinternals.h>
+
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include <new>
+#include <vector>
+
+#include "matmul_stats.h"
+#include "tile_pool.h"
+
+namespace {
+
+// Наибольшая ширина блока столбцов SpMM: столбец A остается в L1, пока
+// его ненулевые элементы умножаются на строку блока B
+const int kSpmmMaxBlock = 16;
+// Высота полосы строк для плотной x разреженной: полоса столбца C (32 КБ)
+// остается в L1, пока к ней прибавляются столбцы A
+const int kRowPanel = 4096;
+// Задач на поток при делении столбцов (для перехвата работы)
+const int kTasksPerThread = 4;
+
+// Матрица CSC: p - начала столбцов (ncol + 1), i - номера строк с 0
+struct Csc {
+  int nrow, ncol;
+  const int *p;
+  const int *i;
+  const double *x;
+};
+
+struct Dense {
+  int nrow, ncol;
+  const double *x;
+};
+
+// Число ненулевых элементов и объем CSC в байтах (x, i и p) для статистики
+double csc_nnz(const Csc &a) { return a.p[a.ncol]; }
+
+double csc_bytes(const Csc &a) {
+  return csc_nnz(a) * (sizeof(double) + sizeof(int)) + (a.ncol + 1.0) * sizeof(int);
+}
+
+// Операнд - плотная матрица double или list(Dim, p, i, x) разреженной;
+// NULL или текст ошибки
+const char *read_operand(SEXP op, bool *sparse, Csc *csc, Dense *dense) {
+  if (Rf_isReal(op) && Rf_isMatrix(op)) {
+    SEXP dim = Rf_getAttrib(op, R_DimSymbol);
+    *sparse = false;
+    *dense = {INTEGER(dim)[0], INTEGER(dim)[1], REAL(op)};
+    return NULL;
+  }
+  if (TYPEOF(op) != VECSXP || Rf_length(op) != 4) {
+    return "Операнд должен быть матрицей double или разреженной матрицей dgCMatrix";
+  }
+  SEXP dim = VECTOR_ELT(op, 0), p = VECTOR_ELT(op, 1);
+  SEXP i = VECTOR_ELT(op, 2), x = VECTOR_ELT(op, 3);
+  if (TYPEOF(dim) != INTSXP || Rf_length(dim) != 2 || TYPEOF(p) != INTSXP ||
+      TYPEOF(i) != INTSXP || TYPEOF(x) != REALSXP) {
+    return "Некорректная разреженная матрица";
+  }
+  int ncol = INTEGER(dim)[1];
+  if (Rf_length(p) != ncol + 1 || Rf_length(i) != Rf_length(x) ||
+      INTEGER(p)[ncol] != Rf_length(i)) {
+    return "Некорректная разреженная матрица";
+  }
+  *sparse = true;
+  *csc = {INTEGER(dim)[0], ncol, INTEGER(p), INTEGER(i), REAL(x)};
+  return NULL;
+}
+
+// Столбцы 0..n-1 делятся на задачи в kTasksPerThread раз больше потоков
+int column_chunk(int n) {
+  int threads = mp_pool_get_threads();
+  int tasks = std::max(1, std::min(n, threads * kTasksPerThread));
+  return (n + tasks - 1) / tasks;
+}
+
+void run_columns(int n, int chunk, mp_task_fn fn, void *ctx) {
+  int tasks = (n + chunk - 1) / chunk;
+  if (tasks == 1) {
+    fn(0, 0, ctx);
+  } else {
+    mp_pool_run(tasks, fn, ctx);
+  }
+}
+
+// C = A * B, A разреженная (m x k), B плотная (k x n)
+struct SpmmJob {
+  Csc a;
+  Dense b;
+  double *c;
+  int chunk;
+};
+
+void spmm_task(int task, int worker, void *ctx) {
+  (void) worker;
+  const SpmmJob *job = (const SpmmJob *) ctx;
+  const Csc &a = job->a;
+  int m = a.nrow, k = a.ncol;
+  int j_end = std::min(job->b.ncol, (task + 1) * job->chunk);
+  for (int j0 = task * job->chunk; j0 < j_end; j0 += kSpmmMaxBlock) {
+    int j1 = std::min(j_end, j0 + kSpmmMaxBlock);
+    for (int j = j0; j < j1; j++) std::memset(job->c + (long) j * m, 0, sizeof(double) * m);
+    for (int l = 0; l < k; l++) {
+      int t0 = a.p[l], t1 = a.p[l + 1];
+      if (t0 == t1) continue;
+      for (int j = j0; j < j1; j++) {
+        // Нули B не пропускаются: Inf и NaN в A дают NaN, как в %*%
+        double b = job->b.x[l + (long) j * k];
+        double *col = job->c + (long) j * m;
+        for (int t = t0; t < t1; t++) col[a.i[t]] += a.x[t] * b;
+      }
+    }
+  }
+}
+
+// C = A * B, A плотная (m x k), B разреженная (k x n)
+struct DenseSparseJob {
+  Dense a;
+  Csc b;
+  double *c;
+  int chunk;
+};
+
+void dense_sparse_task(int task, int worker, void *ctx) {
+  (void) worker;
+  const DenseSparseJob *job = (const DenseSparseJob *) ctx;
+  const Csc &b = job->b;
+  int m = job->a.nrow;
+  int j_end = std::min(b.ncol, (task + 1) * job->chunk);
+  for (int j = task * job->chunk; j < j_end; j++) {
+    double *col = job->c + (long) j * m;
+    std::memset(col, 0, sizeof(double) * m);
+    for (int r0 = 0; r0 < m; r0 += kRowPanel) {
+      int r1 = std::min(m, r0 + kRowPanel);
+      for (int t = b.p[j]; t < b.p[j + 1]; t++) {
+        const double *acol = job->a.x + (long) b.i[t] * m;
+        double v = b.x[t];
+        for (int r = r0; r < r1; r++) col[r] += acol[r] * v;
+      }
+    }
+  }
+}
+
+// C = A * B для двух разреженных. Фаза count считает ненулевые элементы
+// столбцов C по меткам; фаза fill заполняет плотный C или CSC-массивы
+struct SpgemmJob {
+  Csc a, b;
+  int chunk;
+  bool count;
+  int *counts;                 // число ненулевых в столбцах C (фаза count)
+  double *dense;               // плотный результат или NULL
+  const int *offsets;          // начала столбцов CSC-результата
+  int *out_i;
+  double *out_x;
+  std::vector<int> *marks;     // метки строк по потокам
+  std::vector<double> *accum;  // плотные аккумуляторы по потокам
+  std::vector<int> *rows;      // найденные строки столбца по потокам
+};
+
+void spgemm_task(int task, int worker, void *ctx) {
+  const SpgemmJob *job = (const SpgemmJob *) ctx;
+  const Csc &a = job->a, &b = job->b;
+  int m = a.nrow;
+  int j_end = std::min(b.ncol, (task + 1) * job->chunk);
+  for (int j = task * job->chunk; j < j_end; j++) {
+    if (job->dense) {
+      // Плотный результат: элементы прибавляются сразу в столбец C
+      double *col = job->dense + (long) j * m;
+      std::memset(col, 0, sizeof(double) * m);
+      for (int t = b.p[j]; t < b.p[j + 1]; t++) {
+        int l = b.i[t];
+        double v = b.x[t];
+        for (int s = a.p[l]; s < a.p[l + 1]; s++) col[a.i[s]] += a.x[s] * v;
+      }
+      continue;
+    }
+    int *mark = job->marks[worker].data();
+    double *acc = job->count ? NULL : job->accum[worker].data();
+    std::vector<int> &rows = job->rows[worker];
+    rows.clear();
+    // Метка j + 1: строка уже встречалась в столбце j
+    for (int t = b.p[j]; t < b.p[j + 1]; t++) {
+      int l = b.i[t];
+      double v = b.x[t];
+      for (int s = a.p[l]; s < a.p[l + 1]; s++) {
+        int r = a.i[s];
+        if (mark[r] != j + 1) {
+          mark[r] = j + 1;
+          rows.push_back(r);
+          if (!job->count) acc[r] = 0.0;
+        }
+        if (!job->count) acc[r] += a.x[s] * v;
+      }
+    }
+    if (job->count) {
+      job->counts[j] = (int) rows.size();
+      continue;
+    }
+    // dgCMatrix требует возрастающих номеров строк внутри столбца
+    std::sort(rows.begin(), rows.end());
+    int dst = job->offsets[j];
+    for (size_t q = 0; q < rows.size(); q++) {
+      job->out_i[dst + q] = rows[q];
+      job->out_x[dst + q] = acc[rows[q]];
+    }
+  }
+}
+
+// Вспомогательные буферы потоков; false, если памяти не хватило
+bool reserve_workers(std::vector<std::vector<int>> &marks, std::vector<std::vector<double>> &accum,
+                     std::vector<std::vector<int>> &rows, int m, bool with_values) {
+  int threads = std::max(1, mp_pool_get_threads());
+  try {
+    marks.assign(threads, std::vector<int>(m, 0));
+    if (with_values) accum.assign(threads, std::vector<double>(m));
+    rows.resize(threads);
+    for (auto &r : rows) r.reserve(m);
+  } catch (const std::bad_alloc &) {
+    return false;
+  }
+  return true;
+}
+
+const char *const kSpgemmAllocError = "Не удалось выделить буферы разреженного произведения";
+
+// Фазы SpGEMM с буферами потоков. Буферы живут только внутри функции, а
+// объекты R выделяются между фазами: Rf_allocVector при нехватке памяти
+// выходит через longjmp, который не вызывает деструкторы std::vector
+bool spgemm_count(const Csc &a, const Csc &b, int chunk, int *counts) {
+  std::vector<std::vector<int>> marks, rows;
+  std::vector<std::vector<double>> accum;
+  if (!reserve_workers(marks, accum, rows, a.nrow, false)) return false;
+  SpgemmJob job = {a, b, chunk, true, counts, NULL, NULL, NULL, NULL,
+                   marks.data(), accum.data(), rows.data()};
+  run_columns(b.ncol, chunk, spgemm_task, &job);
+  return true;
+}
+
+bool spgemm_fill(const Csc &a, const Csc &b, int chunk, const int *offsets, int *out_i,
+                 double *out_x) {
+  std::vector<std::vector<int>> marks, rows;
+  std::vector<std::vector<double>> accum;
+  if (!reserve_workers(marks, accum, rows, a.nrow, true)) return false;
+  SpgemmJob job = {a, b, chunk, false, NULL, NULL, offsets, out_i, out_x,
+                   marks.data(), accum.data(), rows.data()};
+  run_columns(b.ncol, chunk, spgemm_task, &job);
+  return true;
+}
+
+// Произведение двух разреженных: плотная матрица или list(Dim, p, i, x).
+// При нехватке памяти возвращает R_NilValue и текст ошибки в failure
+SEXP spgemm(const Csc &a, const Csc &b, double fill, int chunk, const char **failure) {
+  int m = a.nrow, n = b.ncol;
+  SEXP counts_r = PROTECT(Rf_allocVector(INTSXP, n));
+  int *counts = INTEGER(counts_r);
+  if (n > 0 && !spgemm_count(a, b, chunk, counts)) {
+    UNPROTECT(1);
+    *failure = kSpgemmAllocError;
+    return R_NilValue;
+  }
+  long nnz = 0;
+  for (int j = 0; j < n; j++) nnz += counts[j];
+
+  // Плотный результат при большом заполнении (и если CSC не помещается в int)
+  double cells = (double) m * n;
+  if (cells > 0 && (nnz >= fill * cells || nnz > (long) INT_MAX)) {
+    SEXP C_r = PROTECT(Rf_allocMatrix(REALSXP, m, n));
+    SpgemmJob job = {a, b, chunk, false, NULL, REAL(C_r), NULL, NULL, NULL, NULL, NULL, NULL};
+    run_columns(n, chunk, spgemm_task, &job);
+    UNPROTECT(2);
+    return C_r;
+  }
+
+  SEXP out = PROTECT(Rf_allocVector(VECSXP, 4));
+  SEXP dim = SET_VECTOR_ELT(out, 0, Rf_allocVector(INTSXP, 2));
+  INTEGER(dim)[0] = m;
+  INTEGER(dim)[1] = n;
+  SEXP p = SET_VECTOR_ELT(out, 1, Rf_allocVector(INTSXP, (R_xlen_t) n + 1));
+  SEXP i = SET_VECTOR_ELT(out, 2, Rf_allocVector(INTSXP, nnz));
+  SEXP x = SET_VECTOR_ELT(out, 3, Rf_allocVector(REALSXP, nnz));
+  int *offsets = INTEGER(p);
+  offsets[0] = 0;
+  for (int j = 0; j < n; j++) offsets[j + 1] = offsets[j] + counts[j];
+  if (nnz > 0 && !spgemm_fill(a, b, chunk, offsets, INTEGER(i), REAL(x))) {
+    UNPROTECT(2);
+    *failure = kSpgemmAllocError;
+    return R_NilValue;
+  }
+  UNPROTECT(2);
+  return out;
+}
+
+}  // namespace
+
+// A_r, B_r: плотная матрица double или list(Dim, p, i, x) со слотами
+// dgCMatrix. fill_r: доля ненулевых элементов, начиная с которой
+// произведение двух разреженных возвращается плотной матрицей. Результат -
+// матрица или list(Dim, p, i, x) разреженного.
+extern "C" SEXP sparse_matmul(SEXP A_r, SEXP B_r, SEXP fill_r) {
+  unsigned call = mp_stats_begin(MP_STATS_SPARSE);
+  bool a_sparse, b_sparse;
+  Csc a_csc = {0, 0, NULL, NULL, NULL}, b_csc = {0, 0, NULL, NULL, NULL};
+  Dense a_dense = {0, 0, NULL}, b_dense = {0, 0, NULL};
+  const char *bad = read_operand(A_r, &a_sparse, &a_csc, &a_dense);
+  if (!bad) bad = read_operand(B_r, &b_sparse, &b_csc, &b_dense);
+  if (bad) Rf_error("%s", bad);
+  if (!a_sparse && !b_sparse) {
+    Rf_error("Хотя бы один операнд должен быть разреженным");
+  }
+  double fill = Rf_asReal(fill_r);
+  if (ISNAN(fill) || fill < 0) {
+    Rf_error("fill_threshold должен быть неотрицательным числом");
+  }
+  int m = a_sparse ? a_csc.nrow : a_dense.nrow;
+  int k = a_sparse ? a_csc.ncol : a_dense.ncol;
+  int kb = b_sparse ? b_csc.nrow : b_dense.nrow;
+  int n = b_sparse ? b_csc.ncol : b_dense.ncol;
+  if (k != kb) {
+    Rf_error("Несовместимые размеры матриц");
+  }
+  int chunk = column_chunk(std::max(n, 1));
+  mp_stats_mark(MP_PHASE_SETUP);
+
+  if (!b_sparse) {
+    SEXP C_r = PROTECT(Rf_allocMatrix(REALSXP, m, n));
+    mp_stats_mark(MP_PHASE_ALLOC);
+    if (m > 0 && n > 0) {
+      SpmmJob job = {a_csc, b_dense, REAL(C_r), chunk};
+      run_columns(n, chunk, spmm_task, &job);
+    }
+    mp_stats_mark(MP_PHASE_KERNEL);
+    mp_stats_end(call, 2.0 * csc_nnz(a_csc) * n,
+                 csc_bytes(a_csc) + sizeof(double) * ((double) k * n + (double) m * n));
+    UNPROTECT(1);
+    return C_r;
+  }
+  if (!a_sparse) {
+    SEXP C_r = PROTECT(Rf_allocMatrix(REALSXP, m, n));
+    mp_stats_mark(MP_PHASE_ALLOC);
+    if (m > 0 && n > 0) {
+      DenseSparseJob job = {a_dense, b_csc, REAL(C_r), chunk};
+      run_columns(n, chunk, dense_sparse_task, &job);
+    }
+    mp_stats_mark(MP_PHASE_KERNEL);
+    mp_stats_end(call, 2.0 * m * csc_nnz(b_csc),
+                 csc_bytes(b_csc) + sizeof(double) * ((double) m * k + (double) m * n));
+    UNPROTECT(1);
+    return C_r;
+  }
+
+  // Две разреженные: точное число ненулевых элементов определяет формат
+  const char *failure = NULL;
+  SEXP C_r = spgemm(a_csc, b_csc, fill, chunk, &failure);
+  if (failure) Rf_error("%s", failure);
+  mp_stats_mark(MP_PHASE_KERNEL);
+  if (call != 0) {
+    // Каждый ненулевой B[l, j] умножается на все ненулевые столбца l матрицы A;
+    // байты - только входы (формат результата зависит от заполнения)
+    double flops = 0;
+    for (int l = 0; l < b_csc.p[b_csc.ncol]; l++) {
+      int row = b_csc.i[l];
+      flops += 2.0 * (a_csc.p[row + 1] - a_csc.p[row]);
+    }
+    mp_stats_end(call, flops, csc_bytes(a_csc) + csc_bytes(b_csc));
+  }
+  return C_r;
+}
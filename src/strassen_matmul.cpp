@@ -0,0 +1,362 @@
+// Умножение Штрассена-Винограда: 7 умножений и 15 сложений блоков вместо 8
+// умножений на каждом уровне рекурсии. Рекурсия продолжается, пока все
+// размеры больше порога cutoff, ниже него блоки считает обычное ядро (BLAS
+// или блочный движок GEBP). Нечетные размеры обрабатываются отщеплением
+// последней строки/столбца (dynamic peeling). Временные блоки всех уровней
+// берутся из одной заранее выделенной области памяти.
+#define R_NO_REMAP
+#include <R.h>
+#include <Rinternals.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+#include "blas_backend.h"
+#include "gebp_engine.h"
+#include "matmul_stats.h"
+#include "tile_pool.h"
+
+namespace {
+
+typedef void (*BaseFn)(int m, int n, int k, double alpha, const double *A, int lda,
+                       const double *B, int ldb, double beta, double *C, int ldc);
+
+const char *const kStrassenBases[] = {"auto", "cpp_accelerate", "block_huge"};
+enum { kAuto, kBlas, kBlockHuge, kStrassenBaseCount };
+
+// Элементов на задачу пула при сложении блоков
+const long kAddChunk = 1L << 16;
+// Блоки области выравниваются на 64 байта
+const size_t kArenaAlign = 8;
+
+void blas_base(int m, int n, int k, double alpha, const double *A, int lda,
+               const double *B, int ldb, double beta, double *C, int ldc) {
+  mp_blas_dgemm(0, 0, m, n, k, alpha, A, lda, B, ldb, beta, C, ldc);
+}
+
+int strassen_base(SEXP base_r) {
+  if (!Rf_isString(base_r) || Rf_length(base_r) != 1) {
+    Rf_error("base должен быть строкой");
+  }
+  const char *base = CHAR(STRING_ELT(base_r, 0));
+  for (int i = 0; i < kStrassenBaseCount; i++) {
+    if (std::strcmp(base, kStrassenBases[i]) == 0) return i;
+  }
+  Rf_error("Неизвестное базовое ядро: %s", base);
+  return -1;
+}
+
+size_t padded(size_t count) { return (count + kArenaAlign - 1) / kArenaAlign * kArenaAlign; }
+
+// Стековая область временных блоков: take() отдает следующий кусок,
+// release() возвращает все, что взято после отметки
+struct Arena {
+  double *base;
+  size_t used;
+
+  double *take(size_t count) {
+    double *ptr = base + used;
+    used += padded(count);
+    return ptr;
+  }
+  size_t mark() const { return used; }
+  void release(size_t to) { used = to; }
+};
+
+bool should_split(int m, int n, int k, int cutoff) {
+  return std::min(m, std::min(n, k)) > cutoff;
+}
+
+// Объем временной памяти последовательной рекурсии: на уровне - по блоку
+// размеров A, B и C (четверти), плюс вложенные уровни
+size_t sequential_workspace(int m, int n, int k, int cutoff) {
+  if (!should_split(m, n, k, cutoff)) return 0;
+  size_t m2 = m / 2, n2 = n / 2, k2 = k / 2;
+  return padded(m2 * k2) + padded(k2 * n2) + padded(m2 * n2) +
+         sequential_workspace((int) m2, (int) n2, (int) k2, cutoff);
+}
+
+// Параллельный верхний уровень: S1..S4, T1..T4, три произведения вне C и
+// отдельная область последовательной рекурсии для каждого из 7 произведений
+size_t parallel_workspace(int m, int n, int k, int cutoff) {
+  size_t m2 = m / 2, n2 = n / 2, k2 = k / 2;
+  return 4 * padded(m2 * k2) + 4 * padded(k2 * n2) + 3 * padded(m2 * n2) +
+         7 * sequential_workspace((int) m2, (int) n2, (int) k2, cutoff);
+}
+
+struct CombineJob {
+  int rows, cols;
+  const double *X;
+  int ldx;
+  double sign;
+  const double *Y;
+  int ldy;
+  double *Z;
+  int ldz;
+  int cols_per_task;
+};
+
+void combine_task(int task, int worker, void *ctx) {
+  (void) worker;
+  const CombineJob *job = (const CombineJob *) ctx;
+  int j0 = task * job->cols_per_task;
+  int j1 = std::min(job->cols, j0 + job->cols_per_task);
+  for (int j = j0; j < j1; j++) {
+    const double *x = job->X + (long) j * job->ldx;
+    const double *y = job->Y + (long) j * job->ldy;
+    double *z = job->Z + (long) j * job->ldz;
+    for (int i = 0; i < job->rows; i++) z[i] = x[i] + job->sign * y[i];
+  }
+}
+
+// Z = X + sign * Y (Z может совпадать с X или Y); столбцы делятся между
+// потоками пула, внутри задачи пула сложение идет в текущем потоке
+void combine(int rows, int cols, const double *X, int ldx, double sign,
+             const double *Y, int ldy, double *Z, int ldz) {
+  if (rows == 0 || cols == 0) return;
+  int cols_per_task = (int) std::max(1L, kAddChunk / rows);
+  CombineJob job = {rows, cols, X, ldx, sign, Y, ldy, Z, ldz, cols_per_task};
+  int tasks = (cols + cols_per_task - 1) / cols_per_task;
+  if (tasks == 1) {
+    combine_task(0, 0, &job);
+  } else {
+    mp_pool_run(tasks, combine_task, &job);
+  }
+}
+
+// Z += sign * X
+void accumulate(int rows, int cols, double *Z, int ldz, double sign, const double *X, int ldx) {
+  combine(rows, cols, Z, ldz, sign, X, ldx, Z, ldz);
+}
+
+struct Strassen {
+  BaseFn base;
+  int cutoff;
+
+  // Отщепленные строка/столбцы: C[0:me, 0:ne] += A[:, k-1] * B[k-1, :] и
+  // последние строка и столбец C целиком базовым ядром
+  void peel(int m, int n, int k, const double *A, int lda, const double *B, int ldb,
+            double *C, int ldc) const {
+    int me = m & ~1, ne = n & ~1, ke = k & ~1;
+    if (k != ke) {
+      base(me, ne, 1, 1.0, A + (long) ke * lda, lda, B + ke, ldb, 1.0, C, ldc);
+    }
+    if (m != me) {
+      base(1, ne, k, 1.0, A + me, lda, B, ldb, 0.0, C + me, ldc);
+    }
+    if (n != ne) {
+      base(m, 1, k, 1.0, A, lda, B + (long) ne * ldb, ldb, 0.0, C + (long) ne * ldc, ldc);
+    }
+  }
+
+  // C = A * B (C не читается). Схема с тремя временными блоками на
+  // уровень: промежуточные суммы хранятся в четвертях C
+  void multiply(int m, int n, int k, const double *A, int lda, const double *B, int ldb,
+                double *C, int ldc, Arena &arena) const {
+    if (!should_split(m, n, k, cutoff)) {
+      base(m, n, k, 1.0, A, lda, B, ldb, 0.0, C, ldc);
+      return;
+    }
+    int m2 = m / 2, n2 = n / 2, k2 = k / 2;
+    const double *A11 = A, *A21 = A + m2;
+    const double *A12 = A + (long) k2 * lda, *A22 = A12 + m2;
+    const double *B11 = B, *B21 = B + k2;
+    const double *B12 = B + (long) n2 * ldb, *B22 = B12 + k2;
+    double *C11 = C, *C21 = C + m2;
+    double *C12 = C + (long) n2 * ldc, *C22 = C12 + m2;
+
+    size_t top = arena.mark();
+    double *SA = arena.take((size_t) m2 * k2);
+    double *TB = arena.take((size_t) k2 * n2);
+    double *P = arena.take((size_t) m2 * n2);
+
+    // P7 = (A11 - A21)(B22 - B12) -> C21
+    combine(m2, k2, A11, lda, -1.0, A21, lda, SA, m2);
+    combine(k2, n2, B22, ldb, -1.0, B12, ldb, TB, k2);
+    multiply(m2, n2, k2, SA, m2, TB, k2, C21, ldc, arena);
+    // S1 = A21 + A22, T1 = B12 - B11; P5 = S1 T1 -> C22
+    combine(m2, k2, A21, lda, 1.0, A22, lda, SA, m2);
+    combine(k2, n2, B12, ldb, -1.0, B11, ldb, TB, k2);
+    multiply(m2, n2, k2, SA, m2, TB, k2, C22, ldc, arena);
+    // S2 = S1 - A11, T2 = B22 - T1; P6 = S2 T2 -> C12
+    combine(m2, k2, SA, m2, -1.0, A11, lda, SA, m2);
+    combine(k2, n2, B22, ldb, -1.0, TB, k2, TB, k2);
+    multiply(m2, n2, k2, SA, m2, TB, k2, C12, ldc, arena);
+    // P1 = A11 B11; U2 = P1 + P6
+    multiply(m2, n2, k2, A11, lda, B11, ldb, P, m2, arena);
+    accumulate(m2, n2, C12, ldc, 1.0, P, m2);
+    // C11 = P2 + P1, P2 = A12 B21
+    multiply(m2, n2, k2, A12, lda, B21, ldb, C11, ldc, arena);
+    accumulate(m2, n2, C11, ldc, 1.0, P, m2);
+    // U3 = U2 + P7, U4 = U2 + P5, C22 = U3 + P5
+    accumulate(m2, n2, C21, ldc, 1.0, C12, ldc);
+    accumulate(m2, n2, C12, ldc, 1.0, C22, ldc);
+    accumulate(m2, n2, C22, ldc, 1.0, C21, ldc);
+    // S4 = A12 - S2; C12 = U4 + S4 B22
+    combine(m2, k2, A12, lda, -1.0, SA, m2, SA, m2);
+    multiply(m2, n2, k2, SA, m2, B22, ldb, P, m2, arena);
+    accumulate(m2, n2, C12, ldc, 1.0, P, m2);
+    // T4 = T2 - B21; C21 = U3 - A22 T4
+    combine(k2, n2, TB, k2, -1.0, B21, ldb, TB, k2);
+    multiply(m2, n2, k2, A22, lda, TB, k2, P, m2, arena);
+    accumulate(m2, n2, C21, ldc, -1.0, P, m2);
+
+    arena.release(top);
+    peel(m, n, k, A, lda, B, ldb, C, ldc);
+  }
+};
+
+// Одно из 7 произведений верхнего уровня
+struct Product {
+  const double *A;
+  int lda;
+  const double *B;
+  int ldb;
+  double *C;
+  int ldc;
+};
+
+struct ParallelJob {
+  const Strassen *engine;
+  int m2, n2, k2;
+  Product products[7];
+  double *workspace;
+  size_t task_workspace;
+};
+
+void product_task(int task, int worker, void *ctx) {
+  (void) worker;
+  const ParallelJob *job = (const ParallelJob *) ctx;
+  const Product &p = job->products[task];
+  Arena arena = {job->workspace + (size_t) task * job->task_workspace, 0};
+  job->engine->multiply(job->m2, job->n2, job->k2, p.A, p.lda, p.B, p.ldb, p.C, p.ldc, arena);
+}
+
+// Верхний уровень с независимыми временными блоками: 7 произведений
+// выполняются параллельно на пуле, вложенные уровни - последовательно в
+// своих задачах (базовое ядро внутри задачи пула однопоточное)
+void multiply_parallel(const Strassen &engine, int m, int n, int k, const double *A, int lda,
+                       const double *B, int ldb, double *C, int ldc, double *workspace) {
+  int m2 = m / 2, n2 = n / 2, k2 = k / 2;
+  const double *A11 = A, *A21 = A + m2;
+  const double *A12 = A + (long) k2 * lda, *A22 = A12 + m2;
+  const double *B11 = B, *B21 = B + k2;
+  const double *B12 = B + (long) n2 * ldb, *B22 = B12 + k2;
+  double *C11 = C, *C21 = C + m2;
+  double *C12 = C + (long) n2 * ldc, *C22 = C12 + m2;
+
+  Arena arena = {workspace, 0};
+  double *S[4], *T[4], *X[3];
+  for (int i = 0; i < 4; i++) S[i] = arena.take((size_t) m2 * k2);
+  for (int i = 0; i < 4; i++) T[i] = arena.take((size_t) k2 * n2);
+  for (int i = 0; i < 3; i++) X[i] = arena.take((size_t) m2 * n2);
+
+  combine(m2, k2, A21, lda, 1.0, A22, lda, S[0], m2);
+  combine(m2, k2, S[0], m2, -1.0, A11, lda, S[1], m2);
+  combine(m2, k2, A11, lda, -1.0, A21, lda, S[2], m2);
+  combine(m2, k2, A12, lda, -1.0, S[1], m2, S[3], m2);
+  combine(k2, n2, B12, ldb, -1.0, B11, ldb, T[0], k2);
+  combine(k2, n2, B22, ldb, -1.0, T[0], k2, T[1], k2);
+  combine(k2, n2, B22, ldb, -1.0, B12, ldb, T[2], k2);
+  combine(k2, n2, T[1], k2, -1.0, B21, ldb, T[3], k2);
+
+  // P1 -> X1, P2 -> C11, P3 -> X3, P4 -> X4, P5 -> C22, P6 -> C12, P7 -> C21
+  ParallelJob job = {&engine, m2, n2, k2,
+                     {{A11, lda, B11, ldb, X[0], m2},
+                      {A12, lda, B21, ldb, C11, ldc},
+                      {S[3], m2, B22, ldb, X[1], m2},
+                      {A22, lda, T[3], k2, X[2], m2},
+                      {S[0], m2, T[0], k2, C22, ldc},
+                      {S[1], m2, T[1], k2, C12, ldc},
+                      {S[2], m2, T[2], k2, C21, ldc}},
+                     workspace + arena.mark(),
+                     sequential_workspace(m2, n2, k2, engine.cutoff)};
+  mp_pool_run(7, product_task, &job);
+
+  accumulate(m2, n2, C12, ldc, 1.0, X[0], m2);
+  accumulate(m2, n2, C11, ldc, 1.0, X[0], m2);
+  accumulate(m2, n2, C21, ldc, 1.0, C12, ldc);
+  accumulate(m2, n2, C12, ldc, 1.0, C22, ldc);
+  accumulate(m2, n2, C22, ldc, 1.0, C21, ldc);
+  accumulate(m2, n2, C12, ldc, 1.0, X[1], m2);
+  accumulate(m2, n2, C21, ldc, -1.0, X[2], m2);
+
+  engine.peel(m, n, k, A, lda, B, ldb, C, ldc);
+}
+
+double *aligned_buffer(size_t count) {
+  void *ptr = NULL;
+  if (posix_memalign(&ptr, 64, std::max<size_t>(count, 1) * sizeof(double)) != 0) return NULL;
+  return (double *) ptr;
+}
+
+// C = A * B; NULL или текст ошибки. Параллельный верхний уровень
+// используется с ядром GEBP (оно учитывает пул), если для него хватает
+// памяти; с BLAS рекурсия последовательная, а параллельны сами вызовы BLAS
+const char *strassen_dgemm(int base_kind, int cutoff, int m, int n, int k,
+                           const double *A, int lda, const double *B, int ldb,
+                           double *C, int ldc) {
+  Strassen engine = {base_kind == kBlas ? blas_base : mp_gebp_dgemm, cutoff};
+  bool split = should_split(m, n, k, cutoff);
+  if (split && base_kind == kBlockHuge && mp_pool_get_threads() > 1 && !mp_pool_in_worker()) {
+    double *workspace = aligned_buffer(parallel_workspace(m, n, k, cutoff));
+    if (workspace) {
+      multiply_parallel(engine, m, n, k, A, lda, B, ldb, C, ldc, workspace);
+      free(workspace);
+      return NULL;
+    }
+  }
+  double *workspace = aligned_buffer(sequential_workspace(m, n, k, cutoff));
+  if (!workspace) return "Не удалось выделить рабочую память алгоритма Штрассена";
+  Arena arena = {workspace, 0};
+  engine.multiply(m, n, k, A, lda, B, ldb, C, ldc, arena);
+  free(workspace);
+  return NULL;
+}
+
+}  // namespace
+
+// cutoff_r: наибольший размер, который считается базовым ядром;
+// base_r: "auto" (BLAS, если пакет собран с оптимизированной библиотекой,
+// иначе GEBP), "cpp_accelerate" (BLAS) или "block_huge" (GEBP)
+extern "C" SEXP strassen_matmul(SEXP A_r, SEXP B_r, SEXP cutoff_r, SEXP base_r) {
+  unsigned call = mp_stats_begin(MP_STATS_STRASSEN);
+  if (!Rf_isReal(A_r) || !Rf_isReal(B_r) || !Rf_isMatrix(A_r) || !Rf_isMatrix(B_r)) {
+    Rf_error("A и B должны быть матрицами типа double");
+  }
+  int cutoff = Rf_asInteger(cutoff_r);
+  if (cutoff == NA_INTEGER || cutoff < 16) {
+    Rf_error("cutoff должен быть целым числом не меньше 16");
+  }
+  int base_kind = strassen_base(base_r);
+  if (base_kind == kAuto) {
+    base_kind = std::strcmp(mp_blas_backend(), "R") == 0 ? kBlockHuge : kBlas;
+  }
+
+  SEXP dim_A = Rf_getAttrib(A_r, R_DimSymbol);
+  SEXP dim_B = Rf_getAttrib(B_r, R_DimSymbol);
+  int m = INTEGER(dim_A)[0];
+  int k = INTEGER(dim_A)[1];
+  int n = INTEGER(dim_B)[1];
+  if (INTEGER(dim_B)[0] != k) {
+    Rf_error("Несовместимые размеры матриц");
+  }
+  mp_stats_mark(MP_PHASE_SETUP);
+
+  SEXP C_r = PROTECT(Rf_allocMatrix(REALSXP, m, n));
+  mp_stats_mark(MP_PHASE_ALLOC);
+  if (m == 0 || n == 0) {
+    UNPROTECT(1);
+    return C_r;
+  }
+  const char *failure = strassen_dgemm(base_kind, cutoff, m, n, k, REAL(A_r), m, REAL(B_r),
+                                       k > 0 ? k : 1, REAL(C_r), m);
+  UNPROTECT(1);
+  if (failure) Rf_error("%s", failure);
+  mp_stats_mark(MP_PHASE_KERNEL);
+  // Как и в benchmark_suite, FLOP считаются по классическому алгоритму (2mnk):
+  // GFLOP/s Штрассена сравнимы с остальными бэкендами
+  mp_stats_end_product(call, m, n, k, sizeof(double));
+  return C_r;
+}
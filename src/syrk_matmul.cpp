@@ -0,0 +1,143 @@
+// Симметричные произведения crossprod(X) = X^T X и tcrossprod(X) = X X^T.
+// Считается только верхний треугольник (dsyrk или блоки GEBP/Rust над
+// диагональю), что почти вдвое сокращает число операций, а затем он
+// отражается в нижний. Транспонированная копия X не создается.
+#define R_NO_REMAP
+#include <R.h>
+#include <Rinternals.h>
+
+#include <algorithm>
+#include <cstring>
+
+#include "blas_backend.h"
+#include "gebp_engine.h"
+#include "matmul_stats.h"
+
+extern "C" {
+void rust_mm_gemm(int trans_a, int trans_b, int m, int n, int k,
+                  double alpha, const double *a_ptr, int lda,
+                  const double *b_ptr, int ldb,
+                  double beta, double *c_ptr, int ldc);
+int mp_metal_dgemm(int trans_a, int trans_b, int M, int N, int K, double alpha,
+                   const double *A, int lda, const double *B, int ldb,
+                   double beta, double *C, int ldc);
+}
+
+namespace {
+
+// Ширина блока столбцов C для треугольного разбиения: блоки на диагонали
+// считаются целиком, так что лишняя работа составляет w / n от всей
+const int kSyrkBlock = 256;
+// Плитка отражения треугольника (64 x 64 double помещаются в L1)
+const int kMirrorTile = 64;
+
+typedef void (*GemmFn)(int trans_a, int trans_b, int m, int n, int k,
+                       double alpha, const double *A, int lda,
+                       const double *B, int ldb,
+                       double beta, double *C, int ldc);
+
+const char *const kSyrkMethods[] = {"auto", "cpp_accelerate", "block_huge", "rust_blocked",
+                                    "metal_gpu"};
+enum { kAuto, kBlas, kBlockHuge, kRust, kMetal, kSyrkMethodCount };
+
+int syrk_method(SEXP method_r) {
+  if (!Rf_isString(method_r) || Rf_length(method_r) != 1) {
+    Rf_error("Метод должен быть строкой");
+  }
+  const char *method = CHAR(STRING_ELT(method_r, 0));
+  for (int i = 0; i < kSyrkMethodCount; i++) {
+    if (std::strcmp(method, kSyrkMethods[i]) == 0) return i;
+  }
+  Rf_error("Неизвестный метод: %s", method);
+  return -1;
+}
+
+// Верхний треугольник C (n x n) блоками столбцов шириной kSyrkBlock:
+// блок C[0:j1, j0:j1] = op(X)[0:j1, :] * op(X)[j0:j1, :]^T. trans != 0
+// означает X^T X (X: k x n), иначе X X^T (X: n x k).
+void triangular_blocks(GemmFn gemm, int trans, int n, int k, const double *X, int ldx,
+                       double *C) {
+  for (int j0 = 0; j0 < n; j0 += kSyrkBlock) {
+    int w = std::min(kSyrkBlock, n - j0);
+    int j1 = j0 + w;
+    if (trans) {
+      gemm(1, 0, j1, w, k, 1.0, X, ldx, X + (long) j0 * ldx, ldx, 0.0, C + (long) j0 * n, n);
+    } else {
+      gemm(0, 1, j1, w, k, 1.0, X, ldx, X + j0, ldx, 0.0, C + (long) j0 * n, n);
+    }
+  }
+}
+
+// Копирует верхний треугольник в нижний плитками, чтобы чтение строк
+// верхнего треугольника не проходило по всей матрице с шагом n
+void mirror_upper(int n, double *C) {
+  for (int i0 = 0; i0 < n; i0 += kMirrorTile) {
+    int i1 = std::min(n, i0 + kMirrorTile);
+    for (int j0 = 0; j0 <= i0; j0 += kMirrorTile) {
+      int j1 = std::min(n, j0 + kMirrorTile);
+      // C[i, j] = C[j, i] для i > j внутри плитки
+      for (int j = j0; j < j1; j++) {
+        for (int i = std::max(i0, j + 1); i < i1; i++) {
+          C[i + (long) j * n] = C[j + (long) i * n];
+        }
+      }
+    }
+  }
+}
+
+}  // namespace
+
+// crossprod(X) при trans = TRUE, tcrossprod(X) при trans = FALSE
+extern "C" SEXP syrk_matmul(SEXP X_r, SEXP trans_r, SEXP method_r) {
+  unsigned call = mp_stats_begin(MP_STATS_SYRK);
+  if (!Rf_isReal(X_r) || !Rf_isMatrix(X_r)) {
+    Rf_error("X должна быть матрицей типа double");
+  }
+  int trans = Rf_asLogical(trans_r) == TRUE;
+  int method = syrk_method(method_r);
+  SEXP dim = Rf_getAttrib(X_r, R_DimSymbol);
+  int rows = INTEGER(dim)[0];
+  int cols = INTEGER(dim)[1];
+  int n = trans ? cols : rows;
+  int k = trans ? rows : cols;
+  int ldx = rows > 0 ? rows : 1;
+  const double *X = REAL(X_r);
+  mp_stats_mark(MP_PHASE_SETUP);
+
+  SEXP C_r = PROTECT(Rf_allocMatrix(REALSXP, n, n));
+  mp_stats_mark(MP_PHASE_ALLOC);
+  double *C = REAL(C_r);
+  if (n == 0) {
+    UNPROTECT(1);
+    return C_r;
+  }
+
+  switch (method) {
+  case kAuto:
+  case kBlas:
+    mp_blas_dsyrk(trans, n, k, 1.0, X, ldx, 0.0, C, n);
+    break;
+  case kBlockHuge:
+    triangular_blocks(mp_gebp_dgemm_ex, trans, n, k, X, ldx, C);
+    break;
+  case kRust:
+    triangular_blocks(rust_mm_gemm, trans, n, k, X, ldx, C);
+    break;
+  case kMetal:
+    // На GPU выгоднее одно полное произведение, чем много малых блоков:
+    // каждый вызов заново переносит X в память GPU
+    if (!mp_metal_dgemm(trans, !trans, n, n, k, 1.0, X, ldx, X, ldx, 0.0, C, n)) {
+      UNPROTECT(1);
+      Rf_error("Metal недоступен или не удалось выделить буферы");
+    }
+    break;
+  }
+  // Результат точно симметричен (для Metal нижний треугольник заменяется верхним)
+  mirror_upper(n, C);
+  mp_stats_mark(MP_PHASE_KERNEL);
+  // Верхний треугольник: n (n + 1) k FLOP, чтение X и запись C
+  mp_stats_end(call, (double) n * (n + 1) * k, sizeof(double) * ((double) n * k + (double) n * n));
+
+  UNPROTECT(1);
+  return C_r;
+}
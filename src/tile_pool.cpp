@@ -0,0 +1,278 @@
+// Пул потоков с перехватом работы для распараллеливания по плиткам матрицы C
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <vector>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#endif
+#ifdef __APPLE__
+#include <pthread.h>
+#include <sys/qos.h>
+#endif
+
+#include "cpu_info.h"
+#include "tile_pool.h"
+
+namespace {
+
+thread_local int current_worker = -1;
+
+// Диапазон задач потока; выровнен по строке кэша, чтобы счетчики
+// соседних потоков не делили одну строку (false sharing)
+struct alignas(64) TaskRange {
+  std::mutex lock;
+  int lo = 0;
+  int hi = 0;
+};
+
+class TilePool {
+ public:
+  ~TilePool() { stop_workers(); }
+
+  int set_threads(int threads, int pin) {
+    std::lock_guard<std::mutex> run_guard(run_mutex_);
+    int previous = nthreads_;
+    bool pinned = pin < 0 ? pin_ : pin != 0;
+    if (threads <= 0) threads = mp_physical_cores();
+    if (threads < 1) threads = 1;
+    if (threads == nthreads_ && pinned == pin_ && started_) return previous;
+
+    stop_workers();
+    nthreads_ = threads;
+    pin_ = pinned;
+    start_workers();
+    return previous;
+  }
+
+  // Вызывается в дочернем процессе после fork, где существует только
+  // вызвавший fork поток. Ждать или уничтожать std::thread чужих потоков
+  // нельзя (деструктор joinable-потока вызывает std::terminate), поэтому
+  // объекты перемещаются в хранилище, которое никогда не разрушается.
+  // Мьютексы и условные переменные могли быть захвачены потоками родителя
+  // - они создаются заново поверх старых, а диапазоны задач просто
+  // оставляются.
+  void after_fork() {
+    alignas(std::vector<std::thread>) static unsigned char orphans[sizeof(std::vector<std::thread>)];
+    new (orphans) std::vector<std::thread>(std::move(workers_));
+    workers_.clear();
+    ranges_.release();
+    new (&run_mutex_) std::mutex;
+    new (&mutex_) std::mutex;
+    new (&wake_) std::condition_variable;
+    new (&done_) std::condition_variable;
+    stop_ = false;
+    active_ = 0;
+    generation_ = 0;
+    nthreads_ = 1;
+    started_ = true;
+  }
+
+  int threads() {
+    ensure_started();
+    return nthreads_;
+  }
+
+  void run(int ntasks, mp_task_fn fn, void *ctx) {
+    if (ntasks <= 0) return;
+    if (current_worker >= 0 || ntasks == 1) {
+      for (int t = 0; t < ntasks; t++) fn(t, current_worker < 0 ? 0 : current_worker, ctx);
+      return;
+    }
+
+    ensure_started();
+    std::lock_guard<std::mutex> run_guard(run_mutex_);
+    if (nthreads_ == 1) {
+      current_worker = 0;
+      for (int t = 0; t < ntasks; t++) fn(t, 0, ctx);
+      current_worker = -1;
+      return;
+    }
+
+    // Начальное распределение: непрерывные диапазоны, чтобы соседние плитки
+    // (использующие одну панель B) обрабатывались одним потоком
+    for (int w = 0; w < nthreads_; w++) {
+      std::lock_guard<std::mutex> guard(ranges_[w].lock);
+      ranges_[w].lo = (int) ((long) ntasks * w / nthreads_);
+      ranges_[w].hi = (int) ((long) ntasks * (w + 1) / nthreads_);
+    }
+
+    {
+      std::lock_guard<std::mutex> guard(mutex_);
+      fn_ = fn;
+      ctx_ = ctx;
+      active_ = nthreads_ - 1;
+      generation_++;
+    }
+    wake_.notify_all();
+
+    // Вызывающий поток работает как поток 0
+    current_worker = 0;
+    work(0);
+    current_worker = -1;
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    done_.wait(lock, [this] { return active_ == 0; });
+  }
+
+ private:
+  void ensure_started() {
+    std::lock_guard<std::mutex> run_guard(run_mutex_);
+    if (!started_) {
+      nthreads_ = mp_physical_cores();
+      if (nthreads_ < 1) nthreads_ = 1;
+      start_workers();
+    }
+  }
+
+  void start_workers() {
+    ranges_.reset(new TaskRange[nthreads_]);
+    cpus_.assign(1024, 0);
+    cpus_.resize(mp_cpu_order(cpus_.data(), (int) cpus_.size()));
+#if defined(__linux__)
+    // Потоков меньше, чем CPU: сдвиг начального CPU по номеру процесса, чтобы
+    // несколько сессий R с закреплением не занимали одни и те же ядра
+    first_cpu_ = !cpus_.empty() && (size_t) nthreads_ < cpus_.size()
+                     ? (int) (getpid() % (pid_t) cpus_.size()) : 0;
+#endif
+    stop_ = false;
+    generation_ = 0;
+    for (int w = 1; w < nthreads_; w++) {
+      workers_.emplace_back(&TilePool::worker_loop, this, w);
+    }
+    started_ = true;
+  }
+
+  void stop_workers() {
+    {
+      std::lock_guard<std::mutex> guard(mutex_);
+      stop_ = true;
+    }
+    wake_.notify_all();
+    for (auto &t : workers_) t.join();
+    workers_.clear();
+    started_ = false;
+  }
+
+  void pin_current(int worker) {
+    if (!pin_) return;
+#if defined(__linux__)
+    if (cpus_.empty()) return;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpus_[(first_cpu_ + worker) % cpus_.size()], &set);
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#elif defined(__APPLE__)
+    // macOS не позволяет закреплять потоки за ядрами; класс QoS
+    // направляет их на производительные ядра
+    (void) worker;
+    pthread_set_qos_class_self_np(QOS_CLASS_USER_INITIATED, 0);
+#else
+    (void) worker;
+#endif
+  }
+
+  void worker_loop(int worker) {
+    current_worker = worker;
+    pin_current(worker);
+    long seen = 0;
+    for (;;) {
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        wake_.wait(lock, [&] { return stop_ || generation_ != seen; });
+        if (stop_) return;
+        seen = generation_;
+      }
+      work(worker);
+      {
+        std::lock_guard<std::mutex> guard(mutex_);
+        if (--active_ == 0) done_.notify_one();
+      }
+    }
+  }
+
+  void work(int worker) {
+    int task;
+    while (next_task(worker, &task)) fn_(task, worker, ctx_);
+  }
+
+  bool next_task(int worker, int *task) {
+    {
+      TaskRange &own = ranges_[worker];
+      std::lock_guard<std::mutex> guard(own.lock);
+      if (own.lo < own.hi) {
+        *task = own.lo++;
+        return true;
+      }
+    }
+    // Собственный диапазон пуст - забираем половину хвоста у другого потока
+    for (int i = 1; i < nthreads_; i++) {
+      TaskRange &victim = ranges_[(worker + i) % nthreads_];
+      int lo, hi;
+      {
+        std::lock_guard<std::mutex> guard(victim.lock);
+        int left = victim.hi - victim.lo;
+        if (left <= 0) continue;
+        hi = victim.hi;
+        lo = victim.hi - (left + 1) / 2;
+        victim.hi = lo;
+      }
+      TaskRange &own = ranges_[worker];
+      std::lock_guard<std::mutex> guard(own.lock);
+      own.lo = lo + 1;
+      own.hi = hi;
+      *task = lo;
+      return true;
+    }
+    return false;
+  }
+
+  std::vector<std::thread> workers_;
+  std::unique_ptr<TaskRange[]> ranges_;
+  std::vector<int> cpus_;
+  std::mutex run_mutex_;
+  std::mutex mutex_;
+  std::condition_variable wake_;
+  std::condition_variable done_;
+  long generation_ = 0;
+  int active_ = 0;
+  bool stop_ = false;
+  bool started_ = false;
+  bool pin_ = false;
+  int first_cpu_ = 0;
+  int nthreads_ = 1;
+  mp_task_fn fn_ = nullptr;
+  void *ctx_ = nullptr;
+};
+
+TilePool &pool() {
+  static TilePool instance;
+  return instance;
+}
+
+}  // namespace
+
+extern "C" int mp_pool_set_threads(int threads, int pin) {
+  return pool().set_threads(threads, pin);
+}
+
+extern "C" int mp_pool_get_threads(void) {
+  return pool().threads();
+}
+
+extern "C" void mp_pool_run(int ntasks, mp_task_fn fn, void *ctx) {
+  pool().run(ntasks, fn, ctx);
+}
+
+extern "C" int mp_pool_in_worker(void) {
+  return current_worker >= 0;
+}
+
+extern "C" void mp_pool_after_fork(void) {
+  pool().after_fork();
+}
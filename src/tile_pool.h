@@ -0,0 +1,35 @@
+#ifndef MATRIXPROD_TILE_POOL_H
+#define MATRIXPROD_TILE_POOL_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Задача пула: task - номер задачи, worker - номер исполняющего потока
+typedef void (*mp_task_fn)(int task, int worker, void *ctx);
+
+// Устанавливает число потоков (<= 0 - по числу физических ядер) и закрепление
+// потоков за CPU с учетом NUMA (по умолчанию выключено, pin < 0 - не
+// менять). Потоки создаются сразу. Возвращает предыдущее число потоков.
+int mp_pool_set_threads(int threads, int pin);
+int mp_pool_get_threads(void);
+
+// Выполняет задачи 0..ntasks-1 на пуле с перехватом работы (work stealing).
+// Каждый поток получает непрерывный диапазон задач, а освободившиеся потоки
+// забирают половину оставшегося диапазона у других. Вызов из задачи пула
+// выполняется последовательно в текущем потоке.
+void mp_pool_run(int ntasks, mp_task_fn fn, void *ctx);
+
+// Ненулевое значение внутри задачи пула
+int mp_pool_in_worker(void);
+
+// Обработчик pthread_atfork в дочернем процессе: потоков пула там нет, их
+// объекты и блокировки забываются без join, и пул становится однопоточным
+// до следующего mp_pool_set_threads
+void mp_pool_after_fork(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
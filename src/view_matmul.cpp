@@ -0,0 +1,133 @@
+// Умножение подматриц без копирования: блок X[i0 + 1:nrow, j0 + 1:ncol]
+// матрицы R в формате column-major - это указатель на его первый элемент и
+// шаг между столбцами, равный числу строк всей матрицы. Все ядра пакета
+// принимают такие шаги (lda/ldb/ldc), поэтому блок передается им напрямую.
+#define R_NO_REMAP
+#include <R.h>
+#include <Rinternals.h>
+
+#include <cstring>
+
+#include "blas_backend.h"
+#include "gebp_engine.h"
+#include "matmul_stats.h"
+
+extern "C" {
+void rust_mm_optimized_ld(const double *a_ptr, int lda, const double *b_ptr, int ldb,
+                          double *c_ptr, int ldc, int m, int k, int n);
+void rust_mm_blocked_ld(const double *a_ptr, int lda, const double *b_ptr, int ldb,
+                        double *c_ptr, int ldc, int m, int k, int n);
+void rust_mm_auto_ld(const double *a_ptr, int lda, const double *b_ptr, int ldb,
+                     double *c_ptr, int ldc, int m, int k, int n);
+int mp_metal_dgemm(int trans_a, int trans_b, int M, int N, int K, double alpha,
+                   const double *A, int lda, const double *B, int ldb,
+                   double beta, double *C, int ldc);
+}
+
+namespace {
+
+// Размеры, до которых "auto" использует малое ядро без упаковки
+const int kSmallViewDim = 64;
+
+struct View {
+  const double *data;
+  int ld, rows, cols;
+};
+
+// Проверяет описание блока (смещение строк и столбцов от 0, число строк и
+// столбцов) и возвращает указатель на его первый элемент
+View make_view(SEXP X_r, SEXP view_r, const char *name) {
+  if (!Rf_isReal(X_r) || !Rf_isMatrix(X_r)) {
+    Rf_error("%s должна быть матрицей типа double", name);
+  }
+  if (!Rf_isInteger(view_r) || Rf_length(view_r) != 4) {
+    Rf_error("Некорректное описание блока матрицы %s", name);
+  }
+  SEXP dim = Rf_getAttrib(X_r, R_DimSymbol);
+  int nrow = INTEGER(dim)[0];
+  int ncol = INTEGER(dim)[1];
+  const int *v = INTEGER(view_r);
+  if (v[0] < 0 || v[1] < 0 || v[2] < 0 || v[3] < 0 ||
+      v[0] > nrow - v[2] || v[1] > ncol - v[3]) {
+    Rf_error("Блок выходит за границы матрицы %s", name);
+  }
+  View view = {REAL(X_r) + v[0] + (size_t) v[1] * nrow, nrow > 0 ? nrow : 1, v[2], v[3]};
+  return view;
+}
+
+// Ядра, доступные для блоков; "auto" - малое ядро или BLAS по размеру
+const char *const kViewMethods[] = {"auto", "cpp_accelerate", "block_huge", "rust_tiny",
+                                    "rust_blocked", "rust_auto", "metal_gpu"};
+enum { kAuto, kBlas, kBlockHuge, kRustTiny, kRustBlocked, kRustAuto, kMetal, kViewMethodCount };
+
+int view_method(SEXP method_r) {
+  if (!Rf_isString(method_r) || Rf_length(method_r) != 1) {
+    Rf_error("Метод должен быть строкой");
+  }
+  const char *method = CHAR(STRING_ELT(method_r, 0));
+  for (int i = 0; i < kViewMethodCount; i++) {
+    if (std::strcmp(method, kViewMethods[i]) == 0) return i;
+  }
+  Rf_error("Неизвестный метод: %s", method);
+  return -1;
+}
+
+}  // namespace
+
+// C = A[блок] * B[блок] выбранным ядром; matrix_view в R описывает блоки
+extern "C" SEXP view_matmul(SEXP A_r, SEXP a_view_r, SEXP B_r, SEXP b_view_r, SEXP method_r) {
+  unsigned call = mp_stats_begin(MP_STATS_VIEW);
+  View A = make_view(A_r, a_view_r, "A");
+  View B = make_view(B_r, b_view_r, "B");
+  if (A.cols != B.rows) {
+    Rf_error("Несовместимые размеры матриц");
+  }
+  int method = view_method(method_r);
+  int m = A.rows, k = A.cols, n = B.cols;
+  mp_stats_mark(MP_PHASE_SETUP);
+
+  SEXP C_r = PROTECT(Rf_allocMatrix(REALSXP, m, n));
+  mp_stats_mark(MP_PHASE_ALLOC);
+  double *C = REAL(C_r);
+  int ldc = m > 0 ? m : 1;
+  if (m == 0 || n == 0) {
+    UNPROTECT(1);
+    return C_r;
+  }
+
+  switch (method) {
+  case kAuto:
+    if (m <= kSmallViewDim && n <= kSmallViewDim && k <= kSmallViewDim) {
+      mp_small_dgemm(m, n, k, A.data, A.ld, B.data, B.ld, C, ldc);
+    } else {
+      mp_blas_dgemm(0, 0, m, n, k, 1.0, A.data, A.ld, B.data, B.ld, 0.0, C, ldc);
+    }
+    break;
+  case kBlas:
+    mp_blas_dgemm(0, 0, m, n, k, 1.0, A.data, A.ld, B.data, B.ld, 0.0, C, ldc);
+    break;
+  case kBlockHuge:
+    mp_gebp_dgemm(m, n, k, 1.0, A.data, A.ld, B.data, B.ld, 0.0, C, ldc);
+    break;
+  case kRustTiny:
+    rust_mm_optimized_ld(A.data, A.ld, B.data, B.ld, C, ldc, m, k, n);
+    break;
+  case kRustBlocked:
+    rust_mm_blocked_ld(A.data, A.ld, B.data, B.ld, C, ldc, m, k, n);
+    break;
+  case kRustAuto:
+    rust_mm_auto_ld(A.data, A.ld, B.data, B.ld, C, ldc, m, k, n);
+    break;
+  case kMetal:
+    if (!mp_metal_dgemm(0, 0, m, n, k, 1.0, A.data, A.ld, B.data, B.ld, 0.0, C, ldc)) {
+      UNPROTECT(1);
+      Rf_error("Metal недоступен или не удалось выделить буферы");
+    }
+    break;
+  }
+  mp_stats_mark(MP_PHASE_KERNEL);
+  mp_stats_end_product(call, m, n, k, sizeof(double));
+
+  UNPROTECT(1);
+  return C_r;
+}